@@ -0,0 +1,353 @@
+#include "stdafx.h"
+#include "AudioOutput.h"
+#ifdef _WIN32
+#include "SoundUtility.h"
+#endif
+#include "ClipCache.h"
+#include "Log.h"
+
+
+namespace Utility
+{
+
+    static const size_t max_pcm_cache_size = 32 * 1024 * 1024;
+    static AudioOutputPtr g_audio_output;
+
+
+    AudioOutputPtr get_audio_output()
+    {
+        AudioOutputPtr output = boost::atomic_load( &g_audio_output );
+
+        if ( ! output )
+        {
+            static boost::mutex mutex;
+            boost::unique_lock<boost::mutex> lock( mutex );
+            output = boost::atomic_load( &g_audio_output );
+
+            if ( ! output )
+            {
+                output = AudioOutput::create( L"windows" );
+                boost::atomic_store( &g_audio_output, output );
+            }
+        }
+
+        return output;
+    }
+
+
+    void set_audio_output( AudioOutputPtr output )
+    {
+        boost::atomic_store( &g_audio_output, output );
+    }
+
+
+    AudioOutputPtr AudioOutput::create( const std::wstring& name )
+    {
+        if ( name == L"null" )
+        {
+            return AudioOutputPtr( new WavFileAudioOutput( L"" ) );
+        }
+
+        if ( boost::starts_with( name, L"wav:" ) )
+        {
+            return AudioOutputPtr( new WavFileAudioOutput( name.substr( 4 ) ) );
+        }
+
+#ifdef _WIN32
+        if ( ! name.empty() && name != L"windows" )
+        {
+            LOG << "unknown audio output: " << name << ", use windows";
+        }
+
+        return AudioOutputPtr( new WindowsAudioOutput );
+#else
+        LOG << "no audio output " << name << " here, use null";
+        return AudioOutputPtr( new WavFileAudioOutput( L"" ) );
+#endif
+    }
+
+
+    PcmClipPtr AudioOutput::load_pcm( const std::wstring& file )
+    {
+        if ( ! boost::iequals( boost::filesystem::path( file ).extension().wstring(), L".wav" ) )
+        {
+            return PcmClipPtr();
+        }
+
+        boost::unique_lock<boost::mutex> lock( m_cache_mutex );
+
+        for ( std::list< std::pair<std::wstring, PcmClipPtr> >::iterator it = m_cache.begin(); it != m_cache.end(); ++it )
+        {
+            if ( it->first == file )
+            {
+                m_cache.splice( m_cache.begin(), m_cache, it );
+                return m_cache.front().second;
+            }
+        }
+
+        ClipCache::WavFormat format;
+
+        if ( ! ClipCache::read_format( file, format ) )
+        {
+            return PcmClipPtr();
+        }
+
+        // a streamed or broken header may claim more data than the file has, e.g. 0xFFFFFFFF
+        boost::system::error_code error;
+        boost::uintmax_t file_size = boost::filesystem::file_size( file, error );
+        boost::uintmax_t data_size = ( error || file_size < format.data_offset ? 0 : std::min<boost::uintmax_t>( format.data_size, file_size - format.data_offset ) );
+
+        boost::shared_ptr<PcmClip> clip( new PcmClip );
+        clip->format = format.fmt;
+
+        if ( 0 < data_size )
+        {
+            clip->data.resize( static_cast<size_t>( data_size ) );
+            boost::filesystem::ifstream is( file, std::ios::in | std::ios::binary );
+            is.seekg( format.data_offset, std::ios::beg );
+            is.read( &clip->data[0], clip->data.size() );
+            clip->data.resize( static_cast<size_t>( is.gcount() ) );
+        }
+
+        if ( max_pcm_cache_size < clip->data.size() ) // played once, it would push every other clip out
+        {
+            return clip;
+        }
+
+        m_cache.push_front( std::make_pair( file, clip ) );
+        m_cache_size += clip->data.size();
+
+        while ( max_pcm_cache_size < m_cache_size && 1 < m_cache.size() )
+        {
+            m_cache_size -= m_cache.back().second->data.size();
+            m_cache.pop_back();
+        }
+
+        return clip;
+    }
+
+
+#ifdef _WIN32
+    WindowsAudioOutput::WindowsAudioOutput()
+        : m_device( NULL ),
+          m_done( ::CreateEvent( NULL, FALSE, FALSE, NULL ) ),
+          m_voice( NULL )
+    {
+        ::CoCreateInstance( CLSID_SpVoice, NULL, CLSCTX_ALL, IID_ISpVoice, (void **)&m_voice );
+    }
+
+
+    WindowsAudioOutput::~WindowsAudioOutput()
+    {
+        close_device();
+        ::CloseHandle( m_done );
+
+        if ( m_voice )
+        {
+            m_voice->Release();
+        }
+    }
+
+
+    void WindowsAudioOutput::play( const std::vector<std::wstring>& files )
+    {
+        std::vector<PcmClipPtr> clips;
+
+        for ( size_t i = 0; i < files.size(); ++i )
+        {
+            PcmClipPtr clip = load_pcm( files[i] );
+
+            if ( clip )
+            {
+                clips.push_back( clip );
+            }
+            else // compressed, DirectShow decodes it
+            {
+                play_pcm( clips );
+                clips.clear();
+                play_sound_direct_show( files[i] );
+            }
+        }
+
+        play_pcm( clips );
+    }
+
+
+    static void wait_for_headers( HWAVEOUT device, std::vector<WAVEHDR>& headers, size_t first, size_t last, HANDLE done )
+    {
+        for ( size_t i = first; i < last; ++i )
+        {
+            while ( headers[i].lpData && ! ( headers[i].dwFlags & WHDR_DONE ) )
+            {
+                ::WaitForSingleObject( done, 1000 );
+            }
+
+            if ( headers[i].lpData )
+            {
+                ::waveOutUnprepareHeader( device, &headers[i], sizeof(WAVEHDR) );
+            }
+        }
+    }
+
+
+    // returns when the sequence has played; the stream stays open for the next sequence in the same format
+    void WindowsAudioOutput::play_pcm( const std::vector<PcmClipPtr>& clips )
+    {
+        if ( clips.empty() )
+        {
+            return;
+        }
+
+        boost::unique_lock<boost::mutex> lock( m_device_mutex );
+        std::vector<WAVEHDR> headers( clips.size(), WAVEHDR() );
+        size_t first = 0;
+
+        for ( size_t i = 0; i < clips.size(); ++i )
+        {
+            if ( NULL == m_device || clips[i]->format != m_format ) // drain, another format needs another stream
+            {
+                wait_for_headers( m_device, headers, first, i, m_done );
+                first = i;
+
+                if ( ! open_device( clips[i]->format ) )
+                {
+                    continue;
+                }
+            }
+
+            headers[i].lpData = const_cast<char*>( clips[i]->data.c_str() );
+            headers[i].dwBufferLength = static_cast<DWORD>( clips[i]->data.size() );
+            ::waveOutPrepareHeader( m_device, &headers[i], sizeof(WAVEHDR) );
+
+            if ( MMSYSERR_NOERROR != ::waveOutWrite( m_device, &headers[i], sizeof(WAVEHDR) ) )
+            {
+                ::waveOutUnprepareHeader( m_device, &headers[i], sizeof(WAVEHDR) );
+                headers[i].lpData = NULL;
+            }
+        }
+
+        wait_for_headers( m_device, headers, first, clips.size(), m_done );
+    }
+
+
+    bool WindowsAudioOutput::open_device( const std::string& format )
+    {
+        close_device();
+
+        std::string wave_format = format;
+        wave_format.resize( std::max( wave_format.size(), sizeof(WAVEFORMATEX) ), 0 ); // a 16 bytes fmt chunk has no cbSize
+
+        if ( MMSYSERR_NOERROR != ::waveOutOpen( &m_device, WAVE_MAPPER, reinterpret_cast<const WAVEFORMATEX*>( wave_format.c_str() ), (DWORD_PTR)m_done, 0, CALLBACK_EVENT ) )
+        {
+            LOG << "waveOutOpen error";
+            m_device = NULL;
+            return false;
+        }
+
+        m_format = format;
+        return true;
+    }
+
+
+    void WindowsAudioOutput::close_device()
+    {
+        if ( m_device )
+        {
+            ::waveOutClose( m_device );
+            m_device = NULL;
+            m_format.clear();
+        }
+    }
+
+
+    void WindowsAudioOutput::speak( const std::wstring& text )
+    {
+        boost::unique_lock<boost::mutex> lock( m_voice_mutex );
+
+        if ( m_voice )
+        {
+            m_voice->Speak( text.c_str(), 0, NULL );
+        }
+    }
+#endif
+
+
+    WavFileAudioOutput::WavFileAudioOutput( const std::wstring& file_name )
+        : m_file_name( file_name ),
+          m_data_size( 0 ),
+          m_files( 0 ),
+          m_spoken( 0 )
+    {
+    }
+
+
+    void WavFileAudioOutput::play( const std::vector<std::wstring>& files )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        for ( size_t i = 0; i < files.size(); ++i )
+        {
+            m_files++;
+
+            if ( m_file_name.empty() )
+            {
+                continue;
+            }
+
+            PcmClipPtr clip = load_pcm( files[i] );
+
+            if ( ! clip )
+            {
+                LOG_DEBUG << "not a wav: " << files[i];
+                continue;
+            }
+
+            if ( m_format.empty() )
+            {
+                m_format = clip->format;
+                m_stream.open( m_file_name, std::ios::out | std::ios::binary | std::ios::trunc );
+                write_header();
+            }
+
+            if ( clip->format != m_format )
+            {
+                LOG_DEBUG << "another format: " << files[i];
+                continue;
+            }
+
+            m_stream.seekp( 0, std::ios::end );
+            m_stream.write( clip->data.c_str(), clip->data.size() );
+            m_data_size += clip->data.size();
+            write_header();
+        }
+
+        m_stream.flush();
+    }
+
+
+    void WavFileAudioOutput::speak( const std::wstring& text )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_spoken++;
+        LOG_DEBUG << "speak: " << text;
+    }
+
+
+    void WavFileAudioOutput::write_header()
+    {
+        boost::uint32_t fmt_size = static_cast<boost::uint32_t>( m_format.size() );
+        boost::uint32_t data_size = static_cast<boost::uint32_t>( m_data_size );
+        boost::uint32_t riff_size = 4 + 8 + fmt_size + ( fmt_size & 1 ) + 8 + data_size;
+
+        m_stream.seekp( 0, std::ios::beg );
+        m_stream.write( "RIFF", 4 );
+        m_stream.write( reinterpret_cast<const char*>( &riff_size ), 4 );
+        m_stream.write( "WAVEfmt ", 8 );
+        m_stream.write( reinterpret_cast<const char*>( &fmt_size ), 4 );
+        m_stream.write( m_format.c_str(), fmt_size );
+        if ( fmt_size & 1 ) { m_stream.put( 0 ); }
+        m_stream.write( "data", 4 );
+        m_stream.write( reinterpret_cast<const char*>( &data_size ), 4 );
+    }
+
+}
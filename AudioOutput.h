@@ -0,0 +1,97 @@
+#pragma once
+
+
+namespace Utility
+{
+
+    struct PcmClip
+    {
+        std::string format; // the fmt chunk of the .wav
+        std::string data;   // samples
+    };
+
+    typedef boost::shared_ptr<const PcmClip> PcmClipPtr;
+
+
+    // where recorded words, clips and synthesized speech go. play() gets a whole sequence,
+    // so an output can queue it gaplessly on one stream instead of setting up a stream per file
+    class AudioOutput
+    {
+    public:
+
+        AudioOutput() : m_cache_size( 0 ) {}
+        virtual ~AudioOutput() {}
+        virtual void play( const std::vector<std::wstring>& files ) = 0;
+        virtual void speak( const std::wstring& text ) = 0;
+
+    public:
+
+        PcmClipPtr load_pcm( const std::wstring& file ); // a decoded .wav, NULL for other formats
+
+    public:
+
+        static boost::shared_ptr<AudioOutput> create( const std::wstring& name ); // windows, null, wav:<file>; null for windows off Windows
+
+    public:
+
+        boost::mutex m_cache_mutex;
+        std::list< std::pair<std::wstring, PcmClipPtr> > m_cache; // most recent first
+        size_t m_cache_size;
+    };
+
+    typedef boost::shared_ptr<AudioOutput> AudioOutputPtr;
+
+
+#ifdef _WIN32
+    // .wav sequences on one waveOut stream that stays open until the format changes, DirectShow for compressed files,
+    // one SAPI voice to speak; the process is in the multithreaded apartment (main), so every thread may use the voice
+    class WindowsAudioOutput : public AudioOutput
+    {
+    public:
+
+        WindowsAudioOutput();
+        ~WindowsAudioOutput();
+        virtual void play( const std::vector<std::wstring>& files );
+        virtual void speak( const std::wstring& text );
+        void play_pcm( const std::vector<PcmClipPtr>& clips );
+        bool open_device( const std::string& format ); // should lock outside
+        void close_device();                           // should lock outside
+
+    public:
+
+        boost::mutex m_device_mutex;    // one sequence plays at a time
+        HWAVEOUT m_device;
+        std::string m_format;           // of m_device
+        HANDLE m_done;                  // signaled as each header is done
+        boost::mutex m_voice_mutex;
+        ISpVoice* m_voice;
+    };
+#endif
+
+
+    // plays nothing: appends the samples of every .wav to a file (or drops them) and counts, for tests and benchmarks
+    class WavFileAudioOutput : public AudioOutput
+    {
+    public:
+
+        WavFileAudioOutput( const std::wstring& file_name );
+        virtual void play( const std::vector<std::wstring>& files );
+        virtual void speak( const std::wstring& text );
+        void write_header();
+
+    public:
+
+        boost::mutex m_mutex;
+        std::wstring m_file_name;   // empty: null sink
+        boost::filesystem::ofstream m_stream;
+        std::string m_format;       // of the first clip, clips in other formats are dropped
+        boost::uint64_t m_data_size;
+        size_t m_files;
+        size_t m_spoken;
+    };
+
+
+    AudioOutputPtr get_audio_output();
+    void set_audio_output( AudioOutputPtr output );
+
+}
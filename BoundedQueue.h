@@ -0,0 +1,89 @@
+#pragma once
+
+
+// a fixed capacity FIFO between two pipeline stages: push() waits while it is full, pop() while it is empty.
+// try_push() never waits, it drops the oldest item instead. close() ends it: push() fails at once, pop() still hands out what is left and then fails
+template< typename T >
+struct BoundedQueue
+{
+    explicit BoundedQueue( size_t capacity )
+        : m_capacity( std::max<size_t>( capacity, 1 ) ),
+          m_closed( false )
+    {
+    }
+
+    bool push( const T& item )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        while ( ! m_closed && m_capacity <= m_items.size() )
+        {
+            m_not_full.wait( lock );
+        }
+
+        if ( m_closed )
+        {
+            return false;
+        }
+
+        m_items.push_back( item );
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    bool try_push( const T& item ) // for a stage that must not wait for a slow consumer
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        if ( m_closed )
+        {
+            return false;
+        }
+
+        if ( m_capacity <= m_items.size() )
+        {
+            m_items.pop_front();
+        }
+
+        m_items.push_back( item );
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    bool pop( T& item )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        while ( ! m_closed && m_items.empty() )
+        {
+            m_not_empty.wait( lock );
+        }
+
+        if ( m_items.empty() )
+        {
+            return false;
+        }
+
+        item = m_items.front();
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_closed = true;
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+public:
+
+    size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    boost::mutex m_mutex;
+    boost::condition_variable m_not_full;
+    boost::condition_variable m_not_empty;
+};
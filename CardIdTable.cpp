@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "CardIdTable.h"
+
+
+CardIdTable::card_id CardIdTable::intern( size_t hash )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    boost::unordered_map<size_t, card_id>::iterator it = m_ids.find( hash );
+
+    if ( it != m_ids.end() )
+    {
+        return it->second;
+    }
+
+    card_id id = static_cast<card_id>( m_hashes.size() );
+    m_hashes.push_back( hash );
+    m_ids[hash] = id;
+    return id;
+}
+
+
+CardIdTable::card_id CardIdTable::find( size_t hash )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    boost::unordered_map<size_t, card_id>::iterator it = m_ids.find( hash );
+    return ( it != m_ids.end() ? it->second : invalid_id );
+}
+
+
+size_t CardIdTable::get_hash( card_id id )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_hashes[id];
+}
+
+
+size_t CardIdTable::size()
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_hashes.size();
+}
+
+
+bool CardIdSet::insert( CardIdTable::card_id id )
+{
+    if ( contains( id ) )
+    {
+        return false;
+    }
+
+    if ( m_bits.size() <= id / 32 )
+    {
+        m_bits.resize( id / 32 + 1, 0 );
+    }
+
+    m_bits[id / 32] |= ( 1u << ( id % 32 ) );
+    m_size++;
+    return true;
+}
+
+
+bool CardIdSet::erase( CardIdTable::card_id id )
+{
+    if ( ! contains( id ) )
+    {
+        return false;
+    }
+
+    m_bits[id / 32] &= ~( 1u << ( id % 32 ) );
+    m_size--;
+    return true;
+}
+
+
+std::vector<CardIdTable::card_id> CardIdSet::get_ids() const
+{
+    std::vector<CardIdTable::card_id> ids;
+    ids.reserve( m_size );
+
+    for ( size_t word = 0; word < m_bits.size(); ++word )
+    {
+        for ( boost::uint32_t bits = m_bits[word]; bits != 0; bits &= bits - 1 )
+        {
+            size_t bit = 0;
+
+            while ( 0 == ( bits & ( 1u << bit ) ) )
+            {
+                ++bit;
+            }
+
+            ids.push_back( static_cast<CardIdTable::card_id>( word * 32 + bit ) );
+        }
+    }
+
+    return ids;
+}
+
+
+CardIdSet CardIdSet::difference( const CardIdSet& rhs ) const
+{
+    CardIdSet result;
+    result.m_bits = m_bits;
+
+    for ( size_t word = 0; word < result.m_bits.size(); ++word )
+    {
+        if ( word < rhs.m_bits.size() )
+        {
+            result.m_bits[word] &= ~rhs.m_bits[word];
+        }
+
+        for ( boost::uint32_t bits = result.m_bits[word]; bits != 0; bits &= bits - 1 )
+        {
+            result.m_size++;
+        }
+    }
+
+    return result;
+}
+
+
+bool CardIdSet::operator==( const CardIdSet& rhs ) const
+{
+    if ( m_size != rhs.m_size )
+    {
+        return false;
+    }
+
+    size_t common = std::min( m_bits.size(), rhs.m_bits.size() ); // the longer one has only zero words beyond
+
+    return std::equal( m_bits.begin(), m_bits.begin() + common, rhs.m_bits.begin() );
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+
+// interns content hashes into dense 32 bit card ids when a deck is loaded.
+// ids are append-only and never reused, so per-card data lives in flat arrays and bitmaps indexed by id;
+// hashes are only needed where cards are persisted (.history, .review, .times).
+class CardIdTable
+{
+public:
+
+    typedef boost::uint32_t card_id;
+    static const card_id invalid_id = 0xFFFFFFFF;
+
+public:
+
+    card_id intern( size_t hash );
+    card_id find( size_t hash );
+    size_t get_hash( card_id id );
+    size_t get_hash_no_lock( card_id id ) const { return m_hashes[id]; } // should lock outside
+    size_t size();
+
+public:
+
+    boost::mutex m_mutex;
+    std::vector<size_t> m_hashes;                   // id -> hash
+    boost::unordered_map<size_t, card_id> m_ids;    // hash -> id
+};
+
+
+// a set of card ids, a bitmap indexed by id and its count: membership is one bit test, iteration is in id order
+class CardIdSet
+{
+public:
+
+    CardIdSet() : m_size( 0 ) {}
+    bool insert( CardIdTable::card_id id ); // false if it was in already
+    bool erase( CardIdTable::card_id id );  // false if it was not in
+    bool contains( CardIdTable::card_id id ) const { return id / 32 < m_bits.size() && ( m_bits[id / 32] & ( 1u << ( id % 32 ) ) ); }
+    size_t size() const { return m_size; }
+    bool empty() const { return 0 == m_size; }
+    void clear() { m_bits.clear(); m_size = 0; }
+    std::vector<CardIdTable::card_id> get_ids() const; // ascending
+    CardIdSet difference( const CardIdSet& rhs ) const; // the ids not in rhs
+    bool operator==( const CardIdSet& rhs ) const;
+    bool operator!=( const CardIdSet& rhs ) const { return ! ( *this == rhs ); }
+
+public:
+
+    std::vector<boost::uint32_t> m_bits;    // bit i % 32 of word i / 32 for id i, the same layout as due_bitmap
+    size_t m_size;
+};
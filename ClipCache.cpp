@@ -0,0 +1,273 @@
+#include "stdafx.h"
+#include "ClipCache.h"
+#include "Utility.h"
+#include "Log.h"
+
+static const boost::uint32_t window_size = 4 * 1024 * 1024; // about 20 seconds of CD quality audio
+
+
+ClipCache::ClipCache()
+    : m_max_size( 0 ),
+      m_size( 0 ),
+      m_window_begin( 0 )
+{
+}
+
+
+void ClipCache::configure( const std::wstring& directory, boost::uint64_t max_size )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( directory != m_directory )
+    {
+        m_directory = directory;
+        m_lru.clear();
+        m_clips.clear();
+        m_size = 0;
+
+        boost::system::error_code ec;
+        std::multimap<std::time_t, std::pair<std::wstring, boost::uint64_t> > clips; // oldest first
+
+        for ( boost::filesystem::directory_iterator it( m_directory, ec ), end; ! ec && it != end; it.increment( ec ) )
+        {
+            if ( boost::filesystem::is_regular_file( it->path() ) && it->path().extension() == L".wav" )
+            {
+                clips.insert( std::make_pair( boost::filesystem::last_write_time( it->path() ), std::make_pair( it->path().wstring(), boost::filesystem::file_size( it->path() ) ) ) );
+            }
+        }
+
+        for ( std::multimap<std::time_t, std::pair<std::wstring, boost::uint64_t> >::iterator it = clips.begin(); it != clips.end(); ++it )
+        {
+            touch( it->second.first, it->second.second );
+        }
+
+        LOG_DEBUG << "clip cache: " << m_directory << ", " << m_lru.size() << " clips, " << m_size << " bytes";
+    }
+
+    m_max_size = max_size;
+    evict();
+}
+
+
+std::wstring ClipCache::get_clip( const std::wstring& media, size_t start_time, size_t stop_time )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( m_directory.empty() || stop_time <= start_time )
+    {
+        return L"";
+    }
+
+    boost::system::error_code ec;
+    std::time_t media_time = boost::filesystem::last_write_time( media, ec );
+    std::map<std::wstring, WavFormat>::iterator format = m_formats.find( media );
+
+    if ( format != m_formats.end() && format->second.last_write_time != media_time ) // replaced: its format and read window are stale
+    {
+        m_formats.erase( format );
+
+        if ( m_window_media == media )
+        {
+            m_window_media.clear();
+            m_window.clear();
+        }
+    }
+
+    std::wstringstream key; // with the media time, so clips cut from a replaced media are not served again (they age out)
+    key << media << L"|" << media_time << L"|" << start_time << L"|" << stop_time;
+    std::string utf8 = Utility::to_string( key.str(), CP_UTF8 );
+    std::wstringstream name;
+    name << std::hex << std::setw( 16 ) << std::setfill( L'0' ) << Utility::xxhash64( utf8.c_str(), utf8.size() ) << L".wav";
+    std::wstring clip = ( boost::filesystem::path( m_directory ) / name.str() ).wstring();
+
+    if ( m_clips.find( clip ) != m_clips.end() && boost::filesystem::exists( clip ) )
+    {
+        boost::filesystem::last_write_time( clip, std::time(0), ec ); // keeps the order after a restart
+    }
+    else if ( ! make_clip( media, start_time, stop_time, clip ) )
+    {
+        return L"";
+    }
+
+    touch( clip, boost::filesystem::file_size( clip ) );
+    evict();
+    return clip;
+}
+
+
+bool ClipCache::make_clip( const std::wstring& media, size_t start_time, size_t stop_time, const std::wstring& clip )
+{
+    std::map<std::wstring, WavFormat>::iterator it = m_formats.find( media );
+
+    if ( it == m_formats.end() )
+    {
+        WavFormat format;
+
+        if ( ! read_format( media, format ) )
+        {
+            LOG << "not a PCM wav: " << media;
+            return false;
+        }
+
+        boost::system::error_code ec;
+        format.last_write_time = boost::filesystem::last_write_time( media, ec );
+
+        it = m_formats.insert( std::make_pair( media, format ) ).first;
+    }
+
+    const WavFormat& format = it->second;
+    boost::uint64_t begin = static_cast<boost::uint64_t>( start_time ) * format.byte_rate / 1000 / format.block_align * format.block_align;
+    boost::uint64_t end = static_cast<boost::uint64_t>( stop_time ) * format.byte_rate / 1000 / format.block_align * format.block_align;
+    end = std::min<boost::uint64_t>( end, format.data_size );
+    std::string data;
+
+    if ( end <= begin || ! read_range( media, static_cast<boost::uint32_t>( format.data_offset + begin ), static_cast<boost::uint32_t>( end - begin ), data ) )
+    {
+        return false;
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories( m_directory, ec );
+    std::ofstream os( clip.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    boost::uint32_t fmt_size = static_cast<boost::uint32_t>( format.fmt.size() );
+    boost::uint32_t data_size = static_cast<boost::uint32_t>( data.size() );
+    boost::uint32_t riff_size = 4 + 8 + fmt_size + ( fmt_size & 1 ) + 8 + data_size;
+
+    os.write( "RIFF", 4 );
+    os.write( reinterpret_cast<const char*>( &riff_size ), 4 );
+    os.write( "WAVEfmt ", 8 );
+    os.write( reinterpret_cast<const char*>( &fmt_size ), 4 );
+    os.write( format.fmt.c_str(), fmt_size );
+    if ( fmt_size & 1 ) { os.put( 0 ); }
+    os.write( "data", 4 );
+    os.write( reinterpret_cast<const char*>( &data_size ), 4 );
+    os.write( data.c_str(), data_size );
+
+    if ( ! os )
+    {
+        LOG << "cannot write: " << clip;
+        return false;
+    }
+
+    LOG_DEBUG << "clip " << clip << ": " << media << " " << start_time << "-" << stop_time;
+    return true;
+}
+
+
+bool ClipCache::read_range( const std::wstring& media, boost::uint32_t begin, boost::uint32_t size, std::string& data )
+{
+    if ( media == m_window_media && m_window_begin <= begin && begin + size <= m_window_begin + m_window.size() )
+    {
+        data.assign( m_window, begin - m_window_begin, size );
+        return true;
+    }
+
+    std::ifstream is( media.c_str(), std::ios::in | std::ios::binary );
+
+    if ( ! is )
+    {
+        return false;
+    }
+
+    m_window.resize( std::max( size, window_size ) );
+    is.seekg( begin, std::ios::beg );
+    is.read( &m_window[0], m_window.size() );
+    m_window.resize( static_cast<size_t>( is.gcount() ) );
+    m_window_media = media;
+    m_window_begin = begin;
+
+    if ( m_window.size() < size )
+    {
+        return false;
+    }
+
+    data.assign( m_window, 0, size );
+    return true;
+}
+
+
+void ClipCache::touch( const std::wstring& clip, boost::uint64_t size )
+{
+    std::map< std::wstring, std::list< std::pair<std::wstring, boost::uint64_t> >::iterator >::iterator it = m_clips.find( clip );
+
+    if ( it != m_clips.end() )
+    {
+        m_size -= it->second->second;
+        m_lru.erase( it->second );
+    }
+
+    m_lru.push_front( std::make_pair( clip, size ) );
+    m_clips[clip] = m_lru.begin();
+    m_size += size;
+}
+
+
+void ClipCache::evict()
+{
+    while ( m_max_size < m_size && 1 < m_lru.size() )
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove( m_lru.back().first, ec );
+        m_size -= m_lru.back().second;
+        m_clips.erase( m_lru.back().first );
+        m_lru.pop_back();
+    }
+}
+
+
+bool ClipCache::read_format( const std::wstring& media, WavFormat& format )
+{
+    std::ifstream is( media.c_str(), std::ios::in | std::ios::binary );
+    char riff[12] = { 0 };
+    is.read( riff, 12 );
+
+    if ( ! is || 0 != memcmp( riff, "RIFF", 4 ) || 0 != memcmp( riff + 8, "WAVE", 4 ) )
+    {
+        return false;
+    }
+
+    boost::uint32_t offset = 12;
+
+    while ( true )
+    {
+        char id[4] = { 0 };
+        boost::uint32_t size = 0;
+        is.read( id, 4 );
+        is.read( reinterpret_cast<char*>( &size ), 4 );
+        offset += 8;
+
+        if ( ! is )
+        {
+            return false;
+        }
+
+        if ( 0 == memcmp( id, "fmt ", 4 ) )
+        {
+            if ( size < 16 )
+            {
+                return false;
+            }
+
+            boost::uint16_t tag = 0;
+            format.fmt.resize( size );
+            is.read( &format.fmt[0], size );
+            memcpy( &tag, &format.fmt[0], 2 );
+            memcpy( &format.byte_rate, &format.fmt[8], 4 );
+            memcpy( &format.block_align, &format.fmt[12], 2 );
+
+            if ( ( tag != 1 && tag != 3 && tag != 0xFFFE ) || 0 == format.byte_rate || 0 == format.block_align ) // PCM, float, extensible
+            {
+                return false;
+            }
+        }
+        else if ( 0 == memcmp( id, "data", 4 ) )
+        {
+            format.data_offset = offset;
+            format.data_size = size;
+            return ! format.fmt.empty();
+        }
+
+        offset += size + ( size & 1 );
+        is.seekg( offset, std::ios::beg );
+    }
+}
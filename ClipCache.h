@@ -0,0 +1,47 @@
+#pragma once
+
+
+// cuts [start, stop) milliseconds out of a local PCM .wav into small clip files, so a subtitle card
+// plays its own line without seeking and decoding the whole media; least recently used clips are removed
+class ClipCache
+{
+public:
+
+    struct WavFormat
+    {
+        WavFormat() : byte_rate( 0 ), block_align( 0 ), data_offset( 0 ), data_size( 0 ), last_write_time( 0 ) {}
+        std::string fmt;                // the fmt chunk, copied into every clip
+        boost::uint32_t byte_rate;
+        boost::uint16_t block_align;
+        boost::uint32_t data_offset;
+        boost::uint32_t data_size;
+        std::time_t last_write_time;    // of the media it was read from
+    };
+
+public:
+
+    ClipCache();
+    void configure( const std::wstring& directory, boost::uint64_t max_size );
+    std::wstring get_clip( const std::wstring& media, size_t start_time, size_t stop_time ); // empty if it can not be cut
+
+public:
+
+    bool make_clip( const std::wstring& media, size_t start_time, size_t stop_time, const std::wstring& clip );
+    bool read_range( const std::wstring& media, boost::uint32_t begin, boost::uint32_t size, std::string& data );
+    void touch( const std::wstring& clip, boost::uint64_t size );
+    void evict();
+    static bool read_format( const std::wstring& media, WavFormat& format );
+
+public:
+
+    boost::mutex m_mutex;
+    std::wstring m_directory;
+    boost::uint64_t m_max_size;
+    boost::uint64_t m_size;
+    std::list< std::pair<std::wstring, boost::uint64_t> > m_lru;  // clip and its size, most recent first
+    std::map< std::wstring, std::list< std::pair<std::wstring, boost::uint64_t> >::iterator > m_clips;
+    std::map<std::wstring, WavFormat> m_formats;                    // media -> format, dropped when the media is replaced
+    std::wstring m_window_media;                                    // the last bytes read, neighbouring cues reuse them
+    boost::uint32_t m_window_begin;
+    std::string m_window;
+};
@@ -4,6 +4,7 @@
 #include "OptionUpdateHelper.h"
 #include "ProgramOptions.h"
 #include "Utility.h"
+#include "ConsoleFrame.h"
 
 
 ConsoleCommand::ConsoleCommand()
@@ -88,6 +89,13 @@ void ConsoleCommand::update_option( const boost::program_options::variables_map&
         set_console_color( color );
         LOG_DEBUG << "console-color: " << color;
     }
+
+    if ( option_helper.update_one_option<std::wstring>( system_console_renderer, vm, L"windows" ) )
+    {
+        std::wstring renderer = option_helper.get_value<std::wstring>( system_console_renderer );
+        Utility::console_frame().set_backend( Utility::ConsoleBackend::create( renderer ) );
+        LOG_DEBUG << "console-renderer: " << renderer;
+    }
 }
 
 
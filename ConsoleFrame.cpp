@@ -0,0 +1,364 @@
+#include "stdafx.h"
+#include "ConsoleFrame.h"
+#ifdef _WIN32
+#include "ConsoleUtility.h"
+#endif
+#include "UnicodeUtility.h"
+#include "Log.h"
+
+
+namespace Utility
+{
+
+    static ConsoleFrame frame; // constructed before main, so no race on first use
+
+
+    ConsoleFrame& console_frame()
+    {
+        return frame;
+    }
+
+
+    ConsoleBackendPtr ConsoleBackend::create( const std::wstring& name )
+    {
+        if ( name == L"ansi" )
+        {
+            return ConsoleBackendPtr( new AnsiConsoleBackend );
+        }
+
+#ifdef _WIN32
+        if ( ! name.empty() && name != L"windows" )
+        {
+            LOG << "unknown console renderer: " << name << ", use windows";
+        }
+
+        return ConsoleBackendPtr( new WindowsConsoleBackend );
+#else
+        LOG << "no console renderer " << name << " here, use ansi";
+        return ConsoleBackendPtr( new AnsiConsoleBackend );
+#endif
+    }
+
+
+#ifdef _WIN32
+    WindowsConsoleBackend::WindowsConsoleBackend()
+        : m_attributes( 0 )
+    {
+        COORD origin = { 0, 0 };
+        SMALL_RECT empty = { 0, 0, 0, 0 };
+        m_cursor = origin;
+        m_window = empty;
+    }
+
+
+    void WindowsConsoleBackend::get_size( size_t& width, size_t& height )
+    {
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        GetConsoleScreenBufferInfo( cout(), &csbi );
+        width = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        height = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    }
+
+
+    bool WindowsConsoleBackend::is_intact()
+    {
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        GetConsoleScreenBufferInfo( cout(), &csbi );
+
+        return csbi.dwCursorPosition.X == m_cursor.X && csbi.dwCursorPosition.Y == m_cursor.Y
+            && csbi.srWindow.Left == m_window.Left && csbi.srWindow.Top == m_window.Top
+            && csbi.srWindow.Right == m_window.Right && csbi.srWindow.Bottom == m_window.Bottom
+            && csbi.wAttributes == m_attributes;
+    }
+
+
+    void WindowsConsoleBackend::draw( const std::vector<wchar_t>& cells, size_t width, const std::vector< std::pair<size_t, size_t> >& runs, size_t cursor )
+    {
+        HANDLE handle = cout();
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        GetConsoleScreenBufferInfo( handle, &csbi );
+
+        if ( ! runs.empty() ) // the rows from the first change to the last one
+        {
+            size_t first_row = runs.front().first / width;
+            size_t last_row = ( runs.back().second - 1 ) / width;
+            std::vector<CHAR_INFO> buffer( ( last_row - first_row + 1 ) * width );
+
+            for ( size_t i = 0; i < buffer.size(); ++i )
+            {
+                size_t cell = first_row * width + i;
+                buffer[i].Attributes = csbi.wAttributes;
+                buffer[i].Char.UnicodeChar = cells[cell];
+
+                if ( 0 == cells[cell] )
+                {
+                    buffer[i].Char.UnicodeChar = cells[cell - 1];
+                    buffer[i].Attributes |= COMMON_LVB_TRAILING_BYTE;
+                }
+                else if ( cell + 1 < cells.size() && 0 == cells[cell + 1] )
+                {
+                    buffer[i].Attributes |= COMMON_LVB_LEADING_BYTE;
+                }
+            }
+
+            COORD size = { static_cast<SHORT>( width ), static_cast<SHORT>( last_row - first_row + 1 ) };
+            COORD origin = { 0, 0 };
+            SMALL_RECT region = { csbi.srWindow.Left, static_cast<SHORT>( csbi.srWindow.Top + first_row ), static_cast<SHORT>( csbi.srWindow.Left + width - 1 ), static_cast<SHORT>( csbi.srWindow.Top + last_row ) };
+            WriteConsoleOutputW( handle, &buffer[0], size, origin, &region );
+        }
+
+        cursor = std::min( cursor, cells.size() - 1 );
+        m_cursor.X = static_cast<SHORT>( csbi.srWindow.Left + cursor % width );
+        m_cursor.Y = static_cast<SHORT>( csbi.srWindow.Top + cursor / width );
+        SetConsoleCursorPosition( handle, m_cursor );
+        m_window = csbi.srWindow;
+        m_attributes = csbi.wAttributes;
+    }
+#endif
+
+
+    void AnsiConsoleBackend::get_size( size_t& width, size_t& height )
+    {
+        const char* columns = std::getenv( "COLUMNS" );
+        const char* lines = std::getenv( "LINES" );
+        width = ( columns && 0 < std::atoi( columns ) ? std::atoi( columns ) : 80 );
+        height = ( lines && 0 < std::atoi( lines ) ? std::atoi( lines ) : 24 );
+    }
+
+
+    void AnsiConsoleBackend::draw( const std::vector<wchar_t>& cells, size_t width, const std::vector< std::pair<size_t, size_t> >& runs, size_t cursor )
+    {
+        std::stringstream strm;
+
+        for ( size_t i = 0; i < runs.size(); ++i )
+        {
+            std::wstring text;
+
+            for ( size_t j = runs[i].first; j < runs[i].second; ++j )
+            {
+                if ( cells[j] ) // the terminal moves two columns for a wide character itself
+                {
+                    text.push_back( cells[j] );
+                }
+            }
+
+            strm << "\x1b[" << ( runs[i].first / width + 1 ) << ";" << ( runs[i].first % width + 1 ) << "H" << to_string( text, CP_UTF8 );
+        }
+
+        cursor = std::min( cursor, cells.size() - 1 );
+        strm << "\x1b[" << ( cursor / width + 1 ) << ";" << ( cursor % width + 1 ) << "H";
+        std::string s = strm.str();
+        std::fwrite( s.c_str(), 1, s.size(), stdout );
+        std::fflush( stdout );
+    }
+
+
+    ConsoleFrame::ConsoleFrame()
+#ifdef _WIN32
+        : m_backend( new WindowsConsoleBackend ),
+#else
+        : m_backend( new AnsiConsoleBackend ),
+#endif
+          m_width( 0 ),
+          m_height( 0 ),
+          m_cursor( 0 )
+    {
+    }
+
+
+    void ConsoleFrame::set_backend( ConsoleBackendPtr backend )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_backend = backend;
+        m_screen.clear();
+    }
+
+
+    void ConsoleFrame::clear()
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        clear_locked();
+    }
+
+
+    void ConsoleFrame::clear_locked()
+    {
+        size_t width = 0;
+        size_t height = 0;
+        m_backend->get_size( width, height );
+
+        if ( width != m_width || height != m_height )
+        {
+            m_width = std::max<size_t>( width, 1 );
+            m_height = std::max<size_t>( height, 1 );
+            m_screen.clear();
+        }
+
+        m_cells.assign( m_width * m_height, L' ' );
+        m_cursor = 0;
+    }
+
+
+    void ConsoleFrame::write( const std::wstring& s )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        if ( m_cells.empty() )
+        {
+            clear_locked();
+        }
+        put( m_cursor, s );
+    }
+
+
+    void ConsoleFrame::write_center( const std::wstring& s )
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        if ( m_cells.empty() )
+        {
+            clear_locked();
+        }
+        size_t width = 0;
+
+        for ( size_t i = 0; i < s.size(); ++i )
+        {
+            width += char_width( s[i] );
+        }
+
+        size_t height = ( 0 == m_height % 2 && 1 < m_height ? m_height - 1 : m_height ); // an odd height has a middle row
+        size_t position = ( width < m_width * height ? ( m_width * height - width ) / 2 : 0 );
+        put( position, s );
+    }
+
+
+    void ConsoleFrame::present()
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        if ( m_cells.empty() )
+        {
+            return;
+        }
+
+        std::vector< std::pair<size_t, size_t> > runs;
+
+        if ( m_screen.size() != m_cells.size() || ! m_backend->is_intact() )
+        {
+            runs.push_back( std::make_pair( 0, m_cells.size() ) );
+        }
+        else
+        {
+            for ( size_t i = 0; i < m_cells.size(); ++i )
+            {
+                if ( m_cells[i] == m_screen[i] )
+                {
+                    continue;
+                }
+
+                size_t begin = ( 0 == m_cells[i] || 0 == m_screen[i] ? i - 1 : i ); // both halves of a wide character
+                size_t end = i + 1;
+
+                while ( end < m_cells.size() && ( m_cells[end] != m_screen[end] || 0 == m_cells[end] ) )
+                {
+                    ++end;
+                }
+
+                if ( ! runs.empty() && begin <= runs.back().second + 8 ) // one sequence is cheaper than a few equal cells
+                {
+                    runs.back().second = end;
+                }
+                else
+                {
+                    runs.push_back( std::make_pair( begin, end ) );
+                }
+
+                i = end - 1;
+            }
+        }
+
+        m_backend->draw( m_cells, m_width, runs, m_cursor );
+        m_screen = m_cells;
+    }
+
+
+    void ConsoleFrame::invalidate()
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_screen.clear();
+    }
+
+
+    void ConsoleFrame::put( size_t& position, const std::wstring& s )
+    {
+        size_t size = m_cells.size();
+
+        for ( size_t i = 0; i < s.size() && position < size; ++i )
+        {
+            wchar_t ch = s[i];
+
+            if ( ch == L'\n' )
+            {
+                position = ( position / m_width + 1 ) * m_width;
+            }
+            else if ( ch == L'\r' )
+            {
+                position = position / m_width * m_width;
+            }
+            else if ( ch == L'\t' )
+            {
+                size_t column = position % m_width;
+                position += std::min( 8 - column % 8, m_width - column );
+            }
+            else
+            {
+                size_t width = char_width( ch );
+
+                if ( 2 == width && position % m_width == m_width - 1 ) // no room for both halves, it goes to the next row
+                {
+                    m_cells[position++] = L' ';
+                }
+
+                if ( size < position + width )
+                {
+                    position = size;
+                    break;
+                }
+
+                if ( 0 == m_cells[position] ) // half of an old wide character is left, blank the other half
+                {
+                    m_cells[position - 1] = L' ';
+                }
+
+                if ( position + width < size && 0 == m_cells[position + width] )
+                {
+                    m_cells[position + width] = L' ';
+                }
+
+                m_cells[position] = ch;
+
+                if ( 2 == width )
+                {
+                    m_cells[position + 1] = 0;
+                }
+
+                position += width;
+            }
+        }
+
+        position = std::min( position, size );
+    }
+
+
+    size_t ConsoleFrame::char_width( wchar_t ch )
+    {
+        if ( ( 0x1100 <= ch && ch <= 0x115F ) || ( 0x2E80 <= ch && ch <= 0xA4CF && ch != 0x303F ) || ( 0xAC00 <= ch && ch <= 0xD7A3 ) ||
+             ( 0xF900 <= ch && ch <= 0xFAFF ) || ( 0xFE30 <= ch && ch <= 0xFE4F ) || ( 0xFF00 <= ch && ch <= 0xFF60 ) || ( 0xFFE0 <= ch && ch <= 0xFFE6 ) )
+        {
+            return 2;
+        }
+
+        return 1;
+    }
+
+}
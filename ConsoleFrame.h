@@ -0,0 +1,90 @@
+#pragma once
+
+
+namespace Utility
+{
+
+    // where a frame goes. cells holds width * height characters, 0 for the right half of a wide one;
+    // runs are the [begin, end) ranges of cells that changed since the last draw
+    class ConsoleBackend
+    {
+    public:
+
+        virtual ~ConsoleBackend() {}
+        virtual void get_size( size_t& width, size_t& height ) = 0;
+        virtual bool is_intact() = 0; // the screen still shows the last draw, nothing else wrote to it
+        virtual void draw( const std::vector<wchar_t>& cells, size_t width, const std::vector< std::pair<size_t, size_t> >& runs, size_t cursor ) = 0;
+
+    public:
+
+        static boost::shared_ptr<ConsoleBackend> create( const std::wstring& name ); // windows, ansi; ansi off Windows
+    };
+
+    typedef boost::shared_ptr<ConsoleBackend> ConsoleBackendPtr;
+
+
+#ifdef _WIN32
+    // the visible window of the Windows console, changed rows in one WriteConsoleOutputW
+    class WindowsConsoleBackend : public ConsoleBackend
+    {
+    public:
+
+        WindowsConsoleBackend();
+        virtual void get_size( size_t& width, size_t& height );
+        virtual bool is_intact();
+        virtual void draw( const std::vector<wchar_t>& cells, size_t width, const std::vector< std::pair<size_t, size_t> >& runs, size_t cursor );
+
+    public:
+
+        COORD m_cursor;         // where the last draw left the cursor
+        SMALL_RECT m_window;
+        WORD m_attributes;
+    };
+#endif
+
+
+    // VT escape sequences on stdout, for terminals; changed runs in one write
+    class AnsiConsoleBackend : public ConsoleBackend
+    {
+    public:
+
+        virtual void get_size( size_t& width, size_t& height ); // $COLUMNS x $LINES, 80 x 24 if unset
+        virtual bool is_intact() { return true; }
+        virtual void draw( const std::vector<wchar_t>& cells, size_t width, const std::vector< std::pair<size_t, size_t> >& runs, size_t cursor );
+    };
+
+
+    // a card is composed off-screen into cells, and present() sends the cells that differ from the screen in one write
+    class ConsoleFrame
+    {
+    public:
+
+        ConsoleFrame();
+        void set_backend( ConsoleBackendPtr backend );
+        void clear();                                   // blank cells of the window size, cursor at the top left
+        void write( const std::wstring& s );            // at the cursor; \n, \t and wrapping like the console
+        void write_center( const std::wstring& s );     // centered in the window, the cursor stays
+        void present();
+        void invalidate();                              // the next present() redraws every cell
+
+    public:
+
+        void clear_locked();                            // clear() under m_mutex
+        void put( size_t& position, const std::wstring& s );
+        static size_t char_width( wchar_t ch );         // 2 for east asian wide characters
+
+    public:
+
+        boost::mutex m_mutex;
+        ConsoleBackendPtr m_backend;
+        size_t m_width;
+        size_t m_height;
+        size_t m_cursor;
+        std::vector<wchar_t> m_cells;
+        std::vector<wchar_t> m_screen;                  // what the last present() sent, empty if unknown
+    };
+
+
+    ConsoleFrame& console_frame();
+
+}
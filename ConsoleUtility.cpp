@@ -2,6 +2,7 @@
 #include "ConsoleUtility.h"
 #include "UnicodeUtility.h"
 #include "WriteConsoleHelper.h"
+#include "ConsoleFrame.h"
 
 
 namespace Utility
@@ -159,6 +160,13 @@ namespace Utility
 
     void cls( HANDLE handle )
     {
+        if ( handle == cout() ) // only the cells that are not blank yet
+        {
+            console_frame().clear();
+            console_frame().present();
+            return;
+        }
+
         DWORD written = 0;
         COORD coord = { 0, 0 };
         CONSOLE_SCREEN_BUFFER_INFO csbi;
@@ -200,7 +208,12 @@ namespace Utility
 
     void write_console_on_center( const std::wstring& s, HANDLE output )
     {
-        std::string as = to_string( s, 936 );
+        size_t width = 0;
+
+        for ( size_t i = 0; i < s.size(); ++i )
+        {
+            width += ConsoleFrame::char_width( s[i] );
+        }
 
         DWORD written = 0;
         CONSOLE_SCREEN_BUFFER_INFO csbi;
@@ -213,7 +226,7 @@ namespace Utility
             --window_height;
         }
 
-        size_t pos = ( window_width * window_height - as.size() ) / 2;
+        size_t pos = ( width < window_width * window_height ? ( window_width * window_height - width ) / 2 : 0 );
         COORD coord = { pos % window_width, pos / window_width };
         WriteConsoleOutputCharacter( output, s.c_str(), s.size(), coord, &written );
     }
@@ -0,0 +1,216 @@
+#include "stdafx.h"
+#include "Deck.h"
+#include "History.h"
+#include "Loader.h"
+#include "Utility.h"
+#include "Log.h"
+
+
+struct Order
+{
+    Order( Loader* l, History* h ) : loader(l), history(h) {}
+
+    bool operator()( size_t lhs, size_t rhs ) const
+    {
+        size_t lr = history->get_review_round(lhs);
+        size_t rr = history->get_review_round(rhs);
+        std::time_t lt = history->get_last_review_time( lhs );
+        std::time_t rt = history->get_last_review_time( rhs );
+        return ( ( lr < rr ) || ( lr == rr && rt < lt ) || ( lr == rr && lt == rt && lhs < rhs ) );
+    }
+
+    Loader* loader;
+    History* history;
+};
+
+
+Deck::Deck( const std::wstring& file_name )
+    : m_file_name( file_name ),
+      m_name_hash( 0 ),
+      m_loader( NULL ),
+      m_history( NULL )
+{
+    std::wstring name = boost::to_lower_copy( file_name );
+    m_name_hash = static_cast<boost::uint32_t>( Utility::xxhash64( name.data(), name.size() * sizeof(wchar_t) ) );
+    m_loader = new Loader( file_name );
+    m_history = new History( &m_loader->get_card_ids(), file_name );
+}
+
+
+Deck::~Deck()
+{
+    delete m_history;
+    delete m_loader;
+}
+
+
+void Deck::initialize()
+{
+    upgrade_hash_algorithm();
+    m_history->initialize();
+    m_history->synchronize_history( m_loader->get_card_set() );
+}
+
+
+bool Deck::update()
+{
+    LOG_TRACE << "begin";
+
+    const CardIdSet& all = m_loader->get_card_set();
+
+    if ( m_all.size() != all.size() ) // no need precise
+    {
+        m_all = all;
+        m_history->synchronize_history( m_all );
+    }
+
+    CardIdSet expired = m_history->get_expired();
+
+    if ( m_reviewing_set.size() == expired.size() )
+    {
+        LOG_TRACE << "end";
+        return false;
+    }
+
+    if ( ! m_reviewing_set.empty() )
+    {
+        LOG_DEBUG
+            << m_file_name << ": "
+            << "old-size=" << m_reviewing_set.size()
+            << ", new-size=" << expired.size() << ""
+            << get_new_expired_string( m_reviewing_set, expired )
+            ;
+    }
+    else
+    {
+        LOG_DEBUG
+            << m_file_name << ": "
+            << "old-size=" << m_reviewing_set.size()
+            << ", new-size=" << expired.size() << ""
+            ;
+    }
+
+    m_reviewing_set = expired;
+    std::vector<CardIdTable::card_id> ids = m_reviewing_set.get_ids();
+    m_reviewing_list.clear();
+
+    for ( size_t i = 0; i < ids.size(); ++i )
+    {
+        m_reviewing_list.push_back( m_loader->get_card_ids().get_hash( ids[i] ) );
+    }
+
+    m_reviewing_list.sort( Order( m_loader, m_history ) );
+    LOG_DEBUG << "sort " << m_reviewing_list.size();
+    // LOG_TEST<< std::endl << get_hash_list_string( m_reviewing_list );
+
+    LOG_TRACE << "end";
+    return true;
+}
+
+
+CardIdTable::card_id Deck::get_card_id( size_t hash )
+{
+    return m_loader->get_card_ids().intern( hash );
+}
+
+
+size_t& Deck::get_review_number( size_t hash )
+{
+    CardIdTable::card_id id = get_card_id( hash );
+
+    if ( m_review_numbers.size() <= id )
+    {
+        m_review_numbers.resize( id + 1, 0 );
+    }
+
+    return m_review_numbers[id];
+}
+
+
+std::wstring Deck::get_new_expired_string( const CardIdSet& os,  const CardIdSet& ns )
+{
+    std::vector<CardIdTable::card_id> added = ns.difference( os ).get_ids();
+    std::wstringstream strm;
+
+    for ( size_t i = 0; i < added.size(); ++i )
+    {
+        size_t hash = m_loader->get_card_ids().get_hash( added[i] );
+        size_t round = m_history->get_review_round( hash );
+        std::time_t last_review = m_history->get_last_review_time( hash );
+        std::time_t elapsed = std::time(0) - last_review;
+        const std::wstring& s = m_loader->get_string( hash );
+        strm << std::endl << L"expired: " << round << L" (" << Utility::duration_string_from_seconds(elapsed) << L") " << s;
+    }
+
+    return strm.str();
+}
+
+
+std::wostream& Deck::output_hash_list( std::wostream& os, const std::list<size_t>& l )
+{
+    for ( std::list<size_t>::const_iterator it = l.begin(); it != l.end(); ++it )
+    {
+        size_t hash = *it;
+        std::time_t t = m_history->get_last_review_time( hash );
+        size_t r = m_history->get_review_round( hash );
+        const std::wstring& s = m_loader->get_string( hash );
+
+        os
+            << r << L"\t"
+            << Utility::string_from_time_t( t ) << L"\t"
+            << s.size() << L"\t"
+            << s << L"\n";
+            ;
+    }
+
+    return os;
+}
+
+
+std::wstring Deck::get_hash_list_string( const std::list<size_t>& l )
+{
+    std::wstringstream strm;
+    output_hash_list( strm, l );
+    return strm.str();
+}
+
+
+void Deck::upgrade_hash_algorithm()
+{
+    if ( m_history->is_hash_upgraded() )
+    {
+        return;
+    }
+
+    std::cout << "upgrading hash algorithm ..." << std::flush;
+    boost::unordered_map<size_t, size_t> hashes; // old -> new
+
+    {
+        boost::unique_lock<boost::mutex> lock( m_loader->m_mutex );
+
+        for ( std::map<size_t, std::wstring>::const_iterator it = m_loader->m_hash_2_string_map.begin(); it != m_loader->m_hash_2_string_map.end(); ++it )
+        {
+            hashes[Loader::string_hash_legacy( it->second )] = it->first;
+        }
+    }
+
+    m_history->rehash( hashes );
+    std::cout << "\ndone." << std::endl;
+}
+
+
+void Deck::evaluate_schedulers()
+{
+    upgrade_hash_algorithm();
+    m_history->initialize();
+
+    const wchar_t* names[] = { L"fixed", L"sm2" };
+    History::OptionsPtr options = m_history->m_options.get();
+
+    for ( size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i )
+    {
+        SchedulerPtr scheduler = Scheduler::create( names[i], options->schedule );
+        Utility::write_console( scheduler->evaluate( m_history->get_cold_times() ) );
+        std::cout << std::endl;
+    }
+}
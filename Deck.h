@@ -0,0 +1,41 @@
+#pragma once
+#include "CardIdTable.h"
+class Loader;
+class History;
+
+
+// one reviewed file: its lines (Loader), its own persistence (History) and its due cards.
+// ReviewManager hosts every deck and shares the update thread, speech and console between them.
+class Deck
+{
+public:
+
+    Deck( const std::wstring& file_name );
+    ~Deck();
+    void initialize();
+    bool update(); // true when the due set changed
+
+public:
+
+    CardIdTable::card_id get_card_id( size_t hash );
+    size_t& get_review_number( size_t hash );
+    std::wstring get_new_expired_string( const CardIdSet& os,  const CardIdSet& ns );
+    std::wostream& output_hash_list( std::wostream& os, const std::list<size_t>& l );
+    std::wstring get_hash_list_string( const std::list<size_t>& l );
+
+public:
+
+    void upgrade_hash_algorithm();
+    void evaluate_schedulers();
+
+public:
+
+    std::wstring m_file_name;
+    boost::uint32_t m_name_hash;            // of the file name, case-insensitive: names the deck in the .back ring
+    Loader* m_loader;
+    History* m_history;
+    CardIdSet m_all;                        // by card id, the cards of the file as of the last update
+    CardIdSet m_reviewing_set;              // by card id, the due cards not reviewed yet
+    std::list<size_t> m_reviewing_list;     // the due cards in review order, as of the last change
+    std::vector<size_t> m_review_numbers;   // by card id, the review number when the card was last shown
+};
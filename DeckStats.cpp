@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "DeckStats.h"
+#include "Utility.h"
+
+
+DeckStats::DeckStats()
+    : m_utc_offset( 0 ),
+      m_cards( 0 ),
+      m_disabled( 0 ),
+      m_first_day( 0 ),
+      m_review_days_loaded( false )
+{
+    std::fill( m_rounds, m_rounds + 256, 0 );
+    std::fill( m_intervals, m_intervals + 256, 0.0 );
+}
+
+
+void DeckStats::rebuild( const ScheduleStates& states, const due_bitmap& in_deck, const Scheduler& scheduler )
+{
+    std::vector<boost::uint32_t> due;
+    scheduler.get_due_times( states, due );
+    std::time_t current_time = std::time(0);
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_utc_offset = get_utc_offset( current_time );
+    m_first_day = get_day( current_time ); // overdue days stay overdue, they share today
+    m_cards = 0;
+    m_disabled = 0;
+    std::fill( m_rounds, m_rounds + 256, 0 );
+    std::fill( m_intervals, m_intervals + 256, 0.0 );
+    m_due_days.assign( 32, 0 );
+
+    for ( size_t word = 0; word < in_deck.size(); ++word )
+    {
+        for ( boost::uint32_t bits = in_deck[word]; bits != 0; bits &= bits - 1 )
+        {
+            size_t bit = 0;
+
+            while ( 0 == ( bits & ( 1u << bit ) ) )
+            {
+                ++bit;
+            }
+
+            size_t i = word * 32 + bit;
+
+            if ( i < states.size() )
+            {
+                m_cards++;
+                add( states.get( i ), due[i], 1 );
+            }
+        }
+    }
+}
+
+
+void DeckStats::move( const ScheduleState& from, const ScheduleState& to, const Scheduler& scheduler )
+{
+    std::time_t from_due = scheduler.get_due_time( from );
+    std::time_t to_due = scheduler.get_due_time( to );
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    add( from, static_cast<boost::uint32_t>( std::min<std::time_t>( from_due, 0xFFFFFFFF ) ), -1 );
+    add( to, static_cast<boost::uint32_t>( std::min<std::time_t>( to_due, 0xFFFFFFFF ) ), 1 );
+}
+
+
+void DeckStats::add_review( std::time_t review_time )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_review_days[get_day( review_time )]++;
+}
+
+
+void DeckStats::load_review_days( const history_type& history )
+{
+    std::map<boost::int32_t, size_t> review_days;
+
+    for ( history_type::const_iterator it = history.begin(); it != history.end(); ++it )
+    {
+        for ( size_t i = 0; i < it->second.size(); ++i )
+        {
+            if ( ScheduleState::FINISHED < it->second[i] ) // not a deleted or finished marker
+            {
+                review_days[get_day( it->second[i] )]++;
+            }
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_review_days.swap( review_days );
+    m_review_days_loaded = true;
+}
+
+
+std::vector<size_t> DeckStats::get_forecast( std::time_t current_time, size_t days )
+{
+    std::vector<size_t> forecast( days, 0 );
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    boost::int32_t today = get_day( current_time );
+
+    for ( size_t i = 0; i < m_due_days.size() && 0 < days; ++i )
+    {
+        boost::int32_t n = std::max<boost::int32_t>( m_first_day + static_cast<boost::int32_t>( i ) - today, 0 );
+
+        if ( static_cast<size_t>( n ) < days )
+        {
+            forecast[n] += m_due_days[i];
+        }
+    }
+
+    return forecast;
+}
+
+
+std::map<boost::int32_t, size_t> DeckStats::get_review_days()
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_review_days;
+}
+
+
+std::wstring DeckStats::to_string( std::time_t current_time, size_t days )
+{
+    std::vector<size_t> forecast = get_forecast( current_time, days );
+    std::map<boost::int32_t, size_t> review_days = get_review_days();
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    std::wstringstream strm;
+
+    strm << L"cards " << m_cards << L", new " << m_rounds[0] << L", deleted or finished " << m_disabled << std::endl;
+
+    for ( size_t round = 1; round < 256; ++round )
+    {
+        if ( m_rounds[round] )
+        {
+            strm
+                << L"round " << std::setw( 3 ) << round << L": " << std::setw( 8 ) << m_rounds[round] << L" cards, interval "
+                << Utility::duration_string_from_seconds( static_cast<std::time_t>( m_intervals[round] / m_rounds[round] ) ) << std::endl;
+        }
+    }
+
+    strm << L"due:";
+
+    for ( size_t i = 0; i < forecast.size(); ++i )
+    {
+        strm << L" " << Utility::string_from_time_t( current_time + i * 24 * 3600, L"%m/%d" ) << L" " << forecast[i];
+    }
+
+    strm << std::endl << L"reviews:";
+    boost::int32_t today = get_day( current_time );
+    std::map<boost::int32_t, size_t>::iterator it = review_days.lower_bound( today - static_cast<boost::int32_t>( days ) + 1 );
+
+    for ( ; it != review_days.end(); ++it )
+    {
+        strm << L" " << Utility::string_from_time_t( current_time - ( today - it->first ) * 24 * 3600, L"%m/%d" ) << L" " << it->second;
+    }
+
+    strm << std::endl;
+    return strm.str();
+}
+
+
+void DeckStats::add( const ScheduleState& state, boost::uint32_t due_time, int sign )
+{
+    if ( state.is_disabled() )
+    {
+        m_disabled += sign;
+        return;
+    }
+
+    m_rounds[state.round] += sign;
+    size_t index = 0; // a new card is due at once, it counts today
+
+    if ( ! state.is_new() )
+    {
+        if ( 0xFFFFFFFF == due_time ) // never due again
+        {
+            return;
+        }
+
+        m_intervals[state.round] += sign * static_cast<double>( due_time - state.last_time );
+        index = static_cast<size_t>( std::max( get_day( due_time ), m_first_day ) - m_first_day );
+    }
+
+    if ( m_due_days.size() <= index )
+    {
+        m_due_days.resize( index + 1, 0 );
+    }
+
+    m_due_days[index] += sign;
+}
+
+
+std::time_t DeckStats::get_utc_offset( std::time_t t )
+{
+    std::tm local;
+    std::tm utc;
+    localtime_s( &local, &t ); // not the static buffers, stats are rebuilt on other threads
+    gmtime_s( &utc, &t );
+    utc.tm_isdst = local.tm_isdst;
+    return t - std::mktime( &utc );
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "Scheduler.h"
+
+
+// the shape of one deck's schedule, kept up to date as cards are reviewed so the title and the dump read it for free:
+// cards and their scheduled intervals by round, due cards by local day and reviews by local day.
+// days are absolute (days since 1970 in local time), so nothing shifts at midnight.
+// rebuild() scans the states once, the due times in bulk (Scheduler::get_due_times); move() follows one card
+class DeckStats
+{
+public:
+
+    DeckStats();
+    void rebuild( const ScheduleStates& states, const due_bitmap& in_deck, const Scheduler& scheduler );
+    void move( const ScheduleState& from, const ScheduleState& to, const Scheduler& scheduler ); // a card of the deck changed
+    void add_review( std::time_t review_time );
+    void load_review_days( const history_type& history ); // every review time, replaces what add_review counted
+    std::vector<size_t> get_forecast( std::time_t current_time, size_t days );     // [0] due today, overdue or new, [n] due n days later
+    std::map<boost::int32_t, size_t> get_review_days();
+    std::wstring to_string( std::time_t current_time, size_t days );
+
+public:
+
+    void add( const ScheduleState& state, boost::uint32_t due_time, int sign ); // should lock outside
+    boost::int32_t get_day( std::time_t t ) const { return static_cast<boost::int32_t>( ( t + m_utc_offset ) / ( 24 * 3600 ) ); }
+    static std::time_t get_utc_offset( std::time_t t );
+
+public:
+
+    boost::mutex m_mutex;
+    std::time_t m_utc_offset;               // of the last rebuild, a daylight saving change waits for the next one
+    size_t m_cards;                         // of the deck
+    size_t m_disabled;                      // deleted or finished
+    size_t m_rounds[256];                   // by round, round 0 is new
+    double m_intervals[256];                // by round, the scheduled intervals summed in seconds
+    boost::int32_t m_first_day;
+    std::vector<size_t> m_due_days;         // by day from m_first_day, new cards on the first
+    std::map<boost::int32_t, size_t> m_review_days;
+    bool m_review_days_loaded;              // from .times, once asked for
+};
@@ -3,18 +3,12 @@
 #include "Log.h"
 
 
+boost::mutex DirectoryWatcher::m_mutex;
 std::map<std::wstring, DirectoryWatcher::signal_type*> DirectoryWatcher::m_signals;
+std::map< std::wstring, std::set<std::wstring> > DirectoryWatcher::m_directories;
 
 
 void DirectoryWatcher::connect_to_signal( slot_type slot, const std::wstring& file )
-{
-    m_signals[file] = new signal_type;
-    m_signals[file]->connect( slot );
-    boost::thread( boost::bind( &DirectoryWatcher::watch_directory_thread, file ) );
-}
-
-
-void DirectoryWatcher::watch_directory_thread( const std::wstring& file )
 {
     if ( ! boost::filesystem::exists( file ) )
     {
@@ -22,48 +16,121 @@ void DirectoryWatcher::watch_directory_thread( const std::wstring& file )
         return;
     }
 
-    if ( ! boost::filesystem::is_regular_file( file ) )
+    boost::filesystem::path path = boost::filesystem::system_complete( file );
+    std::wstring directory = ( boost::filesystem::is_directory( path ) ? path : path.parent_path() ).wstring();
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( m_signals.find( file ) == m_signals.end() )
     {
-        LOG << "it is not a file: " << file;
-        return;
+        m_signals[file] = new signal_type;
     }
 
-    std::wstring directory = boost::filesystem::system_complete( file ).parent_path().wstring();
-    HANDLE handle = ::FindFirstChangeNotification( directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE );
+    m_signals[file]->connect( slot );
+
+    // one thread per directory, however many files (decks) are in it
+    if ( m_directories.find( directory ) == m_directories.end() )
+    {
+        m_directories[directory].insert( file );
+        boost::thread( boost::bind( &DirectoryWatcher::watch_directory_thread, directory ) );
+    }
+    else
+    {
+        m_directories[directory].insert( file );
+    }
+}
+
+
+void DirectoryWatcher::watch_directory_thread( const std::wstring& directory )
+{
+    HANDLE handle = ::FindFirstChangeNotification( directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME );
 
     if ( handle == INVALID_HANDLE_VALUE )
     {
-        LOG << file << ", FindFirstChangeNotification error: " << ::GetLastError();
+        LOG << directory << ", FindFirstChangeNotification error: " << ::GetLastError();
         return;
     }
 
-    std::time_t last_write_time = boost::filesystem::last_write_time( file );
+    std::map<std::wstring, std::time_t> last_write_times;
 
     while ( true )
     {
+        std::set<std::wstring> files;
+
+        {
+            boost::unique_lock<boost::mutex> lock( m_mutex );
+            files = m_directories[directory];
+        }
+
+        for ( std::set<std::wstring>::iterator it = files.begin(); it != files.end(); ++it )
+        {
+            if ( last_write_times.find( *it ) == last_write_times.end() && boost::filesystem::exists( *it ) )
+            {
+                last_write_times[*it] = get_last_write_time( *it );
+            }
+        }
+
         DWORD status = ::WaitForSingleObject( handle, INFINITE );
 
         if ( WAIT_OBJECT_0 == status )
         {
-            std::time_t t = boost::filesystem::last_write_time( file );
-
-            if ( t != last_write_time )
+            for ( std::set<std::wstring>::iterator it = files.begin(); it != files.end(); ++it )
             {
-                last_write_time = t;
-                LOG_DEBUG << file;
-                (*m_signals[file])();
+                const std::wstring& file = *it;
+
+                if ( ! boost::filesystem::exists( file ) )
+                {
+                    continue;
+                }
+
+                std::time_t t = get_last_write_time( file );
+
+                if ( t != last_write_times[file] )
+                {
+                    last_write_times[file] = t;
+                    LOG_DEBUG << file;
+                    signal_type* signal = NULL;
+
+                    {
+                        boost::unique_lock<boost::mutex> lock( m_mutex );
+                        signal = m_signals[file];
+                    }
+
+                    (*signal)();
+                }
             }
 
             if ( ::FindNextChangeNotification( handle ) == FALSE )
             {
-                LOG << file << ", FindNextChangeNotification error: " << ::GetLastError();
+                LOG << directory << ", FindNextChangeNotification error: " << ::GetLastError();
                 return;
             }
         }
         else
         {
-            LOG << file << ", WaitForSingleObject error: " << ::GetLastError();
+            LOG << directory << ", WaitForSingleObject error: " << ::GetLastError();
             return;
         }
     }
 }
+
+
+std::time_t DirectoryWatcher::get_last_write_time( const std::wstring& file )
+{
+    boost::system::error_code ec;
+    std::time_t t = boost::filesystem::last_write_time( file, ec ); // a directory's changes when a file is added, removed or renamed
+
+    if ( ! ec && boost::filesystem::is_directory( file, ec ) )
+    {
+        for ( boost::filesystem::directory_iterator it( file, ec ), end; ! ec && it != end; it.increment( ec ) )
+        {
+            boost::system::error_code file_ec;
+
+            if ( boost::filesystem::is_regular_file( it->path(), file_ec ) )
+            {
+                t = std::max( t, boost::filesystem::last_write_time( it->path(), file_ec ) );
+            }
+        }
+    }
+
+    return t;
+}
@@ -10,10 +10,13 @@ public:
 
 public:
 
-    static void connect_to_signal( slot_type slot, const std::wstring& file );
-    static void watch_directory_thread( const std::wstring& file );
+    static void connect_to_signal( slot_type slot, const std::wstring& file ); // or a directory: a change of any file in it
+    static void watch_directory_thread( const std::wstring& directory );
+    static std::time_t get_last_write_time( const std::wstring& file ); // of a directory: the newest of it and its files
 
 public:
 
+    static boost::mutex m_mutex;
     static std::map<std::wstring, signal_type*> m_signals;
+    static std::map< std::wstring, std::set<std::wstring> > m_directories; // directory -> watched files
 };
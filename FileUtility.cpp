@@ -1,141 +1,448 @@
 #include "stdafx.h"
 #include "FileUtility.h"
+#include "UnicodeUtility.h"
+#include "Log.h"
 
 
 namespace Utility
 {
-    std::wstring wstring_from_file( const wchar_t* file_name, int code_page )
+
+#ifdef _WIN32
+    FileMapping::FileMapping()
+        : m_file( INVALID_HANDLE_VALUE ),
+          m_mapping( NULL ),
+          m_data( NULL ),
+          m_size( 0 )
     {
-        std::wstring ws;
-        std::ifstream is( file_name, std::ios::in | std::ios::binary );
+    }
+
+
+    FileMapping::~FileMapping()
+    {
+        close();
+    }
+
 
-        if ( !is )
+    bool FileMapping::open( const std::wstring& file_name, bool writable )
+    {
+        close();
+        m_file = CreateFileW( file_name.c_str(), GENERIC_READ | ( writable ? GENERIC_WRITE : 0 ), FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        LARGE_INTEGER size;
+
+        if ( INVALID_HANDLE_VALUE == m_file || ! GetFileSizeEx( m_file, &size ) || static_cast<boost::uint64_t>( size.QuadPart ) != static_cast<size_t>( size.QuadPart ) )
         {
-            return L"";
+            close();
+            return false;
         }
 
-        unsigned char ch[3] = { 0 };
+        if ( 0 == size.QuadPart ) // nothing to map
+        {
+            return true;
+        }
 
-        is.unsetf( std::ios::skipws );
-        is.read( (char*)ch, 3 );
+        m_mapping = CreateFileMappingW( m_file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL );
+        m_data = ( m_mapping ? static_cast<char*>( MapViewOfFile( m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0 ) ) : NULL );
 
-        if ( ch[0] == 0xFF && ch[1] == 0xFE ) // unicode: FF FE
+        if ( NULL == m_data )
         {
-            is.seekg( -2, std::ios::end );
-            size_t size = is.tellg();
-            ws.resize( size / 2 );
-            is.seekg( 2, std::ios::beg );
-            is.read( (char*)&ws[0], size );
-        }
-        else if ( ch[0] == 0xEF && ch[1] == 0xBB && ch[2] == 0xBF ) // utf-8 + BOM: EF BB BF
-        {
-            is.seekg( -3, std::ios::end );
-            size_t size = is.tellg();
-            char* buf = new char[ size ];
-            is.seekg( 3, std::ios::beg );
-            is.read( buf, size );
-            size_t wsize = MultiByteToWideChar( CP_UTF8, 0, buf, size, 0, 0 );
-            ws.resize( wsize );
-            MultiByteToWideChar( CP_UTF8, 0, buf, size, &ws[0], wsize );
-            delete[] buf;
-        }
-        else // ANSI
-        {
-            is.seekg( 0, std::ios::end );
-            size_t size = is.tellg();
-            char* buf = new char[ size ];
-            is.seekg( 0, std::ios::beg );
-            is.read( buf, size );
-            size_t wsize = MultiByteToWideChar( code_page, 0, buf, size, 0, 0 );
-            ws.resize( wsize );
-            MultiByteToWideChar( code_page, 0, buf, size, &ws[0], wsize );
-            delete[] buf;
+            close();
+            return false;
         }
 
-        return ws;
+        m_size = static_cast<size_t>( size.QuadPart );
+        return true;
     }
 
 
-    std::string string_from_file( const wchar_t* file_name, int file_code_page, int string_code_page )
+    void FileMapping::close()
     {
-        std::string s;
-        std::ifstream is( file_name, std::ios::in | std::ios::binary );
+        if ( m_data )
+        {
+            UnmapViewOfFile( m_data );
+        }
 
-        if ( !is )
+        if ( m_mapping )
         {
-            return "";
+            CloseHandle( m_mapping );
         }
 
-        unsigned char ch[3] = { 0 };
+        if ( INVALID_HANDLE_VALUE != m_file )
+        {
+            CloseHandle( m_file );
+        }
+
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = NULL;
+        m_data = NULL;
+        m_size = 0;
+    }
+
+
+    void FileMapping::flush()
+    {
+        if ( m_data )
+        {
+            FlushViewOfFile( m_data, 0 );
+        }
+    }
+#else
+    FileMapping::FileMapping()
+        : m_file( -1 ),
+          m_data( NULL ),
+          m_size( 0 )
+    {
+    }
+
+
+    FileMapping::~FileMapping()
+    {
+        close();
+    }
+
+
+    bool FileMapping::open( const std::wstring& file_name, bool writable )
+    {
+        close();
+        m_file = ::open( boost::filesystem::path( file_name ).string().c_str(), writable ? O_RDWR : O_RDONLY );
+        struct stat status;
+
+        if ( -1 == m_file || 0 != ::fstat( m_file, &status ) || static_cast<boost::uint64_t>( status.st_size ) != static_cast<size_t>( status.st_size ) )
+        {
+            close();
+            return false;
+        }
+
+        if ( 0 == status.st_size ) // nothing to map
+        {
+            return true;
+        }
+
+        void* data = ::mmap( NULL, static_cast<size_t>( status.st_size ), PROT_READ | ( writable ? PROT_WRITE : 0 ), MAP_SHARED, m_file, 0 );
+
+        if ( MAP_FAILED == data )
+        {
+            close();
+            return false;
+        }
+
+        m_data = static_cast<char*>( data );
+        m_size = static_cast<size_t>( status.st_size );
+        return true;
+    }
+
+
+    void FileMapping::close()
+    {
+        if ( m_data )
+        {
+            ::munmap( m_data, m_size );
+        }
+
+        if ( -1 != m_file )
+        {
+            ::close( m_file );
+        }
+
+        m_file = -1;
+        m_data = NULL;
+        m_size = 0;
+    }
+
+
+    void FileMapping::flush()
+    {
+        if ( m_data )
+        {
+            ::msync( m_data, m_size, MS_SYNC );
+        }
+    }
+#endif
+
+
+    enum TextEncoding
+    {
+        ansi_text,
+        utf8_text,
+        utf16_text
+    };
+
+
+    // the whole file mapped read-only, by its wide name; nothing if it is missing or empty, logged if it can't be opened
+    static void map_for_reading( const wchar_t* file_name, FileMapping& file )
+    {
+        if ( ! file.open( file_name, false ) )
+        {
+#ifdef _WIN32
+            DWORD error = GetLastError();
+#else
+            int error = errno;
+#endif
+
+            if ( boost::filesystem::exists( file_name ) )
+            {
+                LOG << "cannot read: " << file_name << ", error " << error;
+            }
+        }
+    }
+
+
+    // a BOM decides; without one, text that is well-formed UTF-8 is taken as UTF-8 (pure ASCII reads the same either way)
+    static TextEncoding detect_encoding( const char* s, size_t size, size_t& bom )
+    {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>( s );
+        bom = 0;
+
+        if ( 2 <= size && u[0] == 0xFF && u[1] == 0xFE ) // unicode: FF FE
+        {
+            bom = 2;
+            return utf16_text;
+        }
+
+        if ( 3 <= size && u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF ) // utf-8 + BOM: EF BB BF
+        {
+            bom = 3;
+            return utf8_text;
+        }
+
+        return ( is_utf8( s, size ) ? utf8_text : ansi_text );
+    }
+
+
+    // little-endian UTF-16 into wchar_t, surrogate pairs combined where wchar_t is 32-bit
+    static size_t utf16le_to_wide( const char* s, size_t units, wchar_t* out )
+    {
+        if ( sizeof(wchar_t) == 2 )
+        {
+            std::memcpy( out, s, units * 2 );
+            return units;
+        }
 
-        is.unsetf( std::ios::skipws );
-        is.read( (char*)ch, 3 );
+        const unsigned char* u = reinterpret_cast<const unsigned char*>( s );
+        size_t n = 0;
 
-        if ( ch[0] == 0xFF && ch[1] == 0xFE ) // unicode: FF FE
+        for ( size_t i = 0; i < units; ++i )
         {
-            is.seekg( -2, std::ios::end );
-            size_t wsize = is.tellg();
-            wchar_t* buf = new wchar_t[wsize/2];
-            is.seekg( 2, std::ios::beg );
-            is.read( (char*)buf, wsize );
-            size_t size = WideCharToMultiByte( CP_UTF8, 0, buf, wsize, 0, 0, 0, 0 );
-            s.resize( size );
-            WideCharToMultiByte( CP_UTF8, 0, buf, wsize, &s[0], size, 0, 0 );
-            delete[] buf;
+            boost::uint32_t code = u[2 * i] | ( u[2 * i + 1] << 8 );
+
+            if ( 0xD800 <= code && code <= 0xDBFF && i + 1 < units )
+            {
+                boost::uint32_t low = u[2 * i + 2] | ( u[2 * i + 3] << 8 );
+
+                if ( 0xDC00 <= low && low <= 0xDFFF )
+                {
+                    code = 0x10000 + ( ( code - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                    ++i;
+                }
+            }
+
+            out[n++] = static_cast<wchar_t>( code );
         }
-        else if ( ch[0] == 0xEF && ch[1] == 0xBB && ch[2] == 0xBF ) // utf-8 + BOM: EF BB BF
+
+        return n;
+    }
+
+
+    // straight from the mapping into the result, which is sized once for the worst case and trimmed
+    static std::wstring decode( TextEncoding encoding, const char* s, size_t size, int code_page )
+    {
+        std::wstring ws;
+
+        if ( 0 == size )
         {
-            is.seekg( -3, std::ios::end );
-            size_t size = is.tellg();
-            is.seekg( 3, std::ios::beg );
+            return ws;
+        }
 
-            if ( string_code_page == CP_UTF8 )
+        if ( encoding == utf16_text )
+        {
+            if ( size < 2 ) // a stray byte after the BOM
             {
-                s.resize( size );
-                is.read( &s[0], size );
+                return ws;
             }
-            else
+
+            ws.resize( size / 2 );
+            ws.resize( utf16le_to_wide( s, size / 2, &ws[0] ) );
+        }
+        else if ( encoding == utf8_text || code_page == CP_UTF8 )
+        {
+            ws.resize( size );
+            ws.resize( utf8_to_wide( s, size, &ws[0] ) );
+        }
+        else // ANSI: the ASCII prefix is copied as it is, no lead byte of a DBCS code page is below 0x80
+        {
+            ws.resize( size );
+            size_t ascii = widen_ascii( s, size, &ws[0] );
+            int rest = 0;
+
+            if ( ascii < size )
             {
-                char* buf = new char[size];
-                is.read( buf, size );
-                size_t wsize = MultiByteToWideChar( CP_UTF8, 0, buf, size, 0, 0 );
-                wchar_t* wbuf = new wchar_t[wsize];
-                MultiByteToWideChar( CP_UTF8, 0, buf, size, wbuf, wsize );
-                size_t size = WideCharToMultiByte( string_code_page, 0, wbuf, wsize, 0, 0, 0, 0 );
-                s.resize( size );
-                WideCharToMultiByte( string_code_page, 0, wbuf, wsize, &s[0], size, 0, 0 );
-                delete[] buf;
-                delete[] wbuf;
+#ifdef _WIN32
+                rest = MultiByteToWideChar( code_page, 0, s + ascii, static_cast<int>( size - ascii ), &ws[ascii], static_cast<int>( size - ascii ) );
+#else
+                rest = static_cast<int>( utf8_to_wide( s + ascii, size - ascii, &ws[ascii] ) ); // no code pages here, the narrow encoding is UTF-8
+#endif
             }
+
+            ws.resize( ascii + std::max( rest, 0 ) );
         }
-        else // ANSI
+
+        return ws;
+    }
+
+
+    std::wstring wstring_from_file( const wchar_t* file_name, int code_page )
+    {
+        FileMapping file;
+        map_for_reading( file_name, file );
+        size_t bom = 0;
+        TextEncoding encoding = detect_encoding( file.m_data, file.m_size, bom );
+        return decode( encoding, file.m_data + bom, file.m_size - bom, code_page );
+    }
+
+
+    std::string string_from_file( const wchar_t* file_name, int file_code_page, int string_code_page )
+    {
+        FileMapping file;
+        map_for_reading( file_name, file );
+        size_t bom = 0;
+        TextEncoding encoding = detect_encoding( file.m_data, file.m_size, bom );
+        const char* s = file.m_data + bom;
+        size_t size = file.m_size - bom;
+
+        if ( ( encoding == utf8_text && string_code_page == CP_UTF8 ) || ( encoding == ansi_text && file_code_page == string_code_page ) )
         {
-            is.seekg( 0, std::ios::end );
-            size_t size = is.tellg();
-            is.seekg( 0, std::ios::beg );
+            return std::string( s, size );
+        }
 
-            if ( file_code_page == string_code_page )
+        return to_string( decode( encoding, s, size, file_code_page ), string_code_page );
+    }
+
+
+#ifdef _WIN32
+    // written through to the disk, so a crash right after it returns leaves content in the file
+    static bool write_through( HANDLE file, const std::string& content )
+    {
+        size_t written = 0;
+
+        while ( written < content.size() )
+        {
+            DWORD size = static_cast<DWORD>( std::min<size_t>( content.size() - written, 1 << 24 ) );
+            DWORD n = 0;
+
+            if ( ! WriteFile( file, content.data() + written, size, &n, NULL ) || 0 == n )
             {
-                s.resize( size );
-                is.read( &s[0], size );
+                return false;
             }
-            else
+
+            written += n;
+        }
+
+        return FlushFileBuffers( file ) != FALSE;
+    }
+
+
+    bool write_file_durably( const std::wstring& file_name, const std::string& content )
+    {
+        std::wstring temp_name = file_name + L".tmp";
+        HANDLE file = CreateFileW( temp_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+
+        if ( INVALID_HANDLE_VALUE == file )
+        {
+            return false;
+        }
+
+        bool written = write_through( file, content );
+        CloseHandle( file );
+
+        // the rename is atomic: a crash leaves the old file or the new one, never a part of either
+        if ( ! written || ! MoveFileExW( temp_name.c_str(), file_name.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) )
+        {
+            DeleteFileW( temp_name.c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool append_file_durably( const std::wstring& file_name, const std::string& content )
+    {
+        HANDLE file = CreateFileW( file_name.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+
+        if ( INVALID_HANDLE_VALUE == file )
+        {
+            return false;
+        }
+
+        bool written = write_through( file, content );
+        CloseHandle( file );
+        return written;
+    }
+#else
+    // written through to the disk, so a crash right after it returns leaves content in the file
+    static bool write_through( int file, const std::string& content )
+    {
+        size_t written = 0;
+
+        while ( written < content.size() )
+        {
+            ssize_t n = ::write( file, content.data() + written, std::min<size_t>( content.size() - written, 1 << 24 ) );
+
+            if ( n <= 0 )
             {
-                char* buf = new char[size];
-                is.read( buf, size );
-                size_t wsize = MultiByteToWideChar( file_code_page, 0, buf, size, 0, 0 );
-                wchar_t* wbuf = new wchar_t[wsize];
-                MultiByteToWideChar( file_code_page, 0, buf, size, wbuf, wsize );
-                size_t size = WideCharToMultiByte( string_code_page, 0, wbuf, wsize, 0, 0, 0, 0 );
-                s.resize( size );
-                WideCharToMultiByte( string_code_page, 0, wbuf, wsize, &s[0], size, 0, 0 );
-                delete[] buf;
-                delete[] wbuf;
+                if ( n < 0 && EINTR == errno )
+                {
+                    continue;
+                }
+
+                return false;
             }
+
+            written += static_cast<size_t>( n );
+        }
+
+        return 0 == ::fsync( file );
+    }
+
+
+    bool write_file_durably( const std::wstring& file_name, const std::string& content )
+    {
+        std::string name = boost::filesystem::path( file_name ).string();
+        std::string temp_name = name + ".tmp";
+        int file = ::open( temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+
+        if ( -1 == file )
+        {
+            return false;
+        }
+
+        bool written = write_through( file, content );
+        ::close( file );
+
+        // the rename is atomic: a crash leaves the old file or the new one, never a part of either
+        if ( ! written || 0 != ::rename( temp_name.c_str(), name.c_str() ) )
+        {
+            ::unlink( temp_name.c_str() );
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool append_file_durably( const std::wstring& file_name, const std::string& content )
+    {
+        int file = ::open( boost::filesystem::path( file_name ).string().c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+
+        if ( -1 == file )
+        {
+            return false;
         }
 
-        return s;
+        bool written = write_through( file, content );
+        ::close( file );
+        return written;
     }
+#endif
 
 
 }
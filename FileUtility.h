@@ -3,6 +3,32 @@
 
 namespace Utility
 {
+
+    // a whole file mapped into memory, opened by its wide name (a narrow one can't hold every path)
+    class FileMapping : boost::noncopyable
+    {
+    public:
+
+        FileMapping();
+        ~FileMapping();
+        bool open( const std::wstring& file_name, bool writable ); // an empty file opens with no data
+        void close();
+        void flush();
+
+    public:
+
+#ifdef _WIN32
+        HANDLE m_file;
+        HANDLE m_mapping;
+#else
+        int m_file;         // -1 if closed
+#endif
+        char* m_data;
+        size_t m_size;
+    };
+
     std::wstring wstring_from_file( const wchar_t* file_name, int code_page = CP_ACP );
     std::string string_from_file( const wchar_t* file_name, int file_code_page = CP_ACP, int string_code_page = CP_UTF8 );
+    bool write_file_durably( const std::wstring& file_name, const std::string& content );  // a temp file beside it, flushed to disk, renamed over it
+    bool append_file_durably( const std::wstring& file_name, const std::string& content ); // flushed to disk before it returns
 }
@@ -0,0 +1,206 @@
+#include "stdafx.h"
+#include "FixedScheduler.h"
+
+#ifdef max
+#undef max
+#undef min
+#endif
+
+
+FixedScheduler::FixedScheduler( const time_list& schedule )
+    : m_schedule( schedule )
+{
+    for ( size_t i = 0; i < 256; ++i )
+    {
+        m_spans[i] = ( 0 == i ? 0 : ( i < m_schedule.size() ? static_cast<boost::uint32_t>( std::min<std::time_t>( m_schedule[i], 0xFFFFFFFE ) ) : 0xFFFFFFFF ) );
+    }
+}
+
+
+std::time_t FixedScheduler::get_due_time( const ScheduleState& state ) const
+{
+    if ( state.is_new() )
+    {
+        return 0;
+    }
+
+    if ( m_schedule.size() <= state.round )
+    {
+        return std::numeric_limits<std::time_t>::max();
+    }
+
+    return state.last_time + m_schedule[state.round];
+}
+
+
+void FixedScheduler::on_review( ScheduleState& state, std::time_t review_time, EQuality ) const
+{
+    state.last_time = static_cast<boost::uint32_t>( review_time );
+
+    if ( state.round < std::numeric_limits<boost::uint8_t>::max() )
+    {
+        state.round++;
+    }
+}
+
+
+// one card is due when it is new (round 0), or it is not disabled (round 1 with a DELETED/FINISHED marker) and
+//   elapsed = now - last > span[round] and elapsed >= once-per-days and last <= now
+// everything is unsigned 32 bits: new cards have round 0 (span 0) and last 0, finished rounds have span 0xFFFFFFFF.
+// SSE2/AVX2 only have signed compares, so both sides are biased by 0x80000000 first.
+// SSE2 has no gather: 16 rounds are loaded at once and widened, the spans are still 4 loads from the table a step.
+
+static inline boost::uint32_t due_mask_scalar( boost::uint32_t last, boost::uint8_t round, boost::uint32_t span, boost::uint32_t now, boost::uint32_t once_per_days )
+{
+    boost::uint32_t elapsed = now - last;
+    bool disabled = ( 1 == round && last <= ScheduleState::FINISHED );
+    return ( 0 == round || ( ! disabled && last <= now && span < elapsed && once_per_days <= elapsed ) ) ? 1u : 0u;
+}
+
+
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+static size_t due_scan_sse2( const boost::uint32_t* last_times, const boost::uint8_t* rounds, const boost::uint32_t* spans, size_t size,
+                             boost::uint32_t now, boost::uint32_t once_per_days, boost::uint32_t* due )
+{
+    const __m128i bias = _mm_set1_epi32( static_cast<int>( 0x80000000u ) );
+    const __m128i now_b = _mm_xor_si128( _mm_set1_epi32( static_cast<int>( now ) ), bias );
+    const __m128i once_b = _mm_xor_si128( _mm_set1_epi32( static_cast<int>( once_per_days ) ), bias );
+    const __m128i finished_b = _mm_xor_si128( _mm_set1_epi32( ScheduleState::FINISHED ), bias );
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32( 1 );
+    const __m128i now_v = _mm_set1_epi32( static_cast<int>( now ) );
+    size_t i = 0;
+
+    for ( ; i + 16 <= size; i += 16 )
+    {
+        __m128i round_8 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( rounds + i ) );
+        __m128i round_16[2] = { _mm_unpacklo_epi8( round_8, zero ), _mm_unpackhi_epi8( round_8, zero ) };
+        boost::uint32_t bits = 0;
+
+        for ( size_t k = 0; k < 16; k += 4 )
+        {
+            const boost::uint8_t* r = rounds + i + k;
+            __m128i round = ( 0 == k % 8 ? _mm_unpacklo_epi16( round_16[k / 8], zero ) : _mm_unpackhi_epi16( round_16[k / 8], zero ) );
+            __m128i span = _mm_set_epi32( spans[r[3]], spans[r[2]], spans[r[1]], spans[r[0]] );
+            __m128i last = _mm_loadu_si128( reinterpret_cast<const __m128i*>( last_times + i + k ) );
+            __m128i last_b = _mm_xor_si128( last, bias );
+            __m128i elapsed_b = _mm_xor_si128( _mm_sub_epi32( now_v, last ), bias );
+
+            __m128i not_due = _mm_cmpgt_epi32( last_b, now_b );                                                     // reviewed in the future
+            not_due = _mm_or_si128( not_due, _mm_cmpgt_epi32( once_b, elapsed_b ) );                                // within once-per-days
+            not_due = _mm_or_si128( not_due, _mm_andnot_si128( _mm_cmpgt_epi32( last_b, finished_b ), _mm_cmpeq_epi32( round, one ) ) ); // disabled
+            __m128i due_mask = _mm_andnot_si128( not_due, _mm_cmpgt_epi32( elapsed_b, _mm_xor_si128( span, bias ) ) );
+            due_mask = _mm_or_si128( due_mask, _mm_cmpeq_epi32( round, zero ) );                                  // new
+
+            bits |= static_cast<boost::uint32_t>( _mm_movemask_ps( _mm_castsi128_ps( due_mask ) ) ) << k;
+        }
+
+        due[i / 32] |= ( bits << ( i % 32 ) );
+    }
+
+    return i;
+}
+#endif
+
+
+#if defined(__AVX2__)
+static size_t due_scan_avx2( const boost::uint32_t* last_times, const boost::uint8_t* rounds, const boost::uint32_t* spans, size_t size,
+                             boost::uint32_t now, boost::uint32_t once_per_days, boost::uint32_t* due )
+{
+    const __m256i bias = _mm256_set1_epi32( static_cast<int>( 0x80000000u ) );
+    const __m256i now_b = _mm256_xor_si256( _mm256_set1_epi32( static_cast<int>( now ) ), bias );
+    const __m256i once_b = _mm256_xor_si256( _mm256_set1_epi32( static_cast<int>( once_per_days ) ), bias );
+    const __m256i finished_b = _mm256_xor_si256( _mm256_set1_epi32( ScheduleState::FINISHED ), bias );
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32( 1 );
+    const __m256i now_v = _mm256_set1_epi32( static_cast<int>( now ) );
+    const int* span_table = reinterpret_cast<const int*>( spans );
+    size_t i = 0;
+
+    for ( ; i + 8 <= size; i += 8 )
+    {
+        __m256i last = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( last_times + i ) );
+        __m256i round = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( rounds + i ) ) );
+        __m256i span = _mm256_i32gather_epi32( span_table, round, 4 );
+        __m256i last_b = _mm256_xor_si256( last, bias );
+        __m256i elapsed_b = _mm256_xor_si256( _mm256_sub_epi32( now_v, last ), bias );
+
+        __m256i not_due = _mm256_cmpgt_epi32( last_b, now_b );
+        not_due = _mm256_or_si256( not_due, _mm256_cmpgt_epi32( once_b, elapsed_b ) );
+        not_due = _mm256_or_si256( not_due, _mm256_andnot_si256( _mm256_cmpgt_epi32( last_b, finished_b ), _mm256_cmpeq_epi32( round, one ) ) );
+        __m256i due_mask = _mm256_andnot_si256( not_due, _mm256_cmpgt_epi32( elapsed_b, _mm256_xor_si256( span, bias ) ) );
+        due_mask = _mm256_or_si256( due_mask, _mm256_cmpeq_epi32( round, zero ) );
+
+        boost::uint32_t bits = static_cast<boost::uint32_t>( _mm256_movemask_ps( _mm256_castsi256_ps( due_mask ) ) );
+        due[i / 32] |= ( bits << ( i % 32 ) );
+    }
+
+    return i;
+}
+#endif
+
+
+void FixedScheduler::get_due_bitmap( const ScheduleStates& states, std::time_t current_time, std::time_t once_per_days, due_bitmap& due ) const
+{
+    size_t size = states.size();
+    due.assign( ( size + 31 ) / 32, 0 );
+
+    if ( 0 == size )
+    {
+        return;
+    }
+
+    const boost::uint32_t* spans = m_spans;
+    const boost::uint32_t* last_times = &states.last_times[0];
+    const boost::uint8_t* rounds = &states.rounds[0];
+    boost::uint32_t now = static_cast<boost::uint32_t>( current_time );
+    boost::uint32_t once = static_cast<boost::uint32_t>( once_per_days );
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    i = due_scan_avx2( last_times, rounds, spans, size, now, once, &due[0] );
+#elif defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+    i = due_scan_sse2( last_times, rounds, spans, size, now, once, &due[0] );
+#endif
+
+    for ( ; i < size; ++i )
+    {
+        due[i / 32] |= ( due_mask_scalar( last_times[i], rounds[i], spans[rounds[i]], now, once ) << ( i % 32 ) );
+    }
+}
+
+
+void FixedScheduler::get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const
+{
+    size_t size = states.size();
+    due.resize( size );
+
+    if ( 0 == size )
+    {
+        return;
+    }
+
+    const boost::uint32_t* spans = m_spans;
+    const boost::uint32_t* last_times = &states.last_times[0];
+    const boost::uint8_t* rounds = &states.rounds[0];
+    size_t i = 0;
+
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+    const __m128i bias = _mm_set1_epi32( static_cast<int>( 0x80000000u ) );
+
+    for ( ; i + 4 <= size; i += 4 ) // last + span, saturated: a sum below last wrapped around
+    {
+        __m128i last = _mm_loadu_si128( reinterpret_cast<const __m128i*>( last_times + i ) );
+        __m128i span = _mm_set_epi32( spans[rounds[i + 3]], spans[rounds[i + 2]], spans[rounds[i + 1]], spans[rounds[i]] );
+        __m128i sum = _mm_add_epi32( last, span );
+        __m128i wrapped = _mm_cmpgt_epi32( _mm_xor_si128( last, bias ), _mm_xor_si128( sum, bias ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( &due[i] ), _mm_or_si128( sum, wrapped ) );
+    }
+#endif
+
+    for ( ; i < size; ++i )
+    {
+        boost::uint32_t sum = last_times[i] + spans[rounds[i]];
+        due[i] = ( sum < last_times[i] ? 0xFFFFFFFF : sum );
+    }
+}
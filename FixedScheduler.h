@@ -0,0 +1,22 @@
+#pragma once
+#include "Scheduler.h"
+
+
+// round N becomes due review.schedule[N] after the last review, finished after the last round
+class FixedScheduler : public Scheduler
+{
+public:
+
+    FixedScheduler( const time_list& schedule );
+    virtual const wchar_t* get_name() const { return L"fixed"; }
+    virtual std::time_t get_due_time( const ScheduleState& state ) const;
+    virtual bool is_finished( const ScheduleState& state ) const { return m_schedule.size() <= state.round; }
+    virtual void on_review( ScheduleState& state, std::time_t review_time, EQuality quality ) const;
+    virtual void get_due_bitmap( const ScheduleStates& states, std::time_t current_time, std::time_t once_per_days, due_bitmap& due ) const;
+    virtual void get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const;
+
+public:
+
+    time_list m_schedule;
+    boost::uint32_t m_spans[256];   // of every possible round, 0 for new, 0xFFFFFFFF past the schedule: a round is a table lookup
+};
@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "HashUtility.h"
+
+
+namespace Utility
+{
+    // XXH64 (https://github.com/Cyan4973/xxHash), stable across platforms and compilers
+    static const boost::uint64_t prime1 = 11400714785074694791ULL;
+    static const boost::uint64_t prime2 = 14029467366897019727ULL;
+    static const boost::uint64_t prime3 = 1609587929392839161ULL;
+    static const boost::uint64_t prime4 = 9650029242287828579ULL;
+    static const boost::uint64_t prime5 = 2870177450012600261ULL;
+
+
+    static inline boost::uint64_t rotate_left( boost::uint64_t x, int r )
+    {
+        return ( x << r ) | ( x >> ( 64 - r ) );
+    }
+
+
+    static inline boost::uint64_t read64( const unsigned char* p )
+    {
+        return  static_cast<boost::uint64_t>( p[0] )        | ( static_cast<boost::uint64_t>( p[1] ) << 8 )  |
+               ( static_cast<boost::uint64_t>( p[2] ) << 16 ) | ( static_cast<boost::uint64_t>( p[3] ) << 24 ) |
+               ( static_cast<boost::uint64_t>( p[4] ) << 32 ) | ( static_cast<boost::uint64_t>( p[5] ) << 40 ) |
+               ( static_cast<boost::uint64_t>( p[6] ) << 48 ) | ( static_cast<boost::uint64_t>( p[7] ) << 56 );
+    }
+
+
+    static inline boost::uint64_t read32( const unsigned char* p )
+    {
+        return  static_cast<boost::uint64_t>( p[0] )        | ( static_cast<boost::uint64_t>( p[1] ) << 8 ) |
+               ( static_cast<boost::uint64_t>( p[2] ) << 16 ) | ( static_cast<boost::uint64_t>( p[3] ) << 24 );
+    }
+
+
+    static inline boost::uint64_t xxh64_round( boost::uint64_t acc, boost::uint64_t input )
+    {
+        acc += input * prime2;
+        acc = rotate_left( acc, 31 );
+        return acc * prime1;
+    }
+
+
+    static inline boost::uint64_t xxh64_merge( boost::uint64_t acc, boost::uint64_t value )
+    {
+        acc ^= xxh64_round( 0, value );
+        return acc * prime1 + prime4;
+    }
+
+
+    boost::uint64_t xxhash64( const void* data, size_t length, boost::uint64_t seed )
+    {
+        const unsigned char* p = static_cast<const unsigned char*>( data );
+        const unsigned char* end = p + length;
+        boost::uint64_t h = 0;
+
+        if ( 32 <= length )
+        {
+            const unsigned char* limit = end - 32;
+            boost::uint64_t v1 = seed + prime1 + prime2;
+            boost::uint64_t v2 = seed + prime2;
+            boost::uint64_t v3 = seed;
+            boost::uint64_t v4 = seed - prime1;
+
+            do
+            {
+                v1 = xxh64_round( v1, read64( p ) );
+                v2 = xxh64_round( v2, read64( p + 8 ) );
+                v3 = xxh64_round( v3, read64( p + 16 ) );
+                v4 = xxh64_round( v4, read64( p + 24 ) );
+                p += 32;
+            }
+            while ( p <= limit );
+
+            h = rotate_left( v1, 1 ) + rotate_left( v2, 7 ) + rotate_left( v3, 12 ) + rotate_left( v4, 18 );
+            h = xxh64_merge( h, v1 );
+            h = xxh64_merge( h, v2 );
+            h = xxh64_merge( h, v3 );
+            h = xxh64_merge( h, v4 );
+        }
+        else
+        {
+            h = seed + prime5;
+        }
+
+        h += static_cast<boost::uint64_t>( length );
+
+        for ( ; p + 8 <= end; p += 8 )
+        {
+            h ^= xxh64_round( 0, read64( p ) );
+            h = rotate_left( h, 27 ) * prime1 + prime4;
+        }
+
+        if ( p + 4 <= end )
+        {
+            h ^= read32( p ) * prime1;
+            h = rotate_left( h, 23 ) * prime2 + prime3;
+            p += 4;
+        }
+
+        for ( ; p < end; ++p )
+        {
+            h ^= static_cast<boost::uint64_t>( *p ) * prime5;
+            h = rotate_left( h, 11 ) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+
+    size_t hash_from_uint64( boost::uint64_t h )
+    {
+        if ( sizeof(size_t) < sizeof(boost::uint64_t) )
+        {
+            return static_cast<size_t>( h ^ ( h >> 32 ) );
+        }
+
+        return static_cast<size_t>( h );
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+
+namespace Utility
+{
+    boost::uint64_t xxhash64( const void* data, size_t length, boost::uint64_t seed = 0 );
+    size_t hash_from_uint64( boost::uint64_t h ); // folded to 32 bits where size_t is 32 bits
+}
@@ -6,39 +6,17 @@
 #include "ProgramOptions.h"
 #include "OptionUpdateHelper.h"
 
+static const char* history_header = "# xxh64 hash round last-review-time ease interval";
+static const char* legacy_history_header = "# hash round last-review-time ease interval"; // boost::hash keys
 
-History::History()
-    : m_max_cache_size( 100 ),
-      m_cache_size( 0 ),
-      m_once_per_days( 0 )
-{
-    const boost::program_options::variables_map& vm = ProgramOptions::get_vm();
-
-    {
-        std::wstring schedule;
-
-        if ( vm.count( review_schedule ) )
-        {
-            schedule = vm[review_schedule].as<std::wstring>();
-        }
-
-        if ( schedule.empty() )
-        {
-            schedule = L"0 hours, 24 hours, 48 hours, 72 hours, 96 hours, 120 hours, 144 hours, 168 hours";
-            //"0 seconds",    "7 minutes",    "30 minutes",   "30 minutes",   "1 hours",      "3 hours",      "5 hours",
-            //"7 hours",      "9 hours",      "11 hours",     "13 hours",     "15 hours",     "17 hours",     "19 hours",
-            //"24 hours",     "48 hours",     "72 hours",     "96 hours",     "120 hours",    "144 hours",    "168 hours"
-            //"192 hours",    "216 hours",    "240 hours",    "264 hours",    "288 hours",    "312 hours",    "336 hours",
-            //"360 hours",    "384 hours",    "408 hours",    "432 hours",    "456 hours",    "480 hours",    "504 hours",
-            //"528 hours",    "552 hours",    "576 hours",    "600 hours",    "624 hours",    "648 hours",    "672 hours",
-            //"696 hours",    "720 hours",    "744 hours",    "768 hours",    "792 hours",    "816 hours",    "840 hours"
-        }
-
-        std::vector<std::wstring> strings = Utility::split_string( schedule );
-        m_schedule = Utility::times_from_strings( strings );
-        LOG_TRACE << "review.schedule(" << strings.size() << "): " << schedule;
-    }
 
+History::History( CardIdTable* card_ids, const std::wstring& file_name )
+    : m_file_name( file_name ),
+      m_card_ids( card_ids ),
+      m_cold_times_loaded( false ),
+      m_finished_version( 0 ),
+      m_cache_size( 0 )
+{
     m_connection = ProgramOptions::connect_to_signal( boost::bind( &History::update_option, this, _1 ) );
 }
 
@@ -46,105 +24,174 @@ History::History()
 History::~History()
 {
     m_connection.disconnect();
-    write_history();
-    clean_review_cache();
+    checkpoint();
 }
 
 
 void History::initialize()
 {
+    OptionsPtr options = m_options.get();
     bool should_write_history = false;
-    history_type history = load_history_from_file( m_file_name );
-
-    merge_history( history );
 
-    if ( m_history != history )
+    if ( ! read_history( options->file_name ) && boost::filesystem::exists( options->file_name ) )
     {
-        LOG_DEBUG << "wrong history detected.";
+        LOG_DEBUG << "convert time lists: " << options->file_name;
+        history_type history = load_history_from_file( options->file_name );
+        merge_history( history );
+
+        if ( ! boost::filesystem::exists( options->times_name ) )
+        {
+            append_file( options->file_name, options->times_name );
+        }
+
         should_write_history = true;
     }
 
-    history_type review_history = load_history_from_file( m_review_name );
+    review_log log = read_review_log( options->review_name );
 
-    if ( ! review_history.empty() )
+    if ( boost::filesystem::exists( options->review_name ) ) // reviews after the last snapshot
     {
-        LOG_DEBUG << "review detected.";
-        merge_history( review_history );
-        boost::filesystem::remove( m_review_name );
+        LOG_DEBUG << "review detected: " << log.size();
+        replay_review_log( log );
         should_write_history = true;
     }
 
-    if ( should_write_history )
+    if ( should_write_history && ! checkpoint() )
     {
-        write_history();
+        // without a torn tail, so new records append cleanly
+        Utility::write_file_durably( options->review_name, string_from_review_log( log ) );
+        m_cache_size = log.size();
     }
 
-    LOG_TRACE << "history is updated.\n" << string_from_history( m_history );
+    LOG_TRACE << "history is updated.\n" << string_from_states();
 }
 
 
-void History::save_history( size_t hash, std::time_t current_time )
+void History::save_history( size_t hash, std::time_t current_time, Scheduler::EQuality quality )
 {
+    OptionsPtr options = m_options.get();
+    CardIdTable::card_id id = get_card_id( hash );
+    ScheduleState last_state = m_states.get( id );
+    ScheduleState state = last_state;
+
     if ( current_time == 0 )
     {
-        m_history[hash].clear();
+        state.disable( DELETED );
     }
-
-    m_history[hash].push_back( current_time );
-
-    if ( m_cache_size == 0 )
+    else
     {
-        m_review_stream.open( m_review_name.c_str(), std::ios::app );
+        options->scheduler->on_review( state, current_time, quality );
+        m_stats.add_review( current_time );
 
-        if ( ! m_review_stream )
+        if ( options->scheduler->is_finished( state ) )
         {
-            LOG << "cannot open for append: " << m_review_name;
-            return;
+            state.disable( FINISHED );
         }
+    }
 
-        LOG_DEBUG << "created a file for cache: " << m_review_name;
+    m_states.set( id, state );
+
+    if ( is_in_deck( id ) )
+    {
+        m_stats.move( last_state, state, *options->scheduler );
     }
 
-    m_review_stream << hash << "\t" << current_time << std::endl;
+    {
+        boost::lock_guard<boost::mutex> lock( m_cold_mutex );
 
-    if ( m_review_stream.fail() )
+        if ( m_cold_times_loaded )
+        {
+            m_cold_times[hash].push_back( current_time );
+        }
+    }
+
+    // on disk before the review counts, a crash loses nothing already graded
+    if ( ! Utility::append_file_durably( options->review_name, string_from_review_log( review_log( 1, ReviewRecord( hash, current_time, quality ) ) ) ) )
     {
-        m_review_stream.clear();
-        LOG << "failed.";
+        LOG << "cannot append to " << options->review_name;
     }
 
     m_cache_size++;
     LOG_DEBUG << "cache-size = " << m_cache_size;
 
-    if ( m_max_cache_size <= m_cache_size )
+    if ( options->max_cache_size <= m_cache_size )
     {
-        write_history();
-        clean_review_cache();
+        checkpoint();
     }
 }
 
 
-void History::write_history()
+bool History::write_history()
 {
-    std::ofstream os( m_file_name.c_str() );
+    OptionsPtr options = m_options.get();
+    std::stringstream os;
+    os << history_header << "\n";
 
-    if ( ! os )
     {
-        LOG << "can not open file for write " << m_file_name;
-        return;
+        boost::unique_lock<boost::mutex> lock( m_card_ids->m_mutex );
+
+        for ( size_t i = 0; i < m_states.size(); ++i )
+        {
+            if ( m_states.rounds[i] )
+            {
+                os
+                    << m_card_ids->get_hash_no_lock( i ) << " "
+                    << static_cast<unsigned int>( m_states.rounds[i] ) << " "
+                    << m_states.last_times[i] << " "
+                    << static_cast<unsigned int>( m_states.eases[i] ) << " "
+                    << m_states.intervals[i] << "\n";
+            }
+        }
+    }
+
+    if ( ! Utility::write_file_durably( options->file_name, os.str() ) )
+    {
+        LOG << "can not write " << options->file_name;
+        return false;
+    }
+
+    LOG_DEBUG << "update history, size = " << m_states.size();
+    return true;
+}
+
+
+bool History::read_history( const std::wstring& file )
+{
+    std::ifstream is( file.c_str() );
+    std::string s;
+
+    if ( ! is || ! std::getline( is, s ) || ( s != history_header && s != legacy_history_header ) ) // missing or time lists
+    {
+        return false;
     }
 
-    for ( history_type::const_iterator it = m_history.begin(); it != m_history.end(); ++it )
+    size_t hash = 0;
+    unsigned int round = 0;
+    boost::uint32_t last_time = 0;
+    unsigned int ease = 0;
+    boost::uint16_t interval = 0;
+    std::stringstream strm;
+
+    m_states.clear();
+
+    while ( std::getline( is, s ) )
     {
-        if ( ! it->second.empty() )
+        strm.clear();
+        strm.str( s );
+
+        if ( strm >> hash >> round >> last_time >> ease >> interval )
         {
-            os << it->first << " ";
-            std::copy( it->second.begin(), it->second.end(), std::ostream_iterator<std::time_t>(os, " ") );
-            os << std::endl;
+            ScheduleState state;
+            state.round = static_cast<boost::uint8_t>( round );
+            state.last_time = last_time;
+            state.ease = static_cast<boost::uint8_t>( ease );
+            state.interval = interval;
+            m_states.set( get_card_id( hash ), state );
         }
     }
 
-    LOG_DEBUG << "update history, size = " << m_history.size();
+    LOG_TRACE << file << std::endl << string_from_states();
+    return true;
 }
 
 
@@ -191,28 +238,24 @@ history_type History::load_history_from_file( const std::wstring& file )
 
 void History::merge_history( const history_type& history )
 {
+    OptionsPtr options = m_options.get();
+    const Scheduler& scheduler = *options->scheduler;
+
     for ( history_type::const_iterator it = history.begin(); it != history.end(); ++it )
     {
-        size_t hash = it->first;
         const std::vector<std::time_t>& times = it->second;
-        std::vector<std::time_t>& history_times = m_history[hash];
-        size_t round = history_times.size();
-        std::time_t last_time = ( round ? history_times.back() : 0 );
+        CardIdTable::card_id id = get_card_id( it->first );
+        ScheduleState state = m_states.get( id );
 
-        if ( last_time == DELETED && round == 1 )
+        if ( state.is_disabled() ) // deleted or finished
         {
             continue;
         }
 
-        if ( last_time == FINISHED && round == 1 ) // finished
+        if ( scheduler.is_finished( state ) ) // finished
         {
-            continue;
-        }
-
-        if ( m_schedule.size() <= history_times.size() ) // finished
-        {
-            history_times.clear();
-            history_times.push_back( FINISHED );
+            state.disable( FINISHED );
+            m_states.set( id, state );
             continue;
         }
 
@@ -220,118 +263,168 @@ void History::merge_history( const history_type& history )
         {
             if ( times[i] == DELETED ) // deleted
             {
-                history_times.clear();
-                history_times.push_back( DELETED );
+                state.disable( DELETED );
                 break;
             }
 
-            if ( last_time + m_schedule[round] < times[i] )
-            {
-                history_times.push_back( times[i] );
-                last_time = times[i];
-                round++;
+            ScheduleState last_state = state;
+            Scheduler::EReviewResult result = scheduler.review( state, times[i] );
 
-                if ( m_schedule.size() <= round )
+            if ( result == Scheduler::Accepted )
+            {
+                if ( scheduler.is_finished( state ) )
                 {
-                    history_times.clear();
-                    history_times.push_back( FINISHED );
+                    state.disable( FINISHED );
                     break;
                 }
             }
-            else if ( last_time < times[i] ) // schedule changed
-            {
-                history_times.back() = times[i];
-            }
-            else
+            else if ( result == Scheduler::Ignored )
             {
                 LOG_DEBUG
                     << " ignore review time: " << Utility::string_from_time_t( times[i] )
-                    << " round = " << round
-                    << " last-review-time = " << last_time
-                    << " elapsed = " << Utility::duration_string_from_seconds( times[i] - last_time )
-                    << " span = " << Utility::duration_string_from_seconds( m_schedule[round] )
+                    << " round = " << static_cast<unsigned int>( last_state.round )
+                    << " last-review-time = " << last_state.last_time
+                    << " elapsed = " << Utility::duration_string_from_seconds( times[i] - last_state.last_time )
+                    << " span = " << Utility::duration_string_from_seconds( scheduler.get_due_time( last_state ) - last_state.last_time )
                     ;
             }
         }
+
+        m_states.set( id, state );
     }
 }
 
 
-void History::synchronize_history( const std::set<size_t>& hashes )
+void History::synchronize_history( const CardIdSet& cards )
 {
     bool history_changed = false;
+    std::vector<CardIdTable::card_id> ids = cards.get_ids();
+
+    if ( ! ids.empty() && m_states.size() <= ids.back() )
+    {
+        m_states.resize( ids.back() + 1 );
+    }
+
+    due_bitmap in_deck( ( m_states.size() + 31 ) / 32, 0 );
+    std::copy( cards.m_bits.begin(), cards.m_bits.begin() + std::min( cards.m_bits.size(), in_deck.size() ), in_deck.begin() );
 
-    for ( history_type::iterator it = m_history.begin(); it != m_history.end(); NULL )
+    for ( size_t i = 0; i < ids.size(); ++i )
     {
-        if ( hashes.find( it->first ) == hashes.end() )
+        if ( ! is_in_deck( ids[i] ) )
         {
-            LOG_DEBUG << "erase: " << it->first << " " << Utility::duration_string_from_time_list( it->second );
-            m_history.erase( it++ );
             history_changed = true;
         }
-        else
-        {
-            ++it;
-        }
     }
 
-    for ( std::set<size_t>::const_iterator it = hashes.begin(); it != hashes.end(); ++it )
+    for ( size_t i = 0; i < m_states.size(); ++i )
     {
-        if ( m_history.find( *it ) == m_history.end() )
+        if ( 0 == ( in_deck[i / 32] & ( 1u << ( i % 32 ) ) ) && ! m_states.get( i ).is_new() )
         {
-            m_history.insert( history_type::value_type( *it, time_list() ) );
+            LOG_DEBUG << "erase: " << m_card_ids->get_hash( i ) << " " << Utility::string_from_time_t( m_states.last_times[i] );
+            m_states.set( i, ScheduleState() );
             history_changed = true;
-            //LOG_DEBUG << "add: " << *it;
         }
     }
 
+    m_in_deck.swap( in_deck );
+    m_stats.rebuild( m_states, m_in_deck, *m_options.get()->scheduler );
+
     if ( history_changed )
     {
-        write_history();
-        clean_review_cache();
+        checkpoint();
     }
 }
 
 
-bool History::is_expired( size_t hash, const std::time_t& current_time )
+bool History::is_expired( size_t hash, const std::time_t& current_time, const Options& options )
 {
-    time_list& times = m_history[hash];
-    size_t review_round = times.size();
+    CardIdTable::card_id id = get_card_id( hash );
+    ScheduleState state = m_states.get( id );
 
-    if ( 0 == review_round ) // new added
+    if ( ! state.is_new() && ! state.is_disabled() && options.scheduler->is_finished( state ) ) // finished
     {
-        return true;
-    }
+        ScheduleState last_state = state;
+        state.disable( FINISHED );
+        m_states.set( id, state );
 
-    std::time_t last_review_time = times.back();
+        if ( is_in_deck( id ) )
+        {
+            m_stats.move( last_state, state, *options.scheduler );
+        }
 
-    if ( last_review_time == DELETED )
-    {
         return false;
     }
 
-    if ( last_review_time == FINISHED )
+    return options.scheduler->is_expired( state, current_time, options.once_per_days );
+}
+
+
+bool History::is_not_reviewable( size_t hash )
+{
+    CardIdTable::card_id id = m_card_ids->find( hash );
+
+    if ( id == CardIdTable::invalid_id || m_states.size() <= id )
     {
         return false;
     }
 
-    if ( m_schedule.size() <= review_round ) // finished
+    return m_states.get( id ).is_disabled();
+}
+
+
+CardIdSet History::get_expired()
+{
+    CardIdSet expired;
+    std::time_t current_time = std::time(0);
+    OptionsPtr options = m_options.get();
+    const Scheduler& scheduler = *options->scheduler;
+    size_t size = m_states.size();
+
+    if ( m_finished_version != options->version ) // the schedule may have changed, reviews mark the rest
     {
-        times.clear();
-        times.push_back( 1 );
-        return false;
+        for ( size_t i = 0; i < size; ++i )
+        {
+            ScheduleState state = m_states.get( i );
+
+            if ( scheduler.adopt( state ) ) // written by another scheduler
+            {
+                m_states.set( i, state );
+            }
+
+            if ( ! state.is_new() && ! state.is_disabled() && scheduler.is_finished( state ) ) // finished
+            {
+                state.disable( FINISHED );
+                m_states.set( i, state );
+            }
+        }
+
+        m_finished_version = options->version;
+        m_stats.rebuild( m_states, m_in_deck, scheduler );
     }
 
-    std::time_t span = m_schedule[review_round];
+    due_bitmap due;
+    scheduler.get_due_bitmap( m_states, current_time, options->once_per_days, due );
+    expired.m_bits.assign( std::min( due.size(), m_in_deck.size() ), 0 );
 
-    if ( ! ( last_review_time + span < current_time ) )
+    for ( size_t word = 0; word < expired.m_bits.size(); ++word )
     {
-        return false;
+        expired.m_bits[word] = due[word] & m_in_deck[word];
+
+        for ( boost::uint32_t bits = expired.m_bits[word]; bits != 0; bits &= bits - 1 )
+        {
+            expired.m_size++;
+        }
     }
 
-    if ( m_once_per_days )
+    return expired;
+}
+
+
+bool History::is_finished()
+{
+    for ( size_t i = 0; i < m_states.size(); ++i )
     {
-        if ( current_time - last_review_time < m_once_per_days * 24 * 3600 )
+        if ( is_in_deck( i ) && ! m_states.get( i ).is_disabled() )
         {
             return false;
         }
@@ -341,105 +434,521 @@ bool History::is_expired( size_t hash, const std::time_t& current_time )
 }
 
 
-bool History::is_not_reviewable( size_t hash )
+std::wstring History::get_stats_string( size_t days )
 {
-    history_type::iterator it = m_history.find( hash );
+    if ( ! m_stats.m_review_days_loaded )
+    {
+        boost::lock_guard<boost::mutex> lock( m_cold_mutex );
+        m_stats.load_review_days( get_cold_times() );
+    }
+
+    return m_stats.to_string( std::time(0), days );
+}
+
 
-    if ( it == m_history.end() )
+void History::clean_review_cache()
+{
+    OptionsPtr options = m_options.get();
+    review_log log = read_review_log( options->review_name );
+
+    bool torn = false;
+    size_t folded = get_folded_count( log, torn );
+
+    if ( folded < log.size() )
+    {
+        std::stringstream os;
+
+        if ( torn )
+        {
+            os << "\n"; // the torn line stays a line of its own
+        }
+
+        for ( size_t i = folded; i < log.size(); ++i )
+        {
+            os << log[i].hash << "\t" << log[i].time << "\n";
+        }
+
+        if ( ! Utility::append_file_durably( options->times_name, os.str() ) )
+        {
+            LOG << "can not append to " << options->times_name; // the log stays, replaying it again changes nothing
+            return;
+        }
+    }
+
+    if ( boost::filesystem::exists( options->review_name ) )
+    {
+        boost::filesystem::remove( options->review_name );
+        LOG_DEBUG << "remove file: " << options->review_name;
+    }
+
+    m_cache_size = 0;
+}
+
+
+// a fold appends the log in order and then removes it: if the last line of .times is a record of the log,
+// the fold crashed in between and the log up to that record is in .times already
+size_t History::get_folded_count( const review_log& log, bool& torn )
+{
+    OptionsPtr options = m_options.get();
+    std::ifstream is( options->times_name.c_str(), std::ios::in | std::ios::binary );
+    torn = false;
+
+    if ( log.empty() || ! is )
+    {
+        return 0;
+    }
+
+    is.seekg( 0, std::ios::end );
+    std::streamoff size = is.tellg();
+    std::streamoff tail_size = std::min<std::streamoff>( size, 1024 ); // a few lines
+    std::string tail( static_cast<size_t>( tail_size ), 0 );
+    is.seekg( size - tail_size, std::ios::beg );
+
+    if ( tail.empty() || ! is.read( &tail[0], tail.size() ) )
+    {
+        return 0;
+    }
+
+    torn = ( tail[tail.size() - 1] != '\n' );
+    size_t end = tail.rfind( '\n' ); // of the last complete line
+    size_t begin = ( end == std::string::npos || end == 0 ? std::string::npos : tail.rfind( '\n', end - 1 ) );
+
+    if ( end == std::string::npos || ( begin == std::string::npos && tail_size < size ) ) // no whole line in the tail
+    {
+        return 0;
+    }
+
+    begin = ( begin == std::string::npos ? 0 : begin + 1 );
+    std::string line = tail.substr( begin, end - begin );
+    std::vector<std::string> tokens;
+    boost::split( tokens, line, boost::is_any_of( " \t\r" ), boost::token_compress_on );
+
+    if ( tokens.size() < 2 )
+    {
+        return 0;
+    }
+
+    try
+    {
+        size_t hash = boost::lexical_cast<size_t>( tokens.front() );
+        std::time_t time = boost::lexical_cast<std::time_t>( tokens.back() );
+
+        for ( size_t i = log.size(); 0 < i; --i )
+        {
+            if ( log[i - 1].hash == hash && log[i - 1].time == time )
+            {
+                LOG_DEBUG << "folded before: " << i << " of " << log.size() << " records of " << options->review_name;
+                return i;
+            }
+        }
+    }
+    catch ( boost::bad_lexical_cast& )
+    {
+    }
+
+    return 0;
+}
+
+
+bool History::checkpoint()
+{
+    if ( ! write_history() ) // the log still holds every review since the last snapshot
     {
         return false;
     }
 
-    return ( ( 1 == it->second.size() ) && ( DELETED == it->second.front() || FINISHED == it->second.front() ) );
+    clean_review_cache();
+    return true;
 }
 
 
-std::set<size_t> History::get_expired()
+CardIdTable::card_id History::get_card_id( size_t hash )
 {
-    std::set<size_t> expired;
-    std::time_t current_time = std::time(0);
+    CardIdTable::card_id id = m_card_ids->intern( hash );
+
+    if ( m_states.size() <= id )
+    {
+        m_states.resize( id + 1 );
+    }
+
+    return id;
+}
 
-    for ( history_type::iterator it = m_history.begin(); it != m_history.end(); ++it )
+
+time_list History::get_times( size_t hash )
+{
+    boost::lock_guard<boost::mutex> lock( m_cold_mutex );
+    history_type& times = get_cold_times();
+    history_type::const_iterator it = times.find( hash );
+    return ( it == times.end() ? time_list() : it->second );
+}
+
+
+history_type& History::get_cold_times()
+{
+    if ( ! m_cold_times_loaded )
     {
-        if ( is_expired( it->first, current_time ) )
+        OptionsPtr options = m_options.get();
+        m_cold_times = load_history_from_file( options->times_name );
+        review_log log = read_review_log( options->review_name );
+
+        for ( size_t i = 0; i < log.size(); ++i )
         {
-            expired.insert( it->first );
+            m_cold_times[log[i].hash].push_back( log[i].time );
         }
+
+        m_cold_times_loaded = true;
     }
 
-    return expired;
+    return m_cold_times;
 }
 
 
-bool History::is_finished()
+// a record is "hash time quality checksum", the checksum the low 32 bits of xxh64 over the rest of the line.
+// a crash can only tear the last line (no newline yet); nothing after a bad record is trusted.
+// lines of older versions, "hash time", carry no checksum and replay as Good
+History::review_log History::read_review_log( const std::wstring& file )
 {
-    for ( history_type::iterator it = m_history.begin(); it != m_history.end(); ++it )
+    review_log log;
+    std::ifstream is( file.c_str(), std::ios::in | std::ios::binary );
+
+    if ( ! is )
+    {
+        return log;
+    }
+
+    std::stringstream strm;
+
+    for ( std::string s; std::getline( is, s ); )
     {
-        if ( it->second.empty() )
+        if ( is.eof() )
         {
-            return false;
+            LOG << "torn record dropped: " << file;
+            break;
         }
 
-        time_t first_time = it->second.front();
+        if ( ! s.empty() && '\r' == s[s.size() - 1] )
+        {
+            s.erase( s.size() - 1 );
+        }
 
-        if ( first_time != DELETED && first_time != FINISHED )
+        if ( s.empty() )
         {
-            return false;
+            continue;
+        }
+
+        ReviewRecord record;
+        unsigned int quality = Scheduler::Good;
+        boost::uint32_t checksum = 0;
+        std::string::size_type pos = s.rfind( '\t' );
+        bool legacy = ( pos == s.find( '\t' ) );
+
+        strm.clear();
+        strm.str( s );
+
+        if ( legacy )
+        {
+            strm >> record.hash >> record.time;
         }
+        else
+        {
+            strm >> record.hash >> record.time >> quality >> std::hex >> checksum >> std::dec;
+        }
+
+        if ( ! strm || Scheduler::Easy < quality
+            || ( ! legacy && checksum != static_cast<boost::uint32_t>( Utility::xxhash64( s.data(), pos ) ) ) )
+        {
+            LOG << "corrupt record, " << log.size() << " replayed: " << file;
+            break;
+        }
+
+        record.quality = static_cast<Scheduler::EQuality>( quality );
+        log.push_back( record );
     }
 
-    return true;
+    return log;
 }
 
 
-void History::clean_review_cache()
+// reviews already in the snapshot (not after the last review time) are skipped, so a crash between
+// writing .history and removing the log replays nothing twice
+void History::replay_review_log( const review_log& log )
 {
-    if ( m_review_stream.is_open() )
+    OptionsPtr options = m_options.get();
+    const Scheduler& scheduler = *options->scheduler;
+
+    for ( size_t i = 0; i < log.size(); ++i )
     {
-        m_review_stream.close();
+        CardIdTable::card_id id = get_card_id( log[i].hash );
+        ScheduleState state = m_states.get( id );
+
+        if ( state.is_disabled() )
+        {
+            continue;
+        }
+
+        if ( DELETED == log[i].time )
+        {
+            state.disable( DELETED );
+        }
+        else if ( log[i].time <= static_cast<std::time_t>( state.last_time ) )
+        {
+            continue;
+        }
+        else
+        {
+            scheduler.on_review( state, log[i].time, log[i].quality );
+
+            if ( scheduler.is_finished( state ) )
+            {
+                state.disable( FINISHED );
+            }
+        }
+
+        m_states.set( id, state );
     }
+}
+
+
+std::string History::string_from_review_log( const review_log& log )
+{
+    std::stringstream os;
 
-    if ( boost::filesystem::exists( m_review_name ) )
+    for ( size_t i = 0; i < log.size(); ++i )
     {
-        boost::filesystem::remove( m_review_name );
-        LOG_DEBUG << "remove file: " << m_review_name;
+        std::stringstream strm;
+        strm << log[i].hash << "\t" << log[i].time << "\t" << static_cast<unsigned int>( log[i].quality );
+        std::string s = strm.str();
+        os << s << "\t" << std::hex << static_cast<boost::uint32_t>( Utility::xxhash64( s.data(), s.size() ) ) << std::dec << "\n";
     }
 
-    m_cache_size = 0;
+    return os.str();
+}
+
+
+void History::append_file( const std::wstring& from, const std::wstring& to )
+{
+    std::ifstream is( from.c_str(), std::ios::in | std::ios::binary );
+    std::ofstream os( to.c_str(), std::ios::out | std::ios::binary | std::ios::app );
+
+    if ( ! is || ! os )
+    {
+        LOG << "can not append " << from << " to " << to;
+        return;
+    }
+
+    os << is.rdbuf();
 }
 
 
 void History::update_option( const boost::program_options::variables_map& vm )
 {
-    static OptionUpdateHelper option_helper;
-    static std::wstring name = vm[file_name_option].as<std::wstring>();
-    static std::wstring default_history_naame = boost::filesystem::change_extension( name, L".history" ).wstring();
-    static std::wstring default_review_naame = boost::filesystem::change_extension( name, L".review" ).wstring();
+    static const boost::program_options::variables_map no_file_options;
+    const std::wstring& name = m_file_name;
+    std::wstring default_history_naame = boost::filesystem::change_extension( name, L".history" ).wstring();
+    std::wstring default_review_naame = boost::filesystem::change_extension( name, L".review" ).wstring();
+    std::wstring default_times_naame = boost::filesystem::change_extension( name, L".times" ).wstring();
+    bool is_main_deck = ( vm.count( file_name_option ) && name == vm[file_name_option].as<std::wstring>() );
+    const boost::program_options::variables_map& file_vm = ( is_main_deck ? vm : no_file_options ); // other decks keep their files beside them
+    Options options = m_options.copy();
+    bool changed = false;
+    bool scheduler_changed = false;
+
+    if ( m_option_helper.update_one_option<std::wstring>( file_history_option, file_vm, default_history_naame ) )
+    {
+        options.file_name = m_option_helper.get_value<std::wstring>( file_history_option );
+        LOG_DEBUG << "file-history-name: " << options.file_name;
+        changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<std::wstring>( file_review_option, file_vm, default_review_naame ) )
+    {
+        options.review_name = m_option_helper.get_value<std::wstring>( file_review_option );
+        LOG_DEBUG << "file-review-name: " << options.review_name;
+        changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<std::wstring>( file_times_option, file_vm, default_times_naame ) )
+    {
+        options.times_name = m_option_helper.get_value<std::wstring>( file_times_option );
+        LOG_DEBUG << "file-times-name: " << options.times_name;
+        changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<std::wstring>( review_schedule, vm ) || options.schedule.empty() )
+    {
+        std::wstring schedule = m_option_helper.get_value<std::wstring>( review_schedule );
+
+        if ( schedule.empty() )
+        {
+            schedule = L"0 hours, 24 hours, 48 hours, 72 hours, 96 hours, 120 hours, 144 hours, 168 hours";
+            //"0 seconds",    "7 minutes",    "30 minutes",   "30 minutes",   "1 hours",      "3 hours",      "5 hours",
+            //"7 hours",      "9 hours",      "11 hours",     "13 hours",     "15 hours",     "17 hours",     "19 hours",
+            //"24 hours",     "48 hours",     "72 hours",     "96 hours",     "120 hours",    "144 hours",    "168 hours"
+            //"192 hours",    "216 hours",    "240 hours",    "264 hours",    "288 hours",    "312 hours",    "336 hours",
+            //"360 hours",    "384 hours",    "408 hours",    "432 hours",    "456 hours",    "480 hours",    "504 hours",
+            //"528 hours",    "552 hours",    "576 hours",    "600 hours",    "624 hours",    "648 hours",    "672 hours",
+            //"696 hours",    "720 hours",    "744 hours",    "768 hours",    "792 hours",    "816 hours",    "840 hours"
+        }
+
+        std::vector<std::wstring> strings = Utility::split_string( schedule );
+        options.schedule = Utility::times_from_strings( strings );
+        LOG_DEBUG << "review.schedule(" << strings.size() << "): " << schedule;
+        scheduler_changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<std::wstring>( review_scheduler_option, vm, L"fixed" ) )
+    {
+        options.scheduler_name = m_option_helper.get_value<std::wstring>( review_scheduler_option );
+        LOG_DEBUG << "review-scheduler: " << options.scheduler_name;
+        scheduler_changed = true;
+    }
+
+    if ( scheduler_changed )
+    {
+        options.scheduler = Scheduler::create( options.scheduler_name, options.schedule );
+        changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<size_t>( review_max_cache_size_option, vm, 100 ) )
+    {
+        options.max_cache_size = m_option_helper.get_value<size_t>( review_max_cache_size_option );
+        LOG_DEBUG << "review-max-cache-size: " << options.max_cache_size;
+        changed = true;
+    }
+
+    if ( m_option_helper.update_one_option<size_t>( review_once_per_days_option, vm, 0 ) )
+    {
+        size_t once_per_days = m_option_helper.get_value<size_t>( review_once_per_days_option );
+        LOG_DEBUG << "review-once-per-days: " << once_per_days;
+        options.once_per_days = once_per_days * 3600 * 24;
+        changed = true;
+    }
+
+    if ( changed )
+    {
+        m_options.publish( options );
+    }
+}
+
+
+bool History::is_hash_upgraded()
+{
+    OptionsPtr options = m_options.get();
+    std::ifstream is( options->file_name.c_str() );
+    std::string s;
 
-    if ( option_helper.update_one_option<std::wstring>( file_history_option, vm, default_history_naame ) )
+    if ( ! is || ! std::getline( is, s ) ) // nothing to upgrade
     {
-        m_file_name = option_helper.get_value<std::wstring>( file_history_option );
-        LOG_DEBUG << "file-history-name: " << m_file_name;
+        return true;
     }
 
-    if ( option_helper.update_one_option<std::wstring>( file_review_option, vm, default_review_naame ) )
+    return s == history_header;
+}
+
+
+void History::rehash( const boost::unordered_map<size_t, size_t>& hashes )
+{
+    OptionsPtr options = m_options.get();
+    size_t count = 0;
+
+    // .history goes last, its header marks the upgrade as done
+    review_log log = read_review_log( options->review_name );
+
+    for ( size_t i = 0; i < log.size(); ++i )
     {
-        m_review_name = option_helper.get_value<std::wstring>( file_review_option );
-        LOG_DEBUG << "file-review-name: " << m_review_name;
+        boost::unordered_map<size_t, size_t>::const_iterator it = hashes.find( log[i].hash );
+
+        if ( it != hashes.end() )
+        {
+            log[i].hash = it->second;
+            count++;
+        }
     }
 
-    if ( option_helper.update_one_option<size_t>( review_max_cache_size_option, vm, 100 ) )
+    if ( ! log.empty() && ! Utility::write_file_durably( options->review_name, string_from_review_log( log ) ) ) // checksums follow the new hashes
     {
-        m_max_cache_size = option_helper.get_value<size_t>( review_max_cache_size_option );
-        LOG_DEBUG << "review-max-cache-size: " << m_max_cache_size;
+        LOG << "can not rehash " << options->review_name;
     }
 
-    if ( option_helper.update_one_option<size_t>( review_once_per_days_option, vm, 0 ) )
+    count += rehash_file( options->times_name, hashes, NULL );
+    count += rehash_file( options->file_name, hashes, history_header );
+
     {
-        m_once_per_days = option_helper.get_value<size_t>( review_once_per_days_option );
-        LOG_DEBUG << "review-once-per-days: " << m_once_per_days;
-        m_once_per_days *= 3600 * 24;
+        boost::lock_guard<boost::mutex> lock( m_cold_mutex );
+        m_cold_times.clear();
+        m_cold_times_loaded = false;
     }
+
+    LOG << "rehashed " << count << " lines, " << hashes.size() << " cards";
+}
+
+
+size_t History::rehash_file( const std::wstring& file, const boost::unordered_map<size_t, size_t>& hashes, const char* header )
+{
+    if ( ! boost::filesystem::exists( file ) )
+    {
+        return 0;
+    }
+
+    std::ifstream is( file.c_str() );
+    std::stringstream os; // replaces the file at once, a crash leaves the old one or the new one
+
+    if ( ! is )
+    {
+        LOG << "can not rehash " << file;
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t hash = 0;
+    std::stringstream strm;
+
+    for ( std::string s; std::getline( is, s ); )
+    {
+        if ( s.empty() )
+        {
+            continue;
+        }
+
+        if ( '#' == s[0] )
+        {
+            os << ( header ? header : s.c_str() ) << "\n";
+            continue;
+        }
+
+        std::string::size_type pos = s.find_first_of( " \t" );
+        strm.clear();
+        strm.str( s.substr( 0, pos ) );
+
+        boost::unordered_map<size_t, size_t>::const_iterator it = hashes.end();
+
+        if ( strm >> hash )
+        {
+            it = hashes.find( hash );
+        }
+
+        if ( it != hashes.end() )
+        {
+            os << it->second << ( pos == std::string::npos ? "" : s.substr( pos ) ) << "\n";
+            count++;
+        }
+        else
+        {
+            os << s << "\n"; // not in the deck any more, keep it
+        }
+    }
+
+    is.close();
+
+    if ( ! Utility::write_file_durably( file, os.str() ) )
+    {
+        LOG << "failed to write " << file;
+        return 0;
+    }
+
+    LOG_DEBUG << "rehashed " << file << ": " << count;
+    return count;
 }
 
 
@@ -471,3 +980,16 @@ std::wstring History::string_from_history( const history_type& history )
 
     return os.str();
 }
+
+
+std::wstring History::string_from_states()
+{
+    std::wstringstream os;
+
+    for ( size_t i = 0; i < m_states.size(); ++i )
+    {
+        os << m_card_ids->get_hash( i ) << L" " << static_cast<unsigned int>( m_states.rounds[i] ) << L" " << Utility::string_from_time_t( m_states.last_times[i] ) << std::endl;
+    }
+
+    return os.str();
+}
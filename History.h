@@ -1,6 +1,9 @@
 #pragma once
-typedef std::vector<std::time_t> time_list;
-typedef std::map<size_t, time_list> history_type;
+#include "OptionSnapshot.h"
+#include "Scheduler.h"
+#include "CardIdTable.h"
+#include "OptionUpdateHelper.h"
+#include "DeckStats.h"
 
 
 class History
@@ -9,29 +12,79 @@ class History
 
 public:
 
-    History();
+    struct Options
+    {
+        Options() : max_cache_size( 100 ), once_per_days( 0 ), version( 0 ) {}
+        std::wstring file_name;
+        std::wstring review_name;
+        std::wstring times_name;
+        time_list schedule;
+        std::wstring scheduler_name;
+        SchedulerPtr scheduler;
+        size_t max_cache_size;
+        std::time_t once_per_days; // in seconds
+        size_t version;
+    };
+
+    typedef OptionSnapshot<Options>::pointer OptionsPtr;
+
+    struct ReviewRecord // a line of the .review log
+    {
+        ReviewRecord( size_t hash = 0, std::time_t time = 0, Scheduler::EQuality quality = Scheduler::Good ) : hash( hash ), time( time ), quality( quality ) {}
+        size_t hash;
+        std::time_t time;               // DELETED for a deleted card
+        Scheduler::EQuality quality;
+    };
+
+    typedef std::vector<ReviewRecord> review_log;
+
+public:
+
+    History( CardIdTable* card_ids, const std::wstring& file_name );
     ~History();
     void initialize();
-    void save_history( size_t hash, std::time_t current_time );
+    void save_history( size_t hash, std::time_t current_time, Scheduler::EQuality quality = Scheduler::Good );
     void disable( size_t hash ) { save_history( hash, 0 ); }
-    void synchronize_history( const std::set<size_t>& hashes );
-    std::set<size_t> get_expired();
-    size_t get_review_round( size_t hash ) { return m_history[hash].size(); }
-    time_list& get_times( size_t hash ) { return m_history[hash]; }
-    std::time_t get_last_review_time( size_t hash ) { time_list& t = m_history[hash]; return t.empty() ? 0 : t.back(); }
+    void synchronize_history( const CardIdSet& cards );
+    CardIdSet get_expired();
+    size_t get_review_round( size_t hash ) { return m_states.rounds[get_card_id( hash )]; }
+    time_list get_times( size_t hash ); // loads .times the first time
+    std::time_t get_last_review_time( size_t hash ) { return m_states.last_times[get_card_id( hash )]; }
+    ScheduleState get_state( size_t hash ) { return m_states.get( get_card_id( hash ) ); }
     bool is_finished();
+    std::vector<size_t> get_forecast( size_t days ) { return m_stats.get_forecast( std::time(0), days ); }
+    std::wstring get_stats_string( size_t days ); // loads .times the first time
 
 public:
 
-    void write_history();
+    CardIdTable::card_id get_card_id( size_t hash );
+    bool is_in_deck( size_t id ) const { return id / 32 < m_in_deck.size() && ( m_in_deck[id / 32] & ( 1u << ( id % 32 ) ) ); }
+
+public:
+
+    bool write_history(); // false leaves the .history on disk as it was
+    bool read_history( const std::wstring& file );
     void merge_history( const history_type& history );
-    bool is_expired( size_t hash, const std::time_t& current_time );
+    bool is_expired( size_t hash, const std::time_t& current_time, const Options& options );
     bool is_not_reviewable( size_t hash );
-    void clean_review_cache();
+    void clean_review_cache(); // folds the .review log into .times, at most once even if it crashed before removing the log
+    size_t get_folded_count( const review_log& log, bool& torn ); // records of the log already at the end of .times
+    bool checkpoint(); // .history made durable first, only then the .review log moves to .times
 
 public:
 
     history_type load_history_from_file( const std::wstring& file );
+    history_type& get_cold_times(); // under m_cold_mutex
+    review_log read_review_log( const std::wstring& file ); // the records up to the first torn or corrupt one
+    void replay_review_log( const review_log& log );
+    static std::string string_from_review_log( const review_log& log );
+    void append_file( const std::wstring& from, const std::wstring& to );
+
+public:
+
+    bool is_hash_upgraded();
+    void rehash( const boost::unordered_map<size_t, size_t>& hashes ); // old hash -> new hash, rewrites .review, .times and .history
+    size_t rehash_file( const std::wstring& file, const boost::unordered_map<size_t, size_t>& hashes, const char* header );
 
 public:
 
@@ -40,16 +93,21 @@ public:
 public:
 
     std::wstring string_from_history( const history_type& history );
+    std::wstring string_from_states();
 
 public:
 
-    std::wstring m_file_name;
-    std::wstring m_review_name;
-    history_type m_history;
-    std::ofstream m_review_stream;
-    size_t m_max_cache_size;
-    size_t m_cache_size;
-    time_list m_schedule;
-    volatile size_t m_once_per_days;
+    OptionSnapshot<Options> m_options;
+    OptionUpdateHelper m_option_helper;
+    std::wstring m_file_name;                       // the deck
+    CardIdTable* m_card_ids;                        // shared with Loader
+    ScheduleStates m_states;                        // by card id
+    due_bitmap m_in_deck;                           // by card id, cards of the deck after synchronize_history
+    history_type m_cold_times;                      // every review time, only loaded for diagnostics
+    bool m_cold_times_loaded;
+    boost::mutex m_cold_mutex;                      // guards m_cold_times, read off the review thread
+    size_t m_finished_version;                      // options version of the last finished-marking pass
+    DeckStats m_stats;                              // of the cards in the deck, after synchronize_history
+    size_t m_cache_size;                            // records in the .review log
     boost::signals2::connection m_connection;
 };
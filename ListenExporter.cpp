@@ -0,0 +1,227 @@
+#include "stdafx.h"
+#include "ListenExporter.h"
+#include "Speech.h"
+#include "ClipCache.h"
+#include "Utility.h"
+#include "Log.h"
+
+static const boost::uint32_t sample_rate = 22050; // what the SAPI synthesizer writes
+
+
+ListenExporter::ListenExporter( Speech* speech, const std::wstring& file_name, size_t pause )
+    : m_speech( speech ),
+      m_file_name( file_name ),
+      m_pause( pause ),
+      m_data_size( 0 )
+{
+}
+
+
+bool ListenExporter::run( const std::vector<Card>& cards )
+{
+    m_stream.open( m_file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    std::ofstream chapters( ( m_file_name + L".chapters" ).c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+    if ( ! m_stream || ! chapters )
+    {
+        LOG << "cannot write: " << m_file_name;
+        return false;
+    }
+
+    write_header();
+
+    size_t threads = std::max<size_t>( boost::thread::hardware_concurrency(), 1 );
+    size_t batch_size = threads * 4;
+    std::vector<boost::int16_t> pause( sample_rate * m_pause / 1000, 0 );
+    size_t rendered_cards = 0;
+
+    for ( size_t begin = 0; begin < cards.size(); begin += batch_size )
+    {
+        size_t end = std::min( begin + batch_size, cards.size() );
+        std::vector< std::vector<boost::int16_t> > rendered( end - begin );
+        boost::thread_group workers;
+
+        for ( size_t i = 0; i < threads && begin + i < end; ++i )
+        {
+            workers.create_thread( boost::bind( &ListenExporter::render_batch, this, boost::cref( cards ), begin + i, end, threads, boost::ref( rendered ) ) );
+        }
+
+        workers.join_all();
+
+        for ( size_t i = 0; i < rendered.size(); ++i )
+        {
+            if ( rendered[i].empty() )
+            {
+                continue;
+            }
+
+            std::vector<std::wstring> words = WordTable::instance().get_words( cards[begin + i].words );
+            chapters << cards[begin + i].hash << "\t" << ( m_data_size / 2 * 1000 / sample_rate ) << "\t" << Utility::to_string( boost::join( words, L" " ), CP_UTF8 ) << "\n";
+            write_samples( rendered[i] );
+            write_samples( pause );
+            rendered_cards++;
+        }
+    }
+
+    write_header();
+    m_stream.close();
+    LOG << "exported " << rendered_cards << " of " << cards.size() << " cards, " << ( m_data_size / 2 / sample_rate ) << " seconds: " << m_file_name;
+    return !! chapters;
+}
+
+
+void ListenExporter::render_batch( const std::vector<Card>& cards, size_t first, size_t end, size_t step, std::vector< std::vector<boost::int16_t> >& rendered )
+{
+    size_t begin = end - rendered.size();
+
+    for ( size_t i = first; i < end; i += step )
+    {
+        try
+        {
+            render( cards[i], rendered[i - begin] );
+        }
+        catch ( std::exception& e )
+        {
+            LOG << e.what();
+        }
+    }
+}
+
+
+void ListenExporter::render( const Card& card, std::vector<boost::int16_t>& samples )
+{
+    std::vector< std::pair<std::wstring, std::wstring> > word_paths = m_speech->get_word_speech_file_path( card.words );
+
+    for ( size_t i = 0; i < word_paths.size(); ++i )
+    {
+        std::wstring file = word_paths[i].second;
+
+        if ( file.empty() )
+        {
+            file = m_speech->m_tts_cache.synthesize( word_paths[i].first );
+        }
+
+        if ( file.empty() || ! decode_wav( file, samples ) )
+        {
+            LOG_DEBUG << "not exported: " << word_paths[i].first << " " << file;
+        }
+    }
+}
+
+
+void ListenExporter::write_samples( const std::vector<boost::int16_t>& samples )
+{
+    if ( ! samples.empty() )
+    {
+        m_stream.write( reinterpret_cast<const char*>( &samples[0] ), samples.size() * 2 );
+        m_data_size += samples.size() * 2;
+    }
+}
+
+
+void ListenExporter::write_header()
+{
+    boost::uint16_t fmt[8] = { 1, 1, 0, 0, 0, 0, 2, 16 }; // PCM, mono, rate, byte rate, 2 bytes a sample
+    boost::uint32_t byte_rate = sample_rate * 2;
+    memcpy( &fmt[2], &sample_rate, 4 );
+    memcpy( &fmt[4], &byte_rate, 4 );
+    boost::uint32_t fmt_size = sizeof(fmt);
+    boost::uint32_t data_size = static_cast<boost::uint32_t>( std::min<boost::uint64_t>( m_data_size, 0xFFFFFFFF - 36 ) );
+    boost::uint32_t riff_size = 4 + 8 + fmt_size + 8 + data_size;
+
+    m_stream.seekp( 0, std::ios::beg );
+    m_stream.write( "RIFF", 4 );
+    m_stream.write( reinterpret_cast<const char*>( &riff_size ), 4 );
+    m_stream.write( "WAVEfmt ", 8 );
+    m_stream.write( reinterpret_cast<const char*>( &fmt_size ), 4 );
+    m_stream.write( reinterpret_cast<const char*>( fmt ), fmt_size );
+    m_stream.write( "data", 4 );
+    m_stream.write( reinterpret_cast<const char*>( &data_size ), 4 );
+    m_stream.seekp( 0, std::ios::end );
+}
+
+
+bool ListenExporter::decode_wav( const std::wstring& file, std::vector<boost::int16_t>& samples )
+{
+    ClipCache::WavFormat format;
+
+    if ( ! ClipCache::read_format( file, format ) )
+    {
+        return false;
+    }
+
+    boost::uint16_t tag = 0;
+    boost::uint16_t channels = 0;
+    boost::uint32_t rate = 0;
+    boost::uint16_t bits = 0;
+    memcpy( &tag, &format.fmt[0], 2 );
+    memcpy( &channels, &format.fmt[2], 2 );
+    memcpy( &rate, &format.fmt[4], 4 );
+    memcpy( &bits, &format.fmt[14], 2 );
+
+    if ( tag == 0xFFFE && 26 <= format.fmt.size() ) // extensible: the sub format begins with the tag
+    {
+        memcpy( &tag, &format.fmt[24], 2 );
+    }
+
+    if ( 0 == channels || 0 == rate || ! ( ( tag == 1 && ( bits == 8 || bits == 16 ) ) || ( tag == 3 && bits == 32 ) ) )
+    {
+        return false;
+    }
+
+    std::string data( format.data_size, 0 );
+    std::ifstream is( file.c_str(), std::ios::in | std::ios::binary );
+    is.seekg( format.data_offset, std::ios::beg );
+    if ( ! data.empty() ) { is.read( &data[0], data.size() ); }
+    data.resize( static_cast<size_t>( is.gcount() ) );
+
+    size_t sample_size = bits / 8;
+    size_t frames = data.size() / ( sample_size * channels );
+    std::vector<float> mono( frames, 0 );
+
+    for ( size_t i = 0; i < frames; ++i )
+    {
+        for ( size_t c = 0; c < channels; ++c )
+        {
+            const char* p = &data[( i * channels + c ) * sample_size];
+            float v = 0;
+
+            if ( bits == 8 )
+            {
+                v = ( static_cast<unsigned char>( *p ) - 128 ) / 128.0f;
+            }
+            else if ( bits == 16 )
+            {
+                boost::int16_t s = 0;
+                memcpy( &s, p, 2 );
+                v = s / 32768.0f;
+            }
+            else
+            {
+                memcpy( &v, p, 4 );
+            }
+
+            mono[i] += v / channels;
+        }
+    }
+
+    if ( mono.empty() )
+    {
+        return true;
+    }
+
+    size_t out_frames = static_cast<size_t>( static_cast<boost::uint64_t>( frames ) * sample_rate / rate );
+    samples.reserve( samples.size() + out_frames );
+
+    for ( size_t i = 0; i < out_frames; ++i ) // linear interpolation to the output rate
+    {
+        double position = static_cast<double>( i ) * rate / sample_rate;
+        size_t j = static_cast<size_t>( position );
+        double fraction = position - j;
+        double v = mono[j] * ( 1 - fraction ) + mono[std::min( j + 1, frames - 1 )] * fraction;
+        v = std::max( -1.0, std::min( v, 1.0 ) );
+        samples.push_back( static_cast<boost::int16_t>( v * 32767 ) );
+    }
+
+    return true;
+}
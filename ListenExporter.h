@@ -0,0 +1,40 @@
+#pragma once
+#include "WordTable.h"
+class Speech;
+
+
+// renders listen mode into one .wav for players that can not run the program: the speech words of every card,
+// recorded or synthesized, back to back with a pause between cards, and <file>.chapters with where each card begins.
+// cards are decoded in parallel a batch at a time and written in order, so memory does not grow with the deck;
+// words without a file are synthesized one at a time, there is one voice
+class ListenExporter
+{
+public:
+
+    struct Card
+    {
+        size_t hash;
+        std::vector<WordTable::word_id> words;
+    };
+
+public:
+
+    ListenExporter( Speech* speech, const std::wstring& file_name, size_t pause );
+    bool run( const std::vector<Card>& cards );
+
+public:
+
+    void render_batch( const std::vector<Card>& cards, size_t first, size_t end, size_t step, std::vector< std::vector<boost::int16_t> >& rendered );
+    void render( const Card& card, std::vector<boost::int16_t>& samples );
+    void write_samples( const std::vector<boost::int16_t>& samples );
+    void write_header();
+    static bool decode_wav( const std::wstring& file, std::vector<boost::int16_t>& samples ); // appended as 16 bit mono
+
+public:
+
+    Speech* m_speech;
+    std::wstring m_file_name;
+    size_t m_pause;             // in milliseconds, between cards
+    std::ofstream m_stream;
+    boost::uint64_t m_data_size;
+};
@@ -5,21 +5,25 @@
 #include "OptionString.h"
 #include "DirectoryWatcher.h"
 #include "ProgramOptions.h"
+#include "SrtSubtitleParser.h"
 
 
-Loader::Loader( boost::function<size_t (const std::wstring&)> hash_function )
-    : m_last_write_time( 0 ),
+static const boost::wregex g_tag_expression( L"(?x) \\[ [a-zA-Z0-9_ -] \\]" ); // normalize_string(); built before main, so the server thread never races on a function static
+
+
+Loader::Loader( const std::wstring& file_name, boost::function<size_t (const std::wstring&)> hash_function )
+    : m_file_name( file_name ),
+      m_last_write_time( 0 ),
       m_hash_function( hash_function )
 {
-    m_file_name = ProgramOptions::get_vm()[file_name_option].as<std::wstring>();
     DirectoryWatcher::connect_to_signal( boost::bind( &Loader::process_file_change, this), m_file_name );
     reload();
 }
 
 
-const std::set<size_t>& Loader::get_string_hash_set()
+const CardIdSet& Loader::get_card_set()
 {
-    return m_string_hash_set;
+    return m_card_set;
 }
 
 
@@ -39,6 +43,49 @@ const std::wstring& Loader::get_string( size_t hash )
 }
 
 
+ParsedStringPtr Loader::get_parsed_string( size_t hash )
+{
+    CardIdTable::card_id id = m_card_ids.intern( hash );
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( m_parsed_strings.size() <= id )
+    {
+        m_parsed_strings.resize( id + 1 );
+    }
+
+    ParsedStringPtr& parsed = m_parsed_strings[id];
+
+    if ( ! parsed )
+    {
+        std::map<size_t, std::wstring>::iterator it = m_hash_2_string_map.find( hash );
+
+        if ( it == m_hash_2_string_map.end() )
+        {
+            static const ParsedStringPtr empty( new ParsedString( L"", std::vector<WordTable::word_id>() ) );
+            return empty;
+        }
+
+        parsed.reset( new ParsedString( it->second, id < m_card_words.size() ? m_card_words[id] : std::vector<WordTable::word_id>() ) );
+    }
+
+    return parsed;
+}
+
+
+std::vector<WordTable::word_id> Loader::get_card_words( size_t hash )
+{
+    CardIdTable::card_id id = m_card_ids.find( hash );
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( id == CardIdTable::invalid_id || m_card_words.size() <= id )
+    {
+        return std::vector<WordTable::word_id>();
+    }
+
+    return m_card_words[id];
+}
+
+
 void Loader::reload()
 {
     boost::unique_lock<boost::mutex> lock( m_mutex );
@@ -46,13 +93,14 @@ void Loader::reload()
     if ( ! boost::filesystem::exists( m_file_name ) )
     {
         LOG << "can not find " << m_file_name;
-        m_string_hash_set.clear();
+        m_card_set.clear();
         m_hash_2_string_map.clear();
         m_last_write_time = 0;
+        m_search_index.retain( std::vector<CardIdTable::card_id>() );
         return;
     }
 
-    std::time_t t = boost::filesystem::last_write_time( m_file_name );
+    std::time_t t = DirectoryWatcher::get_last_write_time( m_file_name ); // a subtitle directory: its newest file
 
     if ( t == m_last_write_time )
     {
@@ -61,92 +109,296 @@ void Loader::reload()
 
     LOG_DEBUG << "last-writ-time: " << Utility::string_from_time_t( m_last_write_time ) << ", new last-write-time: " << Utility::string_from_time_t( t );
 
-    std::wstring fise_string = Utility::wstring_from_file( m_file_name.c_str() );
-    std::vector<std::wstring> lines = Utility::split_string_to_lines( fise_string );
+    CardIdSet card_set;
+    std::map<size_t, std::wstring> hash_2_string_map;
+    std::map<size_t, SubtitleCue> subtitle_cues;
 
-    if ( lines.empty() )
+    if ( boost::filesystem::is_directory( m_file_name ) || Utility::SrtSubtitleParser::is_subtitle_file( m_file_name ) )
     {
-        LOG << "cannot open file: " << m_file_name;
-        return;
+        load_subtitles( card_set, hash_2_string_map, subtitle_cues );
     }
+    else
+    {
+        std::wstring fise_string = Utility::wstring_from_file( m_file_name.c_str() );
+        std::vector<std::wstring> lines = Utility::split_string_to_lines( fise_string );
 
-    std::set<size_t> string_hash_set;
-    std::map<size_t, std::wstring> hash_2_string_map;
+        if ( lines.empty() )
+        {
+            LOG << "cannot open file: " << m_file_name;
+            return;
+        }
+
+        for ( size_t i = 0; i < lines.size(); ++i )
+        {
+            std::wstring& s = lines[i];
 
-    for ( size_t i = 0; i < lines.size(); ++i )
+            boost::trim(s);
+            boost::replace_all( s, L"\\n", L"\n" );
+            boost::replace_all( s, L"\\t", L"\t" );
+
+            if ( s.empty() || L'#' == s[0] )
+            {
+                continue;
+            }
+
+            add_string( s, i + 1, card_set, hash_2_string_map );
+        }
+    }
+
+    m_subtitle_cues.swap( subtitle_cues );
+
+    if ( m_card_set != card_set )
+    {
+        LOG_DEBUG << "old-size = " << m_card_set.size() << ", new-size = " << card_set.size();
+
+        if ( m_last_write_time != 0 )
+        {
+            LOG_DEBUG << get_difference( m_card_set, m_hash_2_string_map, card_set, hash_2_string_map );
+        }
+
+        m_card_set = card_set;
+        m_hash_2_string_map = hash_2_string_map;
+        retain_search_index();
+    }
+
+    m_last_write_time = t;
+}
+
+
+size_t Loader::add_string( const std::wstring& s, size_t line, CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map )
+{
+    size_t hash = m_hash_function( s );
+
+    if ( hash != 0 )
     {
-        std::wstring& s = lines[i];
+        std::map<size_t, std::wstring>::iterator find_it = hash_2_string_map.find( hash );
 
-        boost::trim(s);
-        boost::replace_all( s, L"\\n", L"\n" );
-        boost::replace_all( s, L"\\t", L"\t" );
+        if ( find_it != hash_2_string_map.end() && normalize_string( find_it->second ) != normalize_string( s ) )
+        {
+            LOG << "hash collision (" << hash << "), ignore line " << line << ": " << s << " (conflicts with: " << find_it->second << ")";
+            return 0;
+        }
 
-        if ( s.empty() || L'#' == s[0] )
+        hash_2_string_map[hash] = s;
+        CardIdTable::card_id id = m_card_ids.intern( hash );
+        card_set.insert( id );
+
+        if ( m_card_words.size() <= id )
         {
-            continue;
+            m_card_words.resize( id + 1 );
         }
 
-        size_t hash = m_hash_function( s );
+        if ( m_card_words[id].empty() ) // a hash never changes its text
+        {
+            m_card_words[id] = WordTable::instance().intern_words( Utility::extract_strings_in_braces( s ) );
+        }
 
-        if ( hash != 0 )
+        if ( ! m_search_index.contains( id ) )
         {
-            string_hash_set.insert( hash );
-            hash_2_string_map[hash] = s;
+            m_search_index.add( id, s, normalize_string( s ), WordTable::instance().get_words( m_card_words[id] ) );
         }
     }
 
-    if ( m_string_hash_set != string_hash_set )
+    return hash;
+}
+
+
+void Loader::load_subtitles( CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map, std::map<size_t, SubtitleCue>& subtitle_cues )
+{
+    std::vector<std::wstring> files;
+
+    if ( boost::filesystem::is_directory( m_file_name ) )
     {
-        LOG_DEBUG << "old-size = " << m_string_hash_set.size() << ", new-size = " << string_hash_set.size();
+        for ( boost::filesystem::directory_iterator it( m_file_name ), end; it != end; ++it )
+        {
+            if ( boost::filesystem::is_regular_file( it->path() ) && Utility::SrtSubtitleParser::is_subtitle_file( it->path().wstring() ) )
+            {
+                files.push_back( it->path().wstring() );
+            }
+        }
 
-        if ( m_last_write_time != 0 )
+        std::sort( files.begin(), files.end() );
+    }
+    else
+    {
+        files.push_back( m_file_name );
+    }
+
+    for ( size_t i = 0; i < files.size(); ++i )
+    {
+        if ( ! Utility::SrtSubtitleParser::parse_file( files[i], boost::bind( &Loader::add_subtitle, this, i, boost::ref( card_set ), boost::ref( hash_2_string_map ), boost::ref( subtitle_cues ), _1 ) ) )
         {
-            LOG_DEBUG << get_difference( m_string_hash_set, m_hash_2_string_map, string_hash_set, hash_2_string_map );
+            LOG << "cannot open file: " << files[i];
         }
+    }
 
-        m_string_hash_set = string_hash_set;
-        m_hash_2_string_map = hash_2_string_map;
+    m_subtitle_files.swap( files );
+    LOG_DEBUG << m_file_name << ": " << m_subtitle_files.size() << " subtitle files, " << subtitle_cues.size() << " cues";
+}
+
+
+void Loader::add_subtitle( size_t file, CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map, std::map<size_t, SubtitleCue>& subtitle_cues, const Utility::SrtSubtitle& sub )
+{
+    std::wstring s = ( sub.text2.empty() ? sub.text : L"[Q] " + sub.text + L" [A] " + sub.text2 );
+    size_t hash = add_string( s, sub.number, card_set, hash_2_string_map );
+
+    if ( hash != 0 && subtitle_cues.find( hash ) == subtitle_cues.end() ) // a repeated line keeps its first cue
+    {
+        SubtitleCue cue = { file, sub.start_time, sub.stop_time };
+        subtitle_cues[hash] = cue;
     }
+}
 
-    m_last_write_time = t;
+
+void Loader::retain_search_index()
+{
+    m_search_index.retain( m_card_set.get_ids() );
 }
 
 
-size_t Loader::string_hash( const std::wstring& str )
+std::vector<size_t> Loader::search( const std::wstring& query, size_t limit )
+{
+    std::vector<std::wstring> terms;
+    std::vector<std::wstring> verify; // substrings longer than a trigram
+    std::vector<SearchIndex::card_id> ids;
+    boost::split( terms, query, boost::is_any_of( L" \t" ), boost::token_compress_on );
+
+    for ( size_t i = 0, matched = 0; i < terms.size(); ++i )
+    {
+        std::vector<SearchIndex::card_id> found;
+
+        if ( 1 < terms[i].size() && L'*' == terms[i][terms[i].size() - 1] )
+        {
+            found = m_search_index.find_prefix( terms[i].substr( 0, terms[i].size() - 1 ) );
+        }
+        else
+        {
+            std::wstring normalized = normalize_string( terms[i] );
+
+            if ( normalized.empty() )
+            {
+                continue;
+            }
+
+            found = m_search_index.find_substring( normalized );
+
+            if ( 3 < normalized.size() )
+            {
+                verify.push_back( normalized );
+            }
+        }
+
+        if ( 0 == matched++ )
+        {
+            ids.swap( found );
+        }
+        else
+        {
+            std::vector<SearchIndex::card_id> result;
+            std::set_intersection( ids.begin(), ids.end(), found.begin(), found.end(), std::back_inserter( result ) );
+            ids.swap( result );
+        }
+    }
+
+    std::vector<size_t> hashes;
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    for ( size_t i = 0; i < ids.size() && hashes.size() < limit; ++i )
+    {
+        size_t hash = m_card_ids.get_hash( ids[i] );
+
+        if ( ! verify.empty() )
+        {
+            std::map<size_t, std::wstring>::iterator it = m_hash_2_string_map.find( hash );
+            std::wstring normalized = ( it == m_hash_2_string_map.end() ? L"" : normalize_string( it->second ) );
+            size_t j = 0;
+
+            while ( j < verify.size() && normalized.find( verify[j] ) != std::wstring::npos )
+            {
+                ++j;
+            }
+
+            if ( j < verify.size() )
+            {
+                continue;
+            }
+        }
+
+        hashes.push_back( hash );
+    }
+
+    return hashes;
+}
+
+
+bool Loader::get_subtitle_cue( size_t hash, std::wstring& subtitle_file, size_t& start_time, size_t& stop_time )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    std::map<size_t, SubtitleCue>::iterator it = m_subtitle_cues.find( hash );
+
+    if ( it == m_subtitle_cues.end() )
+    {
+        return false;
+    }
+
+    subtitle_file = m_subtitle_files[it->second.file];
+    start_time = it->second.start_time;
+    stop_time = it->second.stop_time;
+    return true;
+}
+
+
+std::wstring Loader::normalize_string( const std::wstring& str )
 {
     std::wstring s = str;
-    static boost::wregex e( L"(?x) \\[ [a-zA-Z0-9_ -] \\]" );
-    s = boost::regex_replace( s, e, L"" );
+    s = boost::regex_replace( s, g_tag_expression, L"" );
     boost::to_lower(s);
     const wchar_t* symbols =L" \"\',.?:;!-/#()|<>{}[]~`@$%^&*+\n\t"
         L"࣭ߣ";
     Utility::remove_if_isany_of(s, symbols  );
+    return s;
+}
+
+
+size_t Loader::string_hash( const std::wstring& str )
+{
+    std::wstring s = normalize_string( str );
 
     if ( s.empty() )
     {
         return 0;
     }
 
-    static boost::hash<std::wstring> string_hasher;
-    size_t hash = string_hasher(s);
+    std::string utf8 = Utility::to_string( s, CP_UTF8 );
+    size_t hash = Utility::hash_from_uint64( Utility::xxhash64( utf8.c_str(), utf8.size() ) );
     LOG_TRACE << "hash = " << hash << " \t" << s;
     return hash;
 }
 
 
-std::wstring Loader::get_difference( const HashSet& os, const HashStringMap& om, const HashSet& ns, const HashStringMap& nm )
+size_t Loader::string_hash_legacy( const std::wstring& str )
 {
-    std::set<size_t> removed;
-    std::set_difference( os.begin(), os.end(), ns.begin(), ns.end(), std::inserter(removed, removed.begin()) );
+    std::wstring s = normalize_string( str );
 
-    std::set<size_t> added;
-    std::set_difference( ns.begin(), ns.end(), os.begin(), os.end(), std::inserter(added, added.begin()) );
+    if ( s.empty() )
+    {
+        return 0;
+    }
+
+    static boost::hash<std::wstring> string_hasher;
+    return string_hasher(s);
+}
 
+
+std::wstring Loader::get_difference( const CardIdSet& os, const HashStringMap& om, const CardIdSet& ns, const HashStringMap& nm )
+{
+    std::vector<CardIdTable::card_id> removed = os.difference( ns ).get_ids();
+    std::vector<CardIdTable::card_id> added = ns.difference( os ).get_ids();
     std::wstringstream strm;
 
-    for ( std::set<size_t>::iterator it = removed.begin(); it != removed.end(); ++it )
+    for ( size_t i = 0; i < removed.size(); ++i )
     {
-        std::map<size_t, std::wstring>::const_iterator find_it = om.find( *it );
+        std::map<size_t, std::wstring>::const_iterator find_it = om.find( m_card_ids.get_hash( removed[i] ) );
 
         if ( find_it != om.end() )
         {
@@ -154,9 +406,9 @@ std::wstring Loader::get_difference( const HashSet& os, const HashStringMap& om,
         }
     }
 
-    for ( std::set<size_t>::iterator it = added.begin(); it != added.end(); ++it )
+    for ( size_t i = 0; i < added.size(); ++i )
     {
-        std::map<size_t, std::wstring>::const_iterator find_it = nm.find( *it );
+        std::map<size_t, std::wstring>::const_iterator find_it = nm.find( m_card_ids.get_hash( added[i] ) );
 
         if ( find_it != nm.end() )
         {
@@ -1,5 +1,8 @@
 #pragma once
-typedef std::set<size_t> HashSet;
+#include "CardIdTable.h"
+#include "ParsedString.h"
+#include "SrtSubtitleParser.h"
+#include "SearchIndex.h"
 typedef std::map<size_t, std::wstring> HashStringMap;
 
 
@@ -7,31 +10,56 @@ class Loader
 {
 public:
 
-    Loader( boost::function<size_t (const std::wstring&)> hash_function = &Loader::string_hash );
-    const std::set<size_t>& get_string_hash_set();
+    struct SubtitleCue
+    {
+        size_t file;        // index of m_subtitle_files
+        size_t start_time;  // in milliseconds
+        size_t stop_time;
+    };
+
+public:
+
+    Loader( const std::wstring& file_name, boost::function<size_t (const std::wstring&)> hash_function = &Loader::string_hash );
+    const CardIdSet& get_card_set(); // the cards of the file, by id
     const std::wstring& get_string( size_t hash );
     const std::wstring& get_string_no_lock( size_t hash ) { return m_hash_2_string_map[hash]; } // should lock ouside
+    ParsedStringPtr get_parsed_string( size_t hash );
+    std::vector<WordTable::word_id> get_card_words( size_t hash );
+    bool get_subtitle_cue( size_t hash, std::wstring& subtitle_file, size_t& start_time, size_t& stop_time );
+    CardIdTable& get_card_ids() { return m_card_ids; }
+    std::vector<size_t> search( const std::wstring& query, size_t limit ); // hashes; terms are substrings of the normalized text, "term*" a word prefix, all must match
 
 public:
 
     void reload();
     void process_file_change(); // DirectoryWatcher slot
+    size_t add_string( const std::wstring& s, size_t line, CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map ); // 0: ignored
+    void load_subtitles( CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map, std::map<size_t, SubtitleCue>& subtitle_cues );
+    void add_subtitle( size_t file, CardIdSet& card_set, std::map<size_t, std::wstring>& hash_2_string_map, std::map<size_t, SubtitleCue>& subtitle_cues, const Utility::SrtSubtitle& sub );
+    void retain_search_index(); // should lock outside
 
 public:
 
-    static size_t string_hash( const std::wstring& str );
-    static size_t string_hash_new( const std::wstring& str ) { std::cout << "are you kidding?" << std::endl; ::exit(0); }
+    static std::wstring normalize_string( const std::wstring& str );
+    static size_t string_hash( const std::wstring& str );           // XXH64 of the normalized string in UTF-8
+    static size_t string_hash_legacy( const std::wstring& str );    // boost::hash, only to upgrade old history
 
 public:
 
-    static std::wstring get_difference( const HashSet& os, const HashStringMap& om, const HashSet& ns, const HashStringMap& nm );
+    std::wstring get_difference( const CardIdSet& os, const HashStringMap& om, const CardIdSet& ns, const HashStringMap& nm );
 
 public:
 
     boost::mutex m_mutex;
     std::wstring m_file_name;
     std::time_t m_last_write_time;
-    std::set<size_t> m_string_hash_set;
+    CardIdSet m_card_set;                           // by card id
     std::map<size_t, std::wstring> m_hash_2_string_map;
+    CardIdTable m_card_ids;
+    std::vector<ParsedStringPtr> m_parsed_strings;  // by card id, parsed on first review; a hash never changes its text
+    std::vector< std::vector<WordTable::word_id> > m_card_words; // by card id, the speech words, extracted on load
+    SearchIndex m_search_index;                     // every card loaded once, only the current ones found
+    std::vector<std::wstring> m_subtitle_files;     // when the deck is a .srt/.vtt file or a directory of them
+    std::map<size_t, SubtitleCue> m_subtitle_cues;  // hash -> where the card is in its subtitle file
     boost::function<size_t (const std::wstring&)> m_hash_function;
 };
@@ -0,0 +1,40 @@
+#pragma once
+
+
+// an immutable, versioned set of options published to every thread.
+// writers (the ProgramOptions slots) copy the current snapshot, change the copy and publish it;
+// readers take one snapshot per call and never see a half-updated option set.
+// T must be copyable and have a 'size_t version' member.
+template<typename T>
+class OptionSnapshot
+{
+public:
+
+    typedef boost::shared_ptr<const T> pointer;
+
+    OptionSnapshot()
+        : m_snapshot( new T )
+    {
+    }
+
+    pointer get() const
+    {
+        return boost::atomic_load( &m_snapshot );
+    }
+
+    T copy() const
+    {
+        return *get();
+    }
+
+    void publish( const T& options )
+    {
+        boost::shared_ptr<T> snapshot( new T( options ) );
+        snapshot->version = get()->version + 1;
+        boost::atomic_store( &m_snapshot, pointer( snapshot ) );
+    }
+
+public:
+
+    pointer m_snapshot;
+};
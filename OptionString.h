@@ -13,6 +13,9 @@
 #define file_name_option                        "file.name"
 #define file_history_option                     "file.history-name"
 #define file_review_option                      "file.review-name"
+#define file_times_option                       "file.times-name"
+#define file_decks_option                       "file.decks"
+#define file_back_option                        "file.back-name"
 
 #define review_section                          "review"
 #define review_schedule                         "review.schedule"
@@ -23,6 +26,12 @@
 #define review_display_format_option            "review.display-format"
 #define review_once_per_days_option             "review.once-per-days"
 #define review_minimal_review_distance_option   "review.minimal-review-distance"
+#define review_scheduler_option                 "review.scheduler"
+#define review_evaluate_scheduler_option        "review.evaluate-scheduler"
+#define review_session_size_option              "review.session-size"
+#define review_back_size_option                 "review.back-size"
+#define review_forecast_days_option             "review.forecast-days"
+#define review_dump_stats_option                "review.dump-stats"
 
 #define speech_section                          "speech"
 #define speech_path_option                      "speech.path"
@@ -30,10 +39,18 @@
 #define speech_play_back                        "speech.play-back"
 #define speech_no_duplicate                     "speech.no-duplicate"
 #define speech_no_text_to_speech                "speech.no-text-to-speech"
+#define speech_clip_cache_path_option           "speech.clip-cache-path"
+#define speech_clip_cache_size_option           "speech.clip-cache-size"
+#define speech_output_option                    "speech.output"
+#define speech_tts_cache_path_option            "speech.tts-cache-path"
+#define speech_tts_voice_option                 "speech.tts-voice"
 
 #define listen_section                          "listen"
 #define listen_no_string_option                 "listen.no-string"
 #define listen_all_option                       "listen.all"
+#define listen_prefetch_option                  "listen.prefetch"
+#define listen_pause_option                     "listen.pause"
+#define listen_export_option                    "listen.export"
 
 #define upgrade_section                         "upgrade"
 #define upgrade_hash_algorithm_option           "upgrade.hash-algorithm"
@@ -44,4 +61,9 @@
 #define system_console_width                    "system.console-width"
 #define system_console_height                   "system.console-height"
 #define system_console_color                    "system.console-color"
+#define system_console_renderer                 "system.console-renderer"
 #define system_picture_path                     "system.picture-path"
+
+#define server_section                          "server"
+#define server_port_option                      "server.port"
+#define server_request_option                   "server.request"
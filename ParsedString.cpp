@@ -0,0 +1,34 @@
+#include "stdafx.h"
+#include "ParsedString.h"
+#include "Utility.h"
+
+
+ParsedString::ParsedString( const std::wstring& s, const std::vector<WordTable::word_id>& words )
+    : text( s ),
+      speech_words( words )
+{
+    text.erase( std::remove_if( text.begin(), text.end(), boost::is_any_of( "{}" ) ), text.end() );
+
+    // each [x] marker owns the text up to the next marker or the end; a linear scan, no shared regex between threads
+    size_t marker = std::wstring::npos;
+
+    for ( size_t i = 0; i <= text.size(); ++i )
+    {
+        if ( i == text.size() || is_part_marker( text, i ) )
+        {
+            if ( marker != std::wstring::npos )
+            {
+                parts[text[marker + 1]] = boost::trim_copy( text.substr( marker + 3, i - marker - 3 ) );
+            }
+
+            marker = i;
+            i += 2;
+        }
+    }
+}
+
+
+bool ParsedString::is_part_marker( const std::wstring& s, size_t i )
+{
+    return i + 2 < s.size() && L'[' == s[i] && L']' == s[i + 2] && ( ( L'a' <= s[i + 1] && s[i + 1] <= L'z' ) || ( L'A' <= s[i + 1] && s[i + 1] <= L'Z' ) );
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "WordTable.h"
+
+
+// a card's text parsed once for review; immutable, so every ReviewString of the card shares it
+struct ParsedString
+{
+    ParsedString( const std::wstring& s, const std::vector<WordTable::word_id>& words );
+    static bool is_part_marker( const std::wstring& s, size_t i ); // [a] to [Z] at i
+
+    std::wstring text;                                  // braces removed
+    std::vector<WordTable::word_id> speech_words;       // the words in braces, extracted when the deck was loaded
+    std::map<wchar_t, std::wstring> parts;  // [Q] question [A] answer ...
+};
+
+typedef boost::shared_ptr<const ParsedString> ParsedStringPtr;
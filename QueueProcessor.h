@@ -1,4 +1,5 @@
 #pragma once
+#include "Log.h"
 
 
 template< typename T = std::wstring, typename C = std::vector<T> >
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "ReviewManager.h"
+#include "Deck.h"
 #include "History.h"
 #include "Loader.h"
 #include "Speech.h"
@@ -9,49 +10,41 @@
 #include "OptionString.h"
 #include "ProgramOptions.h"
 #include "OptionUpdateHelper.h"
+#include "AudioOutput.h"
+#include "ListenExporter.h"
+#include "ConsoleFrame.h"
 
 std::wstring g_current_wallpaper;
 ReviewManager* g_review_manager = NULL;
 
 
-struct Order
-{
-    Order( Loader* l, History* h ) : loader(l), history(h) {}
-
-    bool operator()( size_t lhs, size_t rhs ) const
-    {
-        size_t lr = history->get_review_round(lhs);
-        size_t rr = history->get_review_round(rhs);
-        std::time_t lt = history->get_last_review_time( lhs );
-        std::time_t rt = history->get_last_review_time( rhs );
-        return ( ( lr < rr ) || ( lr == rr && rt < lt ) || ( lr == rr && lt == rt && lhs < rhs ) );
-    }
-
-    Loader* loader;
-    History* history;
-};
-
-
 ReviewManager::ReviewManager()
-    : m_review_mode( Forward ),
-      m_backward_index( 0 ),
-      m_loader( NULL ),
-      m_history( NULL ),
-      m_speech( NULL ),
-      m_speech_impl( NULL ),
+    : m_speech_impl( NULL ),
       m_is_listening( false ),
-      m_minimal_review_time( 500 * 1000 * 1000 ),
-      m_auto_update_interval( 60 ),
-      m_play_back( 0 ),
       m_current_reviewing( NULL ),
-      m_listen_no_string( false ),
-      m_listen_all( false ),
+      m_review_order_index( 0 ),
       m_review_number( 0 ),
-      m_minimal_review_distance( 10 ),
+      m_session_index( 0 ),
       m_running( true )
 {
-    m_loader = new Loader;
-    m_history = new History;
+    const boost::program_options::variables_map& vm = ProgramOptions::get_vm();
+    m_decks.push_back( new Deck( vm[file_name_option].as<std::wstring>() ) );
+
+    if ( vm.count( file_decks_option ) )
+    {
+        std::vector<std::wstring> files = Utility::split_string( vm[file_decks_option].as<std::wstring>(), L"|" );
+
+        for ( size_t i = 0; i < files.size(); ++i )
+        {
+            std::wstring file = boost::trim_copy( files[i] );
+
+            if ( ! file.empty() ) // "a||b" or a trailing "|"
+            {
+                m_decks.push_back( new Deck( file ) );
+            }
+        }
+    }
+
     m_speech_impl = new Speech;
     m_connection = ProgramOptions::connect_to_signal( boost::bind( &ReviewManager::update_option, this, _1 ) );
     g_review_manager = this;
@@ -68,22 +61,52 @@ ReviewManager::~ReviewManager()
     m_update_thread.join();
 
     delete m_speech_impl;
-    delete m_history;
-    delete m_loader;
+
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        delete m_decks[i];
+    }
 }
 
 
-void ReviewManager::review()
+void ReviewManager::initialize()
 {
-    std::wstring action;
-    boost::timer::cpu_timer t;
-    ReviewString n;
+    OptionsPtr options = m_options.get();
+
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        m_decks[i]->initialize();
+    }
+
+    if ( options->speech )
+    {
+        std::set<WordTable::word_id> ids;
+
+        for ( size_t i = 0; i < m_decks.size(); ++i )
+        {
+            std::vector<CardIdTable::card_id> cards = m_decks[i]->m_loader->get_card_set().get_ids();
+
+            for ( size_t j = 0; j < cards.size(); ++j )
+            {
+                std::vector<WordTable::word_id> w = m_decks[i]->m_loader->get_card_words( m_decks[i]->m_loader->get_card_ids().get_hash( cards[j] ) );
+                ids.insert( w.begin(), w.end() );
+            }
+        }
+
+        options->speech->prefill( WordTable::instance().get_words( std::vector<WordTable::word_id>( ids.begin(), ids.end() ) ) );
+    }
 
-    m_history->initialize();
-    m_history->synchronize_history( m_loader->get_string_hash_set() );
     set_console_title();
     update();
     m_update_thread = boost::thread( boost::bind( &ReviewManager::update_thread, this ) );
+}
+
+
+void ReviewManager::review()
+{
+    std::wstring action;
+    boost::timer::cpu_timer t;
+    ReviewString n;
 
     while ( m_running )
     {
@@ -96,6 +119,7 @@ void ReviewManager::review()
 
             t.start();
             action = n.review();
+            log_review( n );
 
             if ( action == L"next" )
             {
@@ -109,6 +133,7 @@ void ReviewManager::review()
                 n = get_previous();
                 m_current_reviewing = &n;
                 action = n.review();
+                log_review( n );
 
                 if ( action == L"next" )
                 {
@@ -139,32 +164,42 @@ void ReviewManager::review()
 
             if ( action == L"delete" )
             {
-                m_history->disable( n.get_hash() );
+                boost::unique_lock<boost::mutex> lock( m_mutex ); // the server and update threads change the history too
+                n.m_history->disable( n.get_hash() );
             }
 
             if ( action == L"add-to-group" )
             {
-                m_review_group.push_back( n );
+                add_to_group( n );
             }
 
-            if ( m_running && m_speech && m_play_back )
+            OptionsPtr options = m_options.get();
+
+            if ( 0 == options->play_back && ! m_play_back_string.empty() )
+            {
+                m_play_back_string.clear();
+            }
+
+            if ( m_running && options->speech && options->play_back )
             {
                 m_play_back_string.push_back( n );
 
-                while ( m_play_back < m_play_back_string.size() )
+                while ( options->play_back < m_play_back_string.size() )
                 {
                     m_play_back_string.pop_front();
                 }
 
-                std::vector<std::wstring> w;
+                std::vector<WordTable::word_id> w;
 
                 for ( std::list<ReviewString>::iterator it = m_play_back_string.begin(); it != m_play_back_string.end(); ++it )
                 {
-                    std::vector<std::wstring> w2 = Utility::extract_strings_in_braces( it->get_string() );
-                    w.insert( w.end(), w2.begin(), w2.end() );
+                    if ( it->m_parsed )
+                    {
+                        w.insert( w.end(), it->m_parsed->speech_words.begin(), it->m_parsed->speech_words.end() );
+                    }
                 }
 
-                std::vector< std::pair<std::wstring, std::wstring> > word_paths = m_speech->get_word_speech_file_path( w );
+                std::vector< std::pair<std::wstring, std::wstring> > word_paths = options->speech->get_word_speech_file_path( w );
                 Utility::play_or_tts_list_thread( word_paths );
             }
 
@@ -172,20 +207,42 @@ void ReviewManager::review()
             n.m_speech = NULL;
             LOG_TRACE << "end do";
         }
-        while ( m_running && ( t.elapsed().wall < m_minimal_review_time ) );
+        while ( m_running && ( t.elapsed().wall < m_options.get()->minimal_review_time ) );
     }
 }
 
 
 ReviewString ReviewManager::get_next()
 {
-    LOG_TRACE << "begin";
-
     boost::thread( boost::bind( &ReviewManager::show_next_picture, this, L"" ) );
 
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_back_cursor = ReviewRing::Cursor(); // the console goes forward again
+    }
+
+    return take_next( true );
+}
+
+
+ReviewString ReviewManager::take_next( bool save_review, bool* again )
+{
+    LOG_TRACE << "begin";
+
     boost::unique_lock<boost::mutex> lock( m_mutex );
+    OptionsPtr options = m_options.get();
 
-    m_review_mode = Forward;
+    if ( again != NULL )
+    {
+        *again = false;
+    }
+
+    if ( options->session_size )
+    {
+        return take_session_next( save_review, *options, again );
+    }
+
+    end_session();
 
     if ( m_reviewing_list.empty() )
     {
@@ -198,73 +255,328 @@ ReviewString ReviewManager::get_next()
         }
     }
 
-    for ( std::list<ReviewString>::iterator it = m_review_group.begin(); it != m_review_group.end(); ++it )
+    if ( ! m_review_group.empty() && m_review_group.begin()->first <= m_review_number )
     {
-        size_t hash = it->get_hash();
+        GroupCard group = m_review_group.begin()->second;
+        m_review_group.erase( m_review_group.begin() );
+        size_t hash = group.deck->m_loader->get_card_ids().get_hash( group.id );
+        group.deck->get_review_number( hash ) = m_review_number++;
 
-        if ( m_minimal_review_distance < m_review_number - m_hash_number_map[hash] )
+        if ( again != NULL )
         {
-            ReviewString s = *it;
-            m_review_group.erase( it );
-            s.m_speech = m_speech;
-            m_hash_number_map[hash] = m_review_number++;
-            return s;
+            *again = true;
         }
+
+        return ReviewString( hash, group.deck->m_loader, group.deck->m_history, options->speech, options->display_format );
     }
 
-    size_t hash = get_next_hash( m_reviewing_list, get_next_order( m_review_orders, m_review_order_it ) );
-    m_reviewing_set.erase( hash );
-    m_review_history.push_back( hash );
-    m_history->save_history( hash, std::time(0) );
+    DeckCard card = get_next_card( m_reviewing_list, get_next_order( options->review_orders, m_review_order_index ) );
+    Deck* deck = card.first;
+    size_t hash = card.second;
 
-    if ( m_reviewing_set.empty() )
+    if ( NULL == deck )
     {
-        m_history->write_history();
-        m_history->clean_review_cache();
+        return ReviewString();
     }
 
-    if ( m_auto_update_interval )
+    deck->m_reviewing_set.erase( deck->get_card_id( hash ) );
+    push_review_history( card );
+
+    if ( save_review )
     {
-        m_condition.notify_one();
+        save_history( deck, hash, Scheduler::Good );
     }
 
-    m_hash_number_map[hash] = m_review_number++;
+    deck->get_review_number( hash ) = m_review_number++;
 
     LOG_TRACE << "end";
     set_console_title();
-    return ReviewString( hash, m_loader, m_history, m_speech, m_display_format );
+    return ReviewString( hash, deck->m_loader, deck->m_history, options->speech, options->display_format );
 }
 
 
-ReviewString ReviewManager::get_previous()
+ReviewString ReviewManager::take_session_next( bool save_review, const Options& options, bool* again )
+{
+    if ( m_session_index == m_session.size() )
+    {
+        update();
+        build_session( options );
+
+        if ( m_session.empty() )
+        {
+            set_console_title();
+            return ReviewString();
+        }
+    }
+
+    const SessionCard& next = m_session[m_session_index++];
+    Deck* deck = next.card.first;
+    size_t hash = next.card.second;
+
+    if ( again != NULL )
+    {
+        *again = next.again;
+    }
+
+    if ( ! next.again )
+    {
+        deck->m_reviewing_set.erase( deck->get_card_id( hash ) );
+        push_review_history( next.card );
+
+        if ( save_review )
+        {
+            save_history( deck, hash, Scheduler::Good );
+        }
+    }
+
+    deck->get_review_number( hash ) = m_review_number++;
+
+    set_console_title();
+    return ReviewString( hash, deck->m_loader, deck->m_history, options.speech, options.display_format );
+}
+
+
+void ReviewManager::build_session( const Options& options )
+{
+    std::list<DeckCard> due;
+
+    for ( std::list<DeckCard>::iterator it = m_reviewing_list.begin(); it != m_reviewing_list.end(); ++it )
+    {
+        if ( it->first->m_reviewing_set.contains( it->first->get_card_id( it->second ) ) ) // not reviewed in the last batch
+        {
+            due.push_back( *it );
+        }
+    }
+
+    m_reviewing_list.swap( due );
+    m_session.clear();
+    m_session_index = 0;
+
+    while ( ! m_reviewing_list.empty() && m_session.size() < options.session_size )
+    {
+        m_session.push_back( SessionCard( get_next_card( m_reviewing_list, get_next_order( options.review_orders, m_review_order_index ) ) ) );
+    }
+
+    for ( std::multimap<size_t, GroupCard>::iterator it = m_review_group.begin(); it != m_review_group.end(); ++it )
+    {
+        insert_group_card( it->second, true );
+    }
+
+    m_review_group.clear();
+    LOG_DEBUG << "session " << m_session.size() << ", due " << m_reviewing_list.size();
+}
+
+
+void ReviewManager::end_session()
+{
+    for ( size_t i = m_session.size(); m_session_index < i; --i ) // give the rest back
+    {
+        if ( ! m_session[i - 1].again )
+        {
+            m_reviewing_list.push_front( m_session[i - 1].card );
+        }
+    }
+
+    for ( size_t i = m_session_index; i < m_session.size(); ++i ) // group cards shown again are eligible now, in session order
+    {
+        const DeckCard& card = m_session[i].card;
+
+        if ( m_session[i].again )
+        {
+            m_review_group.insert( std::make_pair( m_review_number, GroupCard( m_review_number, card.first, card.first->m_loader->get_card_ids().intern( card.second ) ) ) );
+        }
+    }
+
+    m_session.clear();
+    m_session_index = 0;
+}
+
+
+void ReviewManager::log_review( ReviewString& s )
 {
     boost::unique_lock<boost::mutex> lock( m_mutex );
 
+    if ( s.m_history && s.m_parsed )
+    {
+        LOG_DEBUG
+            << s.m_parsed->text << std::endl << "\t\t"
+            << "[Round: " << s.m_history->get_review_round( s.get_hash() ) << "]";
+    }
+}
+
+
+void ReviewManager::add_to_group( const ReviewString& s )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    Deck* deck = get_deck( s.m_history );
+
+    if ( deck == NULL )
+    {
+        return;
+    }
+
+    GroupCard group( deck->get_review_number( s.m_hash ) + m_options.get()->minimal_review_distance + 1, deck, deck->m_loader->get_card_ids().intern( s.m_hash ) );
+
+    if ( m_session.empty() || ! insert_group_card( group, false ) )
+    {
+        m_review_group.insert( std::make_pair( group.eligible, group ) );
+    }
+}
+
+
+void ReviewManager::put_back( const ReviewString& s, bool again )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    Deck* deck = get_deck( s.m_history );
+
+    if ( deck == NULL )
+    {
+        return;
+    }
+
+    if ( again ) // saved already, shown again as soon as it can be
+    {
+        m_review_group.insert( std::make_pair( m_review_number, GroupCard( m_review_number, deck, deck->m_loader->get_card_ids().intern( s.m_hash ) ) ) );
+    }
+    else if ( deck->m_reviewing_set.insert( deck->get_card_id( s.m_hash ) ) )
+    {
+        m_reviewing_list.push_front( DeckCard( deck, s.m_hash ) );
+    }
+}
+
+
+bool ReviewManager::insert_group_card( const GroupCard& group, bool at_end )
+{
+    size_t position = m_session_index + ( m_review_number < group.eligible ? group.eligible - m_review_number : 0 );
+
+    if ( m_session.size() < position )
+    {
+        if ( ! at_end )
+        {
+            return false; // waits for the next batch
+        }
+
+        position = m_session.size();
+    }
+
+    size_t hash = group.deck->m_loader->get_card_ids().get_hash( group.id );
+    m_session.insert( m_session.begin() + position, SessionCard( DeckCard( group.deck, hash ), true ) );
+    return true;
+}
+
+
+void ReviewManager::grade( ReviewString& s, Scheduler::EQuality quality )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    Deck* deck = get_deck( s.m_history );
+
+    if ( deck != NULL )
+    {
+        save_history( deck, s.get_hash(), quality );
+    }
+}
+
+
+void ReviewManager::save_history( Deck* deck, size_t hash, Scheduler::EQuality quality )
+{
+    deck->m_history->save_history( hash, std::time(0), quality );
+
+    if ( deck->m_reviewing_set.empty() )
+    {
+        deck->m_history->checkpoint();
+    }
+
+    if ( m_options.get()->auto_update_interval )
+    {
+        m_condition.notify_one();
+    }
+}
+
+
+std::vector<ReviewManager::DeckCard> ReviewManager::search( const std::wstring& query, size_t limit )
+{
+    std::vector<DeckCard> cards;
+
+    for ( size_t i = 0; i < m_decks.size() && cards.size() < limit; ++i )
+    {
+        std::vector<size_t> hashes = m_decks[i]->m_loader->search( query, limit - cards.size() );
+
+        for ( size_t j = 0; j < hashes.size(); ++j )
+        {
+            cards.push_back( DeckCard( m_decks[i], hashes[j] ) );
+        }
+    }
+
+    return cards;
+}
+
+
+ReviewString ReviewManager::get_card( const DeckCard& card )
+{
+    OptionsPtr options = m_options.get();
+    return ReviewString( card.second, card.first->m_loader, card.first->m_history, options->speech, options->display_format );
+}
+
+
+ReviewString ReviewManager::get_previous( ReviewRing::Cursor& cursor )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    OptionsPtr options = m_options.get();
+
     if ( m_review_history.empty() )
     {
         return ReviewString();
     }
 
-    if ( m_review_mode == Forward )
+    if ( ! cursor.backward || m_review_history.size() <= cursor.index ) // the ring may have been reopened smaller
     {
-        m_review_mode = Backward;
+        cursor.backward = true;
 
         if ( m_review_history.size() == 1 )
         {
-            m_backward_index = 0;
+            cursor.index = 0;
         }
         else
         {
-            m_backward_index = m_review_history.size() - 1;
+            cursor.index = m_review_history.size() - 1;
+        }
+    }
+
+    if ( 0 < cursor.index )
+    {
+        cursor.index--;
+    }
+
+    const ReviewRing::Entry& entry = m_review_history[cursor.index];
+    Deck* deck = NULL;
+
+    for ( size_t i = 0; i < m_decks.size() && deck == NULL; ++i )
+    {
+        if ( m_decks[i]->m_name_hash == entry.deck )
+        {
+            deck = m_decks[i];
         }
     }
 
-    if ( 0 < m_backward_index )
+    if ( deck == NULL ) // of a deck not reviewed any more
     {
-        m_backward_index--;
+        return ReviewString();
     }
 
-    return ReviewString( m_review_history[m_backward_index], m_loader, m_history, m_speech, m_display_format );
+    return ReviewString( static_cast<size_t>( entry.hash ), deck->m_loader, deck->m_history, options->speech, options->display_format );
+}
+
+
+void ReviewManager::push_review_history( const DeckCard& card )
+{
+    ReviewRing::Entry entry;
+    entry.hash = card.second;
+    entry.deck = card.first->m_name_hash;
+    entry.time = static_cast<boost::uint32_t>( std::time(0) );
+    m_review_history.push_back( entry );
 }
 
 
@@ -351,17 +663,37 @@ std::wstring ReviewManager::wait_user_interaction()
 void ReviewManager::set_console_title()
 {
     std::wstringstream strm;
-    static const std::wstring file_name = boost::filesystem::path( m_file_name ).filename().wstring();
+    static const std::wstring file_name = boost::filesystem::path( m_options.get()->file_name ).filename().wstring();
+    size_t reviewing_size = get_reviewing_size();
     
-    strm << file_name << L" - ";
+    strm << file_name;
+
+    if ( 1 < m_decks.size() )
+    {
+        strm << L" +" << m_decks.size() - 1;
+    }
+
+    strm << L" - ";
     
-    if ( 0 == m_reviewing_set.size() && m_history->is_finished() )
+    if ( 0 == reviewing_size && is_finished() )
     {
         strm << L"Finish.";
     }
     else
     {
-        strm << m_reviewing_set.size();
+        strm << reviewing_size;
+    }
+
+    size_t tomorrow = 0;
+
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        tomorrow += m_decks[i]->m_history->get_forecast( 2 )[1];
+    }
+
+    if ( tomorrow )
+    {
+        strm << L", +" << tomorrow << L" tomorrow";
     }
 
     static std::wstring current_title;
@@ -379,45 +711,58 @@ void ReviewManager::update()
 {
     LOG_TRACE << "begin";
 
-    const std::set<size_t>& all = m_loader->get_string_hash_set();
+    bool changed = false;
 
-    if ( m_all.size() != all.size() ) // no need precise
+    for ( size_t i = 0; i < m_decks.size(); ++i )
     {
-        m_all = all;
-        m_history->synchronize_history( m_all );
+        changed = m_decks[i]->update() || changed;
     }
 
-    std::set<size_t> expired = m_history->get_expired();
-
-    if ( m_reviewing_set.size() != expired.size() )
+    if ( changed )
     {
-        if ( ! m_reviewing_set.empty() )
+        // interleave the decks, each keeps its own order
+        std::vector< std::pair<std::list<size_t>::iterator, Deck*> > heads;
+        std::map<Deck*, CardIdSet> frozen; // the rest of the session, end_session gives it back
+        m_reviewing_list.clear();
+
+        for ( size_t i = m_session_index; i < m_session.size(); ++i )
         {
-            LOG_DEBUG
-                << "old-size=" << m_reviewing_list.size()
-                << ", new-size=" << expired.size() << ""
-                << get_new_expired_string( m_reviewing_set, expired )
-                ;
+            if ( ! m_session[i].again )
+            {
+                frozen[m_session[i].card.first].insert( m_session[i].card.first->get_card_id( m_session[i].card.second ) );
+            }
         }
-        else
+
+        for ( size_t i = 0; i < m_decks.size(); ++i )
         {
-            LOG_DEBUG
-                << "old-size=" << m_reviewing_list.size()
-                << ", new-size=" << expired.size() << ""
-                ;
+            heads.push_back( std::make_pair( m_decks[i]->m_reviewing_list.begin(), m_decks[i] ) );
         }
 
-        m_reviewing_set = expired;
-        m_reviewing_list.assign( m_reviewing_set.begin(), m_reviewing_set.end() );
-
+        for ( bool more = true; more; )
         {
-            static Order order( m_loader, m_history );
-            m_reviewing_list.sort( order );
+            more = false;
+
+            for ( size_t i = 0; i < heads.size(); ++i )
+            {
+                Deck* deck = heads[i].second;
+                std::list<size_t>::iterator& it = heads[i].first;
+
+                while ( it != deck->m_reviewing_list.end()
+                        && ( ! deck->m_reviewing_set.contains( deck->get_card_id( *it ) ) || frozen[deck].contains( deck->get_card_id( *it ) ) ) ) // reviewed already, or in the session
+                {
+                    ++it;
+                }
+
+                if ( it != deck->m_reviewing_list.end() )
+                {
+                    m_reviewing_list.push_back( DeckCard( deck, *it++ ) );
+                    more = true;
+                }
+            }
         }
 
         set_console_title();
-        LOG_DEBUG << "sort " << m_reviewing_list.size();
-        // LOG_TEST<< std::endl << get_hash_list_string( m_reviewing_list );
+        LOG_DEBUG << "due " << m_reviewing_list.size() << " in " << m_decks.size() << " decks";
     }
 
     LOG_TRACE << "end";
@@ -428,10 +773,10 @@ void ReviewManager::update_thread()
 {
     while ( m_running )
     {
-        if ( 0 == m_auto_update_interval )
+        if ( 0 == m_options.get()->auto_update_interval )
         {
             boost::unique_lock<boost::mutex> lock( m_mutex );
-            while ( 0 == m_auto_update_interval )
+            while ( m_running && 0 == m_options.get()->auto_update_interval )
             {
                 m_condition.wait( lock );
             }
@@ -443,7 +788,7 @@ void ReviewManager::update_thread()
         }
 
         boost::unique_lock<boost::mutex> lock( m_mutex );
-        boost::chrono::seconds interval( m_auto_update_interval );
+        boost::chrono::seconds interval( m_options.get()->auto_update_interval );
         m_condition.wait_for( lock, interval );
 
         if ( !m_running )
@@ -462,223 +807,346 @@ void ReviewManager::update_thread()
 }
 
 
-std::wostream& ReviewManager::output_hash_list( std::wostream& os, const std::list<size_t>& l )
+void ReviewManager::build_listening_list()
 {
-    for ( std::list<size_t>::const_iterator it = l.begin(); it != l.end(); ++it )
+    OptionsPtr options = m_options.get();
+
+    if ( m_listening_list.empty() )
     {
-        size_t hash = *it;
-        std::time_t t = m_history->get_last_review_time( hash );
-        size_t r = m_history->get_review_round( hash );
-        const std::wstring& s = m_loader->get_string( hash );
+        boost::unique_lock<boost::mutex> lock( m_mutex );
 
-        os
-            << r << L"\t"
-            << Utility::string_from_time_t( t ) << L"\t"
-            << s.size() << L"\t"
-            << s << L"\n";
-            ;
-    }
+        update();
 
-    return os;
-}
+        if ( options->listen_all )
+        {
+            for ( size_t i = 0; i < m_decks.size(); ++i )
+            {
+                Deck* deck = m_decks[i];
 
+                std::vector<CardIdTable::card_id> ids = deck->m_all.get_ids();
 
-std::wstring ReviewManager::get_hash_list_string( const std::list<size_t>& l )
-{
-    std::wstringstream strm;
-    output_hash_list( strm, l );
-    return strm.str();
+                for ( size_t j = 0; j < ids.size(); ++j )
+                {
+                    size_t hash = deck->m_loader->get_card_ids().get_hash( ids[j] );
+
+                    if ( ! deck->m_history->is_not_reviewable( hash ) )
+                    {
+                        m_listening_list.push_back( DeckCard( deck, hash ) );
+                    }
+                }
+            }
+        }
+        else
+        {
+            m_listening_list = m_reviewing_list;
+        }
+    }
 }
 
 
-std::wstring ReviewManager::get_new_expired_string( const std::set<size_t>& os,  const std::set<size_t>& ns )
+void ReviewManager::listen_thread()
 {
-    std::set<size_t> added;
-    std::set_difference( ns.begin(), ns.end(), os.begin(), os.end(), std::inserter( added, added.begin() ) );
-
-    std::wstringstream strm;
-
-    for ( std::set<size_t>::iterator it = added.begin(); it != added.end(); ++it )
+    OptionsPtr options = m_options.get();
+    build_listening_list();
+
+    BoundedQueue<ListenItem> cards( options->listen_prefetch );
+    BoundedQueue<ListenItem> items( options->listen_prefetch );
+    BoundedQueue<ListenItem> screens( options->listen_prefetch ); // a slow console skips screens, the audio stage does not wait for it
+    boost::thread select_thread( boost::bind( &ReviewManager::listen_select_thread, this, &cards ) );
+    boost::thread resolve_thread( boost::bind( &ReviewManager::listen_resolve_thread, this, &cards, &items ) );
+    boost::thread console_thread( boost::bind( &ReviewManager::listen_console_thread, this, &screens ) );
+    ListenItem item;
+
+    while ( m_is_listening && items.pop( item ) ) // the audio stage, the next items are already resolved
     {
-        size_t hash = *it;
-        size_t round = m_history->get_review_round( hash );
-        std::time_t last_review = m_history->get_last_review_time( hash );
-        std::time_t elapsed = std::time(0) - last_review;
-        const std::wstring& s = m_loader->get_string( *it );
-        strm << std::endl << L"expired: " << round << L" (" << Utility::duration_string_from_seconds(elapsed) << L") " << s;
+        screens.try_push( item );
+        LOG_TRACE << item.text;
+        Utility::play_or_tts_list( item.word_paths );
+
+        if ( m_is_listening && options->listen_pause )
+        {
+            boost::this_thread::sleep_for( boost::chrono::milliseconds( options->listen_pause ) );
+        }
     }
 
-    return strm.str();
+    cards.close();
+    items.close();
+    screens.close();
+    select_thread.join();
+    resolve_thread.join();
+    console_thread.join();
+    set_console_title();
 }
 
 
-void ReviewManager::listen_thread()
+bool ReviewManager::export_listen( const std::wstring& file_name )
 {
-    if ( m_listening_list.empty() )
+    OptionsPtr options = m_options.get();
+
+    if ( NULL == options->speech )
     {
-        boost::unique_lock<boost::mutex> lock( m_mutex );
+        LOG << "speech is disabled, nothing to export";
+        return false;
+    }
 
-        update();
+    build_listening_list();
+    std::list<DeckCard> listening_list = m_listening_list;
+    std::vector<ListenExporter::Card> cards;
+    size_t listen_order_index = 0;
 
-        if ( m_listen_all )
+    while ( ! listening_list.empty() )
+    {
+        DeckCard card = get_next_card( listening_list, get_next_order( options->review_orders, listen_order_index ) );
+
+        if ( NULL == card.first )
         {
-            m_listening_list.assign( m_all.begin(), m_all.end() );
-            m_listening_list.erase( std::remove_if( m_listening_list.begin(),
-                                                    m_listening_list.end(),
-                                                    boost::bind( &History::is_not_reviewable, m_history, _1 ) ),
-                                    m_listening_list.end() );
+            break;
         }
-        else
+
+        ListenExporter::Card export_card;
+        export_card.hash = card.second;
+        export_card.words = card.first->m_loader->get_card_words( card.second );
+
+        if ( ! export_card.words.empty() )
         {
-            m_listening_list = m_reviewing_list;
+            cards.push_back( export_card );
         }
     }
 
-    std::vector<EReviewOrder> listen_orders = m_review_orders;
-    std::vector<EReviewOrder>::iterator listen_orders_it = listen_orders.begin();
+    ListenExporter exporter( options->speech, file_name, options->listen_pause );
+    return exporter.run( cards );
+}
+
+
+void ReviewManager::listen_select_thread( BoundedQueue<ListenItem>* cards )
+{
+    OptionsPtr options = m_options.get();
+    size_t listen_order_index = 0;
 
     while ( m_is_listening && ! m_listening_list.empty() )
     {
-        size_t hash = get_next_hash( m_listening_list, get_next_order( listen_orders, listen_orders_it ) );
-        const std::wstring& s = m_loader->get_string( hash );
-        std::vector<std::wstring> words = Utility::extract_strings_in_braces( s );
+        ListenItem item;
+        item.card = get_next_card( m_listening_list, get_next_order( options->review_orders, listen_order_index ) );
+        item.remaining = m_listening_list.size();
 
-        if ( words.empty() )
+        if ( NULL == item.card.first || ! cards->push( item ) )
         {
-            continue;
+            break;
         }
+    }
+
+    cards->close();
+}
+
 
-        if ( m_speech == NULL )
+void ReviewManager::listen_resolve_thread( BoundedQueue<ListenItem>* cards, BoundedQueue<ListenItem>* items )
+{
+    OptionsPtr options = m_options.get();
+    Utility::AudioOutputPtr output = Utility::get_audio_output();
+    ListenItem item;
+
+    while ( m_is_listening && options->speech && cards->pop( item ) )
+    {
+        const DeckCard& card = item.card;
+        std::vector<WordTable::word_id> word_ids = card.first->m_loader->get_card_words( card.second );
+
+        if ( word_ids.empty() )
         {
-            break;
+            continue;
         }
 
-        std::vector< std::pair<std::wstring, std::wstring> > word_paths = m_speech->get_word_speech_file_path( words );
+        item.word_paths = options->speech->get_word_speech_file_path( word_ids );
 
-        if ( word_paths.empty() )
+        if ( item.word_paths.empty() )
         {
             continue;
         }
 
-        Utility::cls();
+        for ( size_t i = 0; i < item.word_paths.size(); ++i )
+        {
+            if ( ! item.word_paths[i].second.empty() )
+            {
+                output->load_pcm( item.word_paths[i].second ); // decoded before its turn
+            }
+        }
+
+        item.text = card.first->m_loader->get_string( card.second );
+        item.words = WordTable::instance().get_words( word_ids );
+
+        if ( ! items->push( item ) )
+        {
+            break;
+        }
+    }
+
+    items->close();
+}
+
+
+void ReviewManager::listen_console_thread( BoundedQueue<ListenItem>* screens )
+{
+    OptionsPtr options = m_options.get();
+    Utility::ConsoleFrame& frame = Utility::console_frame();
+    ListenItem item;
+
+    while ( screens->pop( item ) )
+    {
         std::wstringstream strm;
-        strm << L"TITLE listen - " << m_listening_list.size();
+        strm << L"TITLE listen - " << item.remaining;
         SetConsoleTitle( strm.str().c_str() );
-        //system( ( "TITLE listen - " + boost::lexical_cast<std::wstring>( m_listening_list.size() ) ).c_str() );
+        frame.clear();
 
-        if ( ! m_listen_no_string )
+        if ( ! options->listen_no_string )
         {
-            std::wstring ts = s;
+            std::wstring ts = item.text;
             ts.erase( std::remove_if( ts.begin(), ts.end(), boost::is_any_of( "{}" ) ), ts.end() );
-            std::wcout << L"\t";
-            Utility::write_console( ts );
-            std::wcout << std::endl;
+            frame.write( L"\t" + ts + L"\n" );
         }
 
-        std::wcout << L"\t";
-        //std::copy( words.begin(), words.end(), std::ostream_iterator<std::wstring>( std::wcout, L"\n\t" ) );
-        for ( size_t i = 0; i < words.size(); ++i )
+        frame.write( L"\t" );
+
+        for ( size_t i = 0; i < item.words.size(); ++i )
         {
-            Utility::write_console( words[i] );
-            std::wcout << L"\n\t";
+            frame.write( item.words[i] + L"\n\t" );
         }
 
-        LOG_TRACE << s;
-        Utility::play_or_tts_list( word_paths );
+        frame.present();
     }
-
-    set_console_title();
 }
 
 
 void ReviewManager::update_option( const boost::program_options::variables_map& vm )
 {
     static OptionUpdateHelper option_helper;
+    Options options = m_options.copy();
+    bool changed = false;
 
     if ( option_helper.update_one_option<boost::timer::nanosecond_type>( review_minimal_time_option, vm, 500 ) )
     {
-        m_minimal_review_time = option_helper.get_value<boost::timer::nanosecond_type>( review_minimal_time_option ) * 1000 * 1000;
-        LOG_DEBUG << "review-minimal-review-time: " << m_minimal_review_time;
+        options.minimal_review_time = option_helper.get_value<boost::timer::nanosecond_type>( review_minimal_time_option ) * 1000 * 1000;
+        LOG_DEBUG << "review-minimal-review-time: " << options.minimal_review_time;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<size_t>( review_auto_update_interval_option, vm, 60 ) )
     {
-        volatile size_t old_value = m_auto_update_interval;
-        m_auto_update_interval = option_helper.get_value<size_t>( review_auto_update_interval_option );
-        LOG_DEBUG << "review-auto-update-interval: " << m_auto_update_interval;
-
-        if ( 0 == old_value )
-        {
-            m_condition.notify_one();
-        }
+        options.auto_update_interval = option_helper.get_value<size_t>( review_auto_update_interval_option );
+        LOG_DEBUG << "review-auto-update-interval: " << options.auto_update_interval;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<size_t>( speech_play_back, vm, 0 ) )
     {
-        m_play_back = option_helper.get_value<size_t>( speech_play_back );
-        LOG_DEBUG << "speech-play-back: " << m_play_back;
-
-        if ( 0 == m_play_back && ! m_play_back_string.empty() )
-        {
-            m_play_back_string.clear();
-        }
+        options.play_back = option_helper.get_value<size_t>( speech_play_back );
+        LOG_DEBUG << "speech-play-back: " << options.play_back;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( review_order_option, vm, L"latest" ) )
     {
-        boost::unique_lock<boost::mutex> lock( m_mutex );
         std::wstring order_option_str = option_helper.get_value<std::wstring>( review_order_option );
-        m_review_orders = convert_from_string( order_option_str );
-        m_review_order_it = m_review_orders.begin();
+        options.review_orders = convert_from_string( order_option_str );
         LOG_DEBUG << "review-order: " << order_option_str;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( speech_disabled_option, vm, L"false" ) )
     {
         bool speech_disabled = ( L"true" == option_helper.get_value<std::wstring>( speech_disabled_option ) );
-
-        if ( speech_disabled )
-        {
-            m_speech = NULL;
-            if ( m_current_reviewing != NULL ) { m_current_reviewing->m_speech = NULL; }
-            LOG_DEBUG << "speech-disabled: true";
-        }
-        else
-        {
-            m_speech = m_speech_impl;
-            if ( m_current_reviewing != NULL ) { m_current_reviewing->m_speech = m_speech; }
-            LOG_DEBUG << "speech-disabled: false";
-        }
+        options.speech = ( speech_disabled ? NULL : m_speech_impl );
+        if ( m_current_reviewing != NULL ) { m_current_reviewing->m_speech = options.speech; }
+        LOG_DEBUG << "speech-disabled: " << ( speech_disabled ? "true" : "false" );
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( listen_no_string_option, vm, L"false" ) )
     {
-        m_listen_no_string = ( L"true" == option_helper.get_value<std::wstring>( listen_no_string_option ) );
-        LOG_DEBUG << "listen-no-string: " << ( m_listen_no_string ? "true" : "false" );
+        options.listen_no_string = ( L"true" == option_helper.get_value<std::wstring>( listen_no_string_option ) );
+        LOG_DEBUG << "listen-no-string: " << ( options.listen_no_string ? "true" : "false" );
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( listen_all_option, vm, L"false" ) )
     {
-        m_listen_all = ( L"true" == option_helper.get_value<std::wstring>( listen_all_option ) );
-        LOG_DEBUG << "listen-all: " << ( m_listen_all ? "true" : "false" );
+        options.listen_all = ( L"true" == option_helper.get_value<std::wstring>( listen_all_option ) );
+        LOG_DEBUG << "listen-all: " << ( options.listen_all ? "true" : "false" );
+        changed = true;
+    }
+
+    if ( option_helper.update_one_option<size_t>( listen_prefetch_option, vm, 4 ) )
+    {
+        options.listen_prefetch = option_helper.get_value<size_t>( listen_prefetch_option );
+        LOG_DEBUG << "listen-prefetch: " << options.listen_prefetch;
+        changed = true;
+    }
+
+    if ( option_helper.update_one_option<size_t>( listen_pause_option, vm, 0 ) )
+    {
+        options.listen_pause = option_helper.get_value<size_t>( listen_pause_option );
+        LOG_DEBUG << "listen-pause: " << options.listen_pause;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( file_name_option, vm ) )
     {
-        m_file_name = option_helper.get_value<std::wstring>( file_name_option );
-        LOG_DEBUG << "file-name: " << m_file_name;
+        options.file_name = option_helper.get_value<std::wstring>( file_name_option );
+        LOG_DEBUG << "file-name: " << options.file_name;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( review_display_format_option, vm, L"Q,AE" ) )
     {
-        m_display_format = option_helper.get_value<std::wstring>( review_display_format_option );
-        LOG_DEBUG << "review-display-format: " << m_display_format;
+        options.display_format.reset( new std::wstring( option_helper.get_value<std::wstring>( review_display_format_option ) ) );
+        LOG_DEBUG << "review-display-format: " << *options.display_format;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<size_t>( review_minimal_review_distance_option, vm, 10 ) )
     {
-        m_minimal_review_distance = option_helper.get_value<size_t>( review_minimal_review_distance_option );
-        LOG_DEBUG << "review-minimal-review-distance: " << m_minimal_review_distance;
+        options.minimal_review_distance = option_helper.get_value<size_t>( review_minimal_review_distance_option );
+        LOG_DEBUG << "review-minimal-review-distance: " << options.minimal_review_distance;
+        changed = true;
+    }
+
+    if ( option_helper.update_one_option<size_t>( review_session_size_option, vm, 0 ) )
+    {
+        options.session_size = option_helper.get_value<size_t>( review_session_size_option );
+        LOG_DEBUG << "review-session-size: " << options.session_size;
+        changed = true;
+    }
+
+    std::wstring default_back_name = ( vm.count( file_name_option ) ? boost::filesystem::change_extension( vm[file_name_option].as<std::wstring>(), L".back" ).wstring() : L"" );
+
+    bool back_changed = false;
+
+    if ( option_helper.update_one_option<std::wstring>( file_back_option, vm, default_back_name ) )
+    {
+        options.back_name = option_helper.get_value<std::wstring>( file_back_option );
+        LOG_DEBUG << "file-back-name: " << options.back_name;
+        changed = true;
+        back_changed = true;
+    }
+
+    if ( option_helper.update_one_option<size_t>( review_back_size_option, vm, 1000 ) )
+    {
+        options.back_size = option_helper.get_value<size_t>( review_back_size_option );
+        LOG_DEBUG << "review-back-size: " << options.back_size;
+        changed = true;
+        back_changed = true;
+    }
+
+    if ( back_changed ) // the cards in the ring move over to the new file or capacity
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+        m_review_history.open( options.back_name, options.back_size );
+        m_back_cursor = ReviewRing::Cursor();
+    }
+
+    if ( option_helper.update_one_option<size_t>( review_forecast_days_option, vm, 14 ) )
+    {
+        options.forecast_days = option_helper.get_value<size_t>( review_forecast_days_option );
+        LOG_DEBUG << "review-forecast-days: " << options.forecast_days;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( system_picture_path, vm ) )
@@ -695,73 +1163,130 @@ void ReviewManager::update_option( const boost::program_options::variables_map&
             m_picture_dir_it = boost::filesystem::recursive_directory_iterator();
         }
     }
+
+    if ( changed )
+    {
+        size_t old_interval = m_options.get()->auto_update_interval;
+        m_options.publish( options );
+
+        if ( 0 == old_interval && 0 != options.auto_update_interval )
+        {
+            m_condition.notify_one();
+        }
+    }
 }
 
 
-size_t ReviewManager::get_next_hash( std::list<size_t>& hash_list, EReviewOrder order )
+ReviewManager::DeckCard ReviewManager::get_next_card( std::list<DeckCard>& card_list, EReviewOrder order )
 {
-    if ( hash_list.empty() )
+    if ( card_list.empty() )
     {
-        return 0;
+        return DeckCard( NULL, 0 );
     }
 
-    size_t hash = 0;
+    DeckCard card( NULL, 0 );
 
     if ( order == Latest )
     {
-        hash = hash_list.front();
-        hash_list.pop_front();
+        card = card_list.front();
+        card_list.pop_front();
     }
     else if ( order == Earliest )
     {
-        hash = hash_list.back();
-        hash_list.pop_back();
+        card = card_list.back();
+        card_list.pop_back();
     }
     else if ( order == Random )
     {
-        if ( hash_list.size() < 3 )
+        if ( card_list.size() < 3 )
         {
-            hash = hash_list.back();
-            hash_list.pop_back();
+            card = card_list.back();
+            card_list.pop_back();
         }
         else
         {
-            std::list<size_t>::iterator it = hash_list.begin();
-            std::advance( it, Utility::random_number( 1, hash_list.size() - 2 ) );
-            hash = *it;
-            hash_list.erase( it );
+            std::list<DeckCard>::iterator it = card_list.begin();
+            std::advance( it, Utility::random_number( 1, card_list.size() - 2 ) );
+            card = *it;
+            card_list.erase( it );
         }
     }
     else if ( order == Middle )
     {
-        std::list<size_t>::iterator it = hash_list.begin();
-        std::advance( it, hash_list.size() / 2 );
-        hash = *it;
-        hash_list.erase( it );
+        std::list<DeckCard>::iterator it = card_list.begin();
+        std::advance( it, card_list.size() / 2 );
+        card = *it;
+        card_list.erase( it );
     }
     else
     {
         LOG << "error: the review order is unknown: " << order;
     }
 
-    return hash;
+    return card;
+}
+
+
+Deck* ReviewManager::get_deck( History* history )
+{
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        if ( m_decks[i]->m_history == history )
+        {
+            return m_decks[i];
+        }
+    }
+
+    if ( history != NULL )
+    {
+        LOG << "error: the card is not of any deck";
+    }
+
+    return NULL;
+}
+
+
+size_t ReviewManager::get_reviewing_size()
+{
+    size_t size = 0;
+
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        size += m_decks[i]->m_reviewing_set.size();
+    }
+
+    return size;
 }
 
 
-ReviewManager::EReviewOrder ReviewManager::get_next_order( std::vector<EReviewOrder>& orders, std::vector<EReviewOrder>::iterator& it )
+bool ReviewManager::is_finished()
 {
-    if ( it == orders.end() )
+    for ( size_t i = 0; i < m_decks.size(); ++i )
     {
-        it = orders.begin();
+        if ( ! m_decks[i]->m_history->is_finished() )
+        {
+            return false;
+        }
     }
 
-    if ( it == orders.end() )
+    return true;
+}
+
+
+ReviewManager::EReviewOrder ReviewManager::get_next_order( const std::vector<EReviewOrder>& orders, size_t& index )
+{
+    if ( orders.size() <= index )
+    {
+        index = 0;
+    }
+
+    if ( orders.empty() )
     {
         return Invalid;
     }
 
-    EReviewOrder order = *it;
-    it++;
+    EReviewOrder order = orders[index];
+    index++;
 
     static const char* order_str[] = { "Latest", "Earliest", "Random", "Middle", "Invalid" };
     LOG_TRACE << "review order: " << order_str[order];
@@ -794,41 +1319,39 @@ std::vector<ReviewManager::EReviewOrder> ReviewManager::convert_from_string( con
 
 void ReviewManager::upgrade_hash_algorithm()
 {
-    //std::cout << "upgrading hash algorithm for " << m_loader->m_file_name << " ..." << std::flush;
-
-    m_history->initialize();
-
-    history_type& old_history = m_history->m_history;
-    boost::function<size_t (const std::wstring&)> new_hash_fun = &Loader::string_hash_new;
-    const std::set<size_t>& hash_set = m_loader->get_string_hash_set();
-    history_type new_history;
-
-    for ( std::set<size_t>::const_iterator it = hash_set.begin(); it != hash_set.end(); ++it )
+    for ( size_t i = 0; i < m_decks.size(); ++i )
     {
-        size_t hash = *it;
-        const std::wstring& s = m_loader->get_string_no_lock( hash );
+        m_decks[i]->upgrade_hash_algorithm();
+    }
+}
 
-        history_type::iterator find_it = old_history.find( hash );
 
-        if ( find_it == old_history.end() )
+void ReviewManager::evaluate_schedulers()
+{
+    for ( size_t i = 0; i < m_decks.size(); ++i )
+    {
+        if ( 1 < m_decks.size() )
         {
-            std::cout << "\naborted: not match (updated already?)" << std::endl;
-            return;
+            Utility::write_console( m_decks[i]->m_file_name );
+            std::cout << std::endl;
         }
 
-        size_t new_hash = new_hash_fun( s );
-        new_history[new_hash] = find_it->second;
+        m_decks[i]->evaluate_schedulers();
     }
+}
+
+
+void ReviewManager::dump_stats()
+{
+    OptionsPtr options = m_options.get();
 
-    if ( old_history == new_history )
+    for ( size_t i = 0; i < m_decks.size(); ++i )
     {
-        std::cout << "\nthe algorithm is same, do nothing." << std::endl;
-        return;
+        Utility::write_console( m_decks[i]->m_file_name );
+        std::cout << std::endl;
+        Utility::write_console( m_decks[i]->m_history->get_stats_string( options->forecast_days ) );
+        std::cout << std::endl;
     }
-
-    m_history->m_history = new_history;
-    m_history->write_history();
-    std::cout << "\ndone." << std::endl;
 }
 
 
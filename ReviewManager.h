@@ -1,6 +1,11 @@
 #pragma once
 #include "ReviewString.h"
-class Loader;
+#include "OptionSnapshot.h"
+#include "Scheduler.h"
+#include "CardIdTable.h"
+#include "ReviewRing.h"
+#include "BoundedQueue.h"
+class Deck;
 class History;
 class Speech;
 
@@ -9,20 +14,105 @@ class ReviewManager
 {
 public:
 
-    enum EReviewDirection{ Forward, Backward };
     enum EReviewOrder{ Latest, Earliest, Random, Middle, Invalid };
+    typedef std::pair<Deck*, size_t> DeckCard; // a card is a hash within its deck
+
+    struct SessionCard
+    {
+        SessionCard( const DeckCard& card = DeckCard( NULL, 0 ), bool again = false ) : card( card ), again( again ) {}
+        DeckCard card;
+        bool again; // a group card shown again, saved already
+    };
+
+    struct ListenItem
+    {
+        ListenItem() : card( NULL, 0 ), remaining( 0 ) {}
+        DeckCard card;
+        size_t remaining;   // cards left when it was selected
+        std::wstring text;
+        std::vector<std::wstring> words;
+        std::vector< std::pair<std::wstring, std::wstring> > word_paths;
+    };
+
+    struct GroupCard
+    {
+        GroupCard( size_t eligible = 0, Deck* deck = NULL, CardIdTable::card_id id = CardIdTable::invalid_id ) : eligible( eligible ), deck( deck ), id( id ) {}
+        size_t eligible; // the review number from which it can be shown again
+        Deck* deck;
+        CardIdTable::card_id id;
+    };
+
+    struct Options
+    {
+        Options()
+            : minimal_review_time( 500 * 1000 * 1000 ),
+              auto_update_interval( 60 ),
+              play_back( 0 ),
+              minimal_review_distance( 10 ),
+              session_size( 0 ),
+              back_size( 1000 ),
+              forecast_days( 14 ),
+              listen_no_string( false ),
+              listen_all( false ),
+              listen_prefetch( 4 ),
+              listen_pause( 0 ),
+              speech( NULL ),
+              version( 0 )
+        {
+        }
+
+        std::wstring file_name;
+        DisplayFormatPtr display_format;
+        std::vector<EReviewOrder> review_orders;
+        boost::timer::nanosecond_type minimal_review_time;
+        size_t auto_update_interval;
+        size_t play_back;
+        size_t minimal_review_distance;
+        size_t session_size;
+        std::wstring back_name;
+        size_t back_size;
+        size_t forecast_days;
+        bool listen_no_string;
+        bool listen_all;
+        size_t listen_prefetch;     // items resolved ahead of the one playing
+        size_t listen_pause;        // in milliseconds, between items
+        Speech* speech;
+        size_t version;
+    };
+
+    typedef OptionSnapshot<Options>::pointer OptionsPtr;
 
 public:
 
     ReviewManager();
     ~ReviewManager();
+    void initialize();
     void review();
+    void build_listening_list();
     void listen_thread();
+    bool export_listen( const std::wstring& file_name ); // listen mode rendered into a .wav
+    void listen_select_thread( BoundedQueue<ListenItem>* cards );
+    void listen_resolve_thread( BoundedQueue<ListenItem>* cards, BoundedQueue<ListenItem>* items );
+    void listen_console_thread( BoundedQueue<ListenItem>* screens );
 
 public:
 
     ReviewString get_next();
-    ReviewString get_previous();
+    ReviewString take_next( bool save_review, bool* again = NULL ); // not saved: grade it later, unless it is a group card shown again
+    ReviewString take_session_next( bool save_review, const Options& options, bool* again );
+    void build_session( const Options& options );
+    void end_session();
+    void add_to_group( const ReviewString& s );
+    void log_review( ReviewString& s ); // the text and round of a shown card
+    void put_back( const ReviewString& s, bool again ); // a card taken but not graded: back to the front of the due cards, or of the group
+    bool insert_group_card( const GroupCard& group, bool at_end ); // should lock outside
+    void grade( ReviewString& s, Scheduler::EQuality quality );
+    void save_history( Deck* deck, size_t hash, Scheduler::EQuality quality ); // should lock outside
+    void push_review_history( const DeckCard& card ); // should lock outside
+    ReviewString get_previous() { return get_previous( m_back_cursor ); }
+    ReviewString get_previous( ReviewRing::Cursor& cursor ); // each reader its own cursor
+    std::vector<DeckCard> search( const std::wstring& query, size_t limit ); // see Loader::search, deck by deck
+    ReviewString get_card( const DeckCard& card );
     static std::wstring wait_user_interaction();
     void set_console_title();
     void update();
@@ -31,56 +121,42 @@ public:
 
 public:
 
-    std::wostream& output_hash_list( std::wostream& os, const std::list<size_t>& l );
-    std::wstring get_hash_list_string( const std::list<size_t>& l );
+    Deck* get_deck( History* history ); // NULL for a card of no deck
+    size_t get_reviewing_size();
+    bool is_finished();
 
 public:
 
-    std::wstring get_new_expired_string( const std::set<size_t>& os,  const std::set<size_t>& ns );
-
-public:
-
-    size_t get_next_hash( std::list<size_t>& hash_list, EReviewOrder order );
-    EReviewOrder get_next_order( std::vector<EReviewOrder>& orders, std::vector<EReviewOrder>::iterator& it );
+    DeckCard get_next_card( std::list<DeckCard>& card_list, EReviewOrder order );
+    EReviewOrder get_next_order( const std::vector<EReviewOrder>& orders, size_t& index );
     std::vector<EReviewOrder> convert_from_string( const std::wstring& order_string );
 
 public:
 
     void upgrade_hash_algorithm();
+    void evaluate_schedulers();
+    void dump_stats();
     void show_next_picture( const std::wstring& path = L"" );
 
 public:
 
-    size_t m_play_back;
+    OptionSnapshot<Options> m_options;
     std::list<ReviewString> m_play_back_string;
-    std::list<ReviewString> m_review_group;
-    size_t m_minimal_review_distance;
+    std::multimap<size_t, GroupCard> m_review_group; // by eligible review number
     volatile bool m_is_listening;
     boost::condition_variable m_condition;
     boost::mutex m_mutex;
-    std::wstring m_file_name;
-    std::wstring m_history_name;
-    std::wstring m_display_format;
-    Loader* m_loader;
-    History* m_history;
-    Speech* m_speech;
+    std::vector<Deck*> m_decks;
     Speech* m_speech_impl;
-    std::set<size_t> m_all;
-    std::set<size_t> m_reviewing_set;
-    std::list<size_t> m_reviewing_list;
-    std::list<size_t> m_listening_list;
-    EReviewDirection m_review_mode;
-    size_t m_backward_index;
-    std::vector<size_t> m_review_history;
-    boost::timer::nanosecond_type m_minimal_review_time;
-    volatile size_t m_auto_update_interval;
+    std::list<DeckCard> m_reviewing_list;   // the global due queue, the decks interleaved
+    std::list<DeckCard> m_listening_list;
+    ReviewRing::Cursor m_back_cursor;       // of the console, API sessions keep their own
+    ReviewRing m_review_history;            // hashes, not card ids: the ring is mapped onto .back and ids are assigned per run
+    std::vector<SessionCard> m_session;     // the frozen due list of session mode
+    size_t m_session_index;
     volatile ReviewString* m_current_reviewing;
-    std::vector<EReviewOrder> m_review_orders;
-    std::vector<EReviewOrder>::iterator m_review_order_it;
-    volatile bool m_listen_no_string;
-    volatile bool m_listen_all;
+    size_t m_review_order_index;
     size_t m_review_number;
-    std::map<size_t, size_t> m_hash_number_map;
     boost::signals2::connection m_connection;
     boost::thread m_update_thread;
     bool m_running;
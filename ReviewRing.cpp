@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include "ReviewRing.h"
+#include "Log.h"
+
+static const char ring_magic[8] = { 'R', 'E', 'V', 'R', 'I', 'N', 'G', '2' }; // 1 kept deck indexes
+
+
+ReviewRing::ReviewRing()
+    : m_header( NULL ),
+      m_entries( NULL )
+{
+    reset( 1000 );
+}
+
+
+ReviewRing::~ReviewRing()
+{
+    m_mapping.flush();
+}
+
+
+// the entries move over once: map_file keeps those of the file it reopens, the others are pushed here
+void ReviewRing::open( const std::wstring& file_name, size_t capacity )
+{
+    std::vector<Entry> entries;
+
+    for ( size_t i = 0; i < size(); ++i )
+    {
+        entries.push_back( (*this)[i] );
+    }
+
+    capacity = std::max<size_t>( capacity, 1 );
+    bool same_file = ( ! file_name.empty() && file_name == m_file_name );
+    bool mapped = ( ! file_name.empty() && map_file( file_name, capacity ) );
+
+    if ( ! mapped )
+    {
+        reset( capacity );
+    }
+
+    if ( ! ( mapped && same_file ) )
+    {
+        for ( size_t i = 0; i < entries.size(); ++i )
+        {
+            push_back( entries[i] );
+        }
+    }
+
+    m_file_name = ( mapped ? file_name : std::wstring() );
+
+    LOG_DEBUG << "review ring: " << file_name << ", capacity = " << m_header->capacity << ", size = " << m_header->size;
+}
+
+
+void ReviewRing::push_back( const Entry& entry )
+{
+    m_entries[m_header->next % m_header->capacity] = entry;
+    m_header->next++;
+
+    if ( m_header->size < m_header->capacity )
+    {
+        m_header->size++;
+    }
+}
+
+
+void ReviewRing::reset( size_t capacity )
+{
+    m_mapping.close();
+
+    m_memory.assign( sizeof(Header) + capacity * sizeof(Entry), 0 );
+    m_header = reinterpret_cast<Header*>( &m_memory[0] );
+    m_entries = reinterpret_cast<Entry*>( m_header + 1 );
+    std::copy( ring_magic, ring_magic + sizeof(ring_magic), m_header->magic );
+    m_header->capacity = static_cast<boost::uint32_t>( capacity );
+}
+
+
+// m_header is not used until the file is mapped again, it may point into the mapping closed here
+bool ReviewRing::map_file( const std::wstring& file_name, size_t capacity )
+{
+    m_mapping.flush();
+    m_mapping.close(); // a mapped file can't be truncated or resized
+
+    try
+    {
+        size_t file_capacity = 0;
+        std::vector<Entry> entries = read_file( file_name, file_capacity );
+
+        if ( file_capacity != capacity ) // missing, broken or resized
+        {
+            Header header = Header();
+            std::copy( ring_magic, ring_magic + sizeof(ring_magic), header.magic );
+            header.capacity = static_cast<boost::uint32_t>( capacity );
+
+            std::ofstream os( file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+            os.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+            os.close();
+            boost::filesystem::resize_file( file_name, sizeof(Header) + capacity * sizeof(Entry) );
+        }
+
+        if ( ! m_mapping.open( file_name, true ) || m_mapping.m_size != sizeof(Header) + capacity * sizeof(Entry) )
+        {
+            LOG << "cannot map " << file_name;
+            m_mapping.close();
+            return false;
+        }
+
+        m_memory.clear();
+        m_header = reinterpret_cast<Header*>( m_mapping.m_data );
+        m_entries = reinterpret_cast<Entry*>( m_header + 1 );
+
+        if ( file_capacity != capacity )
+        {
+            size_t first = ( capacity < entries.size() ? entries.size() - capacity : 0 );
+
+            for ( size_t i = first; i < entries.size(); ++i )
+            {
+                push_back( entries[i] );
+            }
+        }
+
+        return true;
+    }
+    catch ( std::exception& e )
+    {
+        LOG << "cannot map " << file_name << ": " << e.what();
+    }
+
+    return false;
+}
+
+
+std::vector<ReviewRing::Entry> ReviewRing::read_file( const std::wstring& file_name, size_t& capacity )
+{
+    std::vector<Entry> entries;
+    capacity = 0;
+
+    if ( ! boost::filesystem::exists( file_name ) )
+    {
+        return entries;
+    }
+
+    std::ifstream is( file_name.c_str(), std::ios::in | std::ios::binary );
+    Header header = Header();
+    is.read( reinterpret_cast<char*>( &header ), sizeof(header) );
+
+    if ( ! is
+         || ! std::equal( ring_magic, ring_magic + sizeof(ring_magic), header.magic )
+         || 0 == header.capacity
+         || header.capacity < header.size
+         || boost::filesystem::file_size( file_name ) != sizeof(Header) + header.capacity * sizeof(Entry) )
+    {
+        LOG << "invalid review ring: " << file_name;
+        return entries;
+    }
+
+    std::vector<Entry> slots( header.capacity );
+    is.read( reinterpret_cast<char*>( &slots[0] ), slots.size() * sizeof(Entry) );
+
+    for ( size_t i = 0; i < header.size; ++i )
+    {
+        entries.push_back( slots[( header.next - header.size + i ) % header.capacity] );
+    }
+
+    capacity = header.capacity;
+    return entries;
+}
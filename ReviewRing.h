@@ -0,0 +1,56 @@
+#pragma once
+#include "FileUtility.h"
+
+
+// the last cards reviewed, oldest first, for going back; a fixed capacity ring that can be
+// mapped onto a file, so it survives restarts and remembers when each card was saved
+class ReviewRing
+{
+public:
+
+    struct Header
+    {
+        char magic[8];
+        boost::uint32_t capacity;
+        boost::uint32_t size;
+        boost::uint64_t next;       // entries ever pushed, next % capacity is the slot to write
+    };
+
+    struct Cursor           // a reader going back through the ring, from the newest entry
+    {
+        Cursor() : backward( false ), index( 0 ) {}
+        bool backward;
+        size_t index;           // of the entry shown last, while backward
+    };
+
+    struct Entry
+    {
+        boost::uint64_t hash;
+        boost::uint32_t deck;       // Deck::m_name_hash, the deck list may change between runs
+        boost::uint32_t time;       // review time
+    };
+
+public:
+
+    ReviewRing();
+    ~ReviewRing();
+    void open( const std::wstring& file_name, size_t capacity ); // an empty file name keeps it in memory
+    void push_back( const Entry& entry );
+    const Entry& operator[]( size_t i ) const { return m_entries[( m_header->next - m_header->size + i ) % m_header->capacity]; }
+    size_t size() const { return m_header->size; }
+    bool empty() const { return 0 == m_header->size; }
+
+public:
+
+    void reset( size_t capacity );
+    bool map_file( const std::wstring& file_name, size_t capacity );
+    static std::vector<Entry> read_file( const std::wstring& file_name, size_t& capacity );
+
+public:
+
+    Header* m_header;
+    Entry* m_entries;
+    std::vector<char> m_memory;
+    Utility::FileMapping m_mapping;
+    std::wstring m_file_name;   // of the mapping, empty for a ring in memory
+};
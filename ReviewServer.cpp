@@ -0,0 +1,704 @@
+#include "stdafx.h"
+#include "ReviewServer.h"
+#include "ReviewManager.h"
+#include "Deck.h"
+#include "Loader.h"
+#include "History.h"
+#include "Utility.h"
+#include "Log.h"
+
+static const size_t max_request_size = 8192;       // the request line and headers, larger ones are answered 431
+static const size_t max_sessions = 64;              // the oldest pending card goes back to the due cards beyond it
+static const std::time_t session_timeout = 30 * 60; // a card pending longer goes back to the due cards
+
+
+class HttpSession : public boost::enable_shared_from_this<HttpSession>
+{
+public:
+
+    HttpSession( boost::asio::io_service& io_service, ReviewServer* server )
+        : m_socket( io_service ),
+          m_server( server ),
+          m_buffer( max_request_size ),
+          m_keep_alive( false )
+    {
+    }
+
+    void start()
+    {
+        boost::asio::async_read_until( m_socket, m_buffer, "\r\n\r\n",
+            boost::bind( &HttpSession::handle_read, shared_from_this(), boost::asio::placeholders::error ) );
+    }
+
+    void handle_read( const boost::system::error_code& error )
+    {
+        if ( error == boost::asio::error::not_found ) // m_buffer is full, no end of the headers in it
+        {
+            m_keep_alive = false;
+            write_response( 431, ReviewServer::json_error( "request header fields too large" ) );
+            return;
+        }
+
+        if ( error )
+        {
+            return;
+        }
+
+        std::istream is( &m_buffer );
+        std::string method, target, version, line;
+        is >> method >> target >> version;
+        std::getline( is, line );
+        m_keep_alive = ( version == "HTTP/1.1" );
+
+        while ( std::getline( is, line ) && line != "\r" ) // the rest stays in m_buffer for the next request
+        {
+            boost::to_lower( line );
+
+            if ( boost::starts_with( line, "connection:" ) )
+            {
+                m_keep_alive = ( line.find( "close" ) == std::string::npos );
+            }
+        }
+
+        int status = 200;
+        std::string body;
+
+        if ( method != "GET" )
+        {
+            status = 405;
+            body = ReviewServer::json_error( "only GET is supported" );
+        }
+        else
+        {
+            body = m_server->handle_request( target, status );
+        }
+
+        write_response( status, body );
+    }
+
+    void write_response( int status, const std::string& body )
+    {
+        std::stringstream strm;
+        strm
+            << "HTTP/1.1 " << status << ( 200 == status ? " OK" : " Error" ) << "\r\n"
+            << "Content-Type: application/json; charset=utf-8\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: " << ( m_keep_alive ? "keep-alive" : "close" ) << "\r\n"
+            << "\r\n"
+            << body;
+        m_response = strm.str();
+
+        boost::asio::async_write( m_socket, boost::asio::buffer( m_response ),
+            boost::bind( &HttpSession::handle_write, shared_from_this(), boost::asio::placeholders::error ) );
+    }
+
+    void handle_write( const boost::system::error_code& error )
+    {
+        if ( ! error && m_keep_alive )
+        {
+            start();
+            return;
+        }
+
+        boost::system::error_code ignored;
+        m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ignored );
+    }
+
+public:
+
+    boost::asio::ip::tcp::socket m_socket;
+    ReviewServer* m_server;
+    boost::asio::streambuf m_buffer;
+    std::string m_response;
+    bool m_keep_alive;
+};
+
+typedef boost::shared_ptr<HttpSession> HttpSessionPtr;
+
+
+ReviewServer::ReviewServer( ReviewManager* review_manager, unsigned short port )
+    : m_review_manager( review_manager ),
+      m_acceptor( m_io_service, boost::asio::ip::tcp::endpoint( boost::asio::ip::address_v4::loopback(), port ) )
+{
+    LOG << "review server on 127.0.0.1:" << port;
+    start_accept();
+    m_thread = boost::thread( boost::bind( &ReviewServer::run, this ) );
+}
+
+
+ReviewServer::~ReviewServer()
+{
+    m_io_service.stop();
+    m_thread.join();
+}
+
+
+void ReviewServer::run()
+{
+    try
+    {
+        m_io_service.run();
+    }
+    catch ( std::exception& e )
+    {
+        LOG << "review server: " << e.what();
+    }
+}
+
+
+static void handle_accept( ReviewServer* server, HttpSessionPtr session, const boost::system::error_code& error )
+{
+    if ( ! error )
+    {
+        session->start();
+    }
+
+    server->start_accept();
+}
+
+
+void ReviewServer::start_accept()
+{
+    HttpSessionPtr session( new HttpSession( m_io_service, this ) );
+    m_acceptor.async_accept( session->m_socket, boost::bind( &handle_accept, this, session, boost::asio::placeholders::error ) );
+}
+
+
+std::string ReviewServer::handle_request( const std::string& target, int& status )
+{
+    LOG_DEBUG << target;
+    expire_sessions();
+
+    size_t pos = target.find( '?' );
+    std::string path = target.substr( 0, pos );
+    query_type query = parse_query( pos == std::string::npos ? "" : target.substr( pos + 1 ) );
+
+    if ( path == "/next" )
+    {
+        return next( query );
+    }
+
+    if ( path == "/grade" )
+    {
+        return grade( query, status );
+    }
+
+    if ( path == "/previous" )
+    {
+        return previous( query );
+    }
+
+    if ( path == "/delete" )
+    {
+        return remove( query, status );
+    }
+
+    if ( path == "/group" )
+    {
+        return group( query, status );
+    }
+
+    if ( path == "/listen" )
+    {
+        return listen( query );
+    }
+
+    if ( path == "/stats" )
+    {
+        return stats();
+    }
+
+    if ( path == "/search" )
+    {
+        return search( query );
+    }
+
+    if ( path == "/jump" )
+    {
+        return jump( query, status );
+    }
+
+    status = 404;
+    return json_error( "unknown request: " + path );
+}
+
+
+std::string ReviewServer::next( const query_type& query )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::string session = ( it == query.end() ? "" : it->second );
+    std::map<std::string, PendingCard>::iterator pending = m_pending.find( session );
+    m_back_cursors.erase( session ); // goes forward again
+
+    if ( pending != m_pending.end() )
+    {
+        if ( ! pending->second.again && ! pending->second.jumped )
+        {
+            m_review_manager->grade( pending->second.card, Scheduler::Good );
+        }
+
+        m_pending.erase( pending );
+    }
+
+    bool again = false;
+    ReviewString s = m_review_manager->take_next( false, &again );
+
+    if ( s.m_history != NULL )
+    {
+        add_pending( session, PendingCard( s, again ) );
+    }
+
+    return json_card( s );
+}
+
+
+std::string ReviewServer::grade( const query_type& query, int& status )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::map<std::string, PendingCard>::iterator pending = m_pending.find( it == query.end() ? "" : it->second );
+
+    if ( pending == m_pending.end() )
+    {
+        status = 409;
+        return json_error( "no pending card" );
+    }
+
+    it = query.find( "quality" );
+    std::string quality = ( it == query.end() ? "good" : it->second );
+    Scheduler::EQuality q = Scheduler::Good;
+
+    if ( quality == "again" )     { q = Scheduler::Again; }
+    else if ( quality == "hard" ) { q = Scheduler::Hard; }
+    else if ( quality == "easy" ) { q = Scheduler::Easy; }
+    else if ( quality != "good" )
+    {
+        status = 400;
+        return json_error( "unknown quality: " + quality );
+    }
+
+    if ( ! pending->second.again )
+    {
+        m_review_manager->grade( pending->second.card, q );
+    }
+
+    std::string result = json_card( pending->second.card );
+    m_pending.erase( pending );
+    return result;
+}
+
+
+std::string ReviewServer::previous( const query_type& query )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::string session = ( it == query.end() ? "" : it->second );
+
+    if ( m_back_cursors.find( session ) == m_back_cursors.end() && max_sessions <= m_back_cursors.size() )
+    {
+        std::map<std::string, BackCursor>::iterator oldest = m_back_cursors.begin();
+
+        for ( std::map<std::string, BackCursor>::iterator back = m_back_cursors.begin(); back != m_back_cursors.end(); ++back )
+        {
+            if ( back->second.time < oldest->second.time )
+            {
+                oldest = back;
+            }
+        }
+
+        m_back_cursors.erase( oldest );
+    }
+
+    BackCursor& back = m_back_cursors[session];
+    back.time = std::time(0);
+    ReviewString s = m_review_manager->get_previous( back.cursor );
+    return json_card( s );
+}
+
+
+std::string ReviewServer::remove( const query_type& query, int& status )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::map<std::string, PendingCard>::iterator pending = m_pending.find( it == query.end() ? "" : it->second );
+
+    if ( pending == m_pending.end() )
+    {
+        status = 409;
+        return json_error( "no pending card" );
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex );
+        pending->second.card.m_history->disable( pending->second.card.get_hash() );
+    }
+
+    std::string result = json_card( pending->second.card );
+    m_pending.erase( pending );
+    return result;
+}
+
+
+std::string ReviewServer::group( const query_type& query, int& status )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::map<std::string, PendingCard>::iterator pending = m_pending.find( it == query.end() ? "" : it->second );
+
+    if ( pending == m_pending.end() )
+    {
+        status = 409;
+        return json_error( "no pending card" );
+    }
+
+    if ( ! pending->second.again )
+    {
+        m_review_manager->grade( pending->second.card, Scheduler::Good );
+    }
+
+    m_review_manager->add_to_group( pending->second.card );
+
+    std::string result = json_card( pending->second.card );
+    m_pending.erase( pending );
+    return result;
+}
+
+
+std::string ReviewServer::listen( const query_type& query )
+{
+    query_type::const_iterator it = query.find( "count" );
+    size_t count = 10;
+
+    if ( it != query.end() )
+    {
+        try
+        {
+            count = boost::lexical_cast<size_t>( it->second );
+        }
+        catch ( boost::bad_lexical_cast& )
+        {
+        }
+    }
+
+    std::vector<ReviewManager::DeckCard> cards;
+    boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex ); // the texts change with the decks
+    std::list<ReviewManager::DeckCard>::iterator card = m_review_manager->m_reviewing_list.begin();
+
+    for ( ; card != m_review_manager->m_reviewing_list.end() && cards.size() < count; ++card )
+    {
+        cards.push_back( *card );
+    }
+
+    std::stringstream strm;
+    strm << "{\"cards\":[";
+
+    for ( size_t i = 0; i < cards.size(); ++i )
+    {
+        const std::wstring& s = cards[i].first->m_loader->get_string( cards[i].second );
+        std::vector<std::wstring> words = WordTable::instance().get_words( cards[i].first->m_loader->get_card_words( cards[i].second ) );
+
+        strm << ( i ? "," : "" ) << "{\"hash\":" << cards[i].second << ",\"text\":" << json_string( s ) << ",\"words\":[";
+
+        for ( size_t j = 0; j < words.size(); ++j )
+        {
+            strm << ( j ? "," : "" ) << json_string( words[j] );
+        }
+
+        strm << "]}";
+    }
+
+    strm << "]}";
+    return strm.str();
+}
+
+
+std::string ReviewServer::stats()
+{
+    boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex );
+    std::stringstream strm;
+    strm << "{\"decks\":[";
+
+    for ( size_t i = 0; i < m_review_manager->m_decks.size(); ++i )
+    {
+        Deck* deck = m_review_manager->m_decks[i];
+        strm
+            << ( i ? "," : "" )
+            << "{\"name\":" << json_string( deck->m_file_name )
+            << ",\"cards\":" << deck->m_all.size()
+            << ",\"due\":" << deck->m_reviewing_set.size()
+            << ",\"forecast\":[";
+
+        std::vector<size_t> forecast = deck->m_history->get_forecast( m_review_manager->m_options.get()->forecast_days );
+
+        for ( size_t day = 0; day < forecast.size(); ++day )
+        {
+            strm << ( day ? "," : "" ) << forecast[day];
+        }
+
+        strm << "]}";
+    }
+
+    strm
+        << "],\"due\":" << m_review_manager->m_reviewing_list.size()
+        << ",\"group\":" << m_review_manager->m_review_group.size()
+        << ",\"reviewed\":" << m_review_manager->m_review_history.size()
+        << ",\"sessions\":" << m_pending.size() << "}";
+    return strm.str();
+}
+
+
+std::string ReviewServer::search( const query_type& query )
+{
+    query_type::const_iterator it = query.find( "q" );
+    std::wstring text = Utility::to_wstring( it == query.end() ? "" : it->second, CP_UTF8 );
+    size_t limit = 20;
+    it = query.find( "limit" );
+
+    if ( it != query.end() )
+    {
+        try
+        {
+            limit = boost::lexical_cast<size_t>( it->second );
+        }
+        catch ( boost::bad_lexical_cast& )
+        {
+        }
+    }
+
+    boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex ); // the texts change with the decks
+    std::vector<ReviewManager::DeckCard> cards = m_review_manager->search( text, limit );
+    std::stringstream strm;
+    strm << "{\"cards\":[";
+
+    for ( size_t i = 0; i < cards.size(); ++i )
+    {
+        size_t deck = std::find( m_review_manager->m_decks.begin(), m_review_manager->m_decks.end(), cards[i].first ) - m_review_manager->m_decks.begin();
+        strm
+            << ( i ? "," : "" )
+            << "{\"deck\":" << deck
+            << ",\"hash\":" << cards[i].second
+            << ",\"text\":" << json_string( cards[i].first->m_loader->get_string( cards[i].second ) ) << "}";
+    }
+
+    strm << "]}";
+    return strm.str();
+}
+
+
+std::string ReviewServer::jump( const query_type& query, int& status )
+{
+    query_type::const_iterator it = query.find( "session" );
+    std::string session = ( it == query.end() ? "" : it->second );
+    size_t deck = 0;
+    size_t hash = 0;
+
+    try
+    {
+        it = query.find( "deck" );
+        deck = ( it == query.end() ? 0 : boost::lexical_cast<size_t>( it->second ) );
+        it = query.find( "hash" );
+        hash = ( it == query.end() ? 0 : boost::lexical_cast<size_t>( it->second ) );
+    }
+    catch ( boost::bad_lexical_cast& )
+    {
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex );
+
+        if ( m_review_manager->m_decks.size() <= deck || ! m_review_manager->m_decks[deck]->m_all.contains( m_review_manager->m_decks[deck]->m_loader->get_card_ids().find( hash ) ) )
+        {
+            status = 404;
+            return json_error( "no such card" );
+        }
+    }
+
+    std::map<std::string, PendingCard>::iterator pending = m_pending.find( session );
+
+    if ( pending != m_pending.end() && ! pending->second.jumped ) // taken from the due cards, not graded yet
+    {
+        m_review_manager->put_back( pending->second.card, pending->second.again );
+    }
+
+    ReviewString s = m_review_manager->get_card( ReviewManager::DeckCard( m_review_manager->m_decks[deck], hash ) );
+    add_pending( session, PendingCard( s, false, true ) );
+    return json_card( s );
+}
+
+
+void ReviewServer::add_pending( const std::string& session, const PendingCard& card )
+{
+    if ( m_pending.find( session ) == m_pending.end() && max_sessions <= m_pending.size() )
+    {
+        std::map<std::string, PendingCard>::iterator oldest = m_pending.begin();
+
+        for ( std::map<std::string, PendingCard>::iterator it = m_pending.begin(); it != m_pending.end(); ++it )
+        {
+            if ( it->second.time < oldest->second.time )
+            {
+                oldest = it;
+            }
+        }
+
+        abandon( oldest );
+    }
+
+    m_pending[session] = card;
+}
+
+
+void ReviewServer::expire_sessions()
+{
+    std::time_t current_time = std::time(0);
+
+    for ( std::map<std::string, BackCursor>::iterator it = m_back_cursors.begin(); it != m_back_cursors.end(); )
+    {
+        if ( it->second.time + session_timeout < current_time )
+        {
+            m_back_cursors.erase( it++ );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for ( std::map<std::string, PendingCard>::iterator it = m_pending.begin(); it != m_pending.end(); )
+    {
+        if ( it->second.time + session_timeout < current_time )
+        {
+            abandon( it++ );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+
+void ReviewServer::abandon( std::map<std::string, PendingCard>::iterator pending )
+{
+    LOG_DEBUG << "abandoned session: " << pending->first;
+
+    if ( ! pending->second.jumped ) // taken from the due cards, not graded yet
+    {
+        m_review_manager->put_back( pending->second.card, pending->second.again );
+    }
+
+    m_pending.erase( pending );
+}
+
+
+ReviewServer::query_type ReviewServer::parse_query( const std::string& query )
+{
+    query_type result;
+    std::vector<std::string> pairs;
+    boost::split( pairs, query, boost::is_any_of( "&" ), boost::token_compress_on );
+
+    for ( size_t i = 0; i < pairs.size(); ++i )
+    {
+        size_t pos = pairs[i].find( '=' );
+
+        if ( ! pairs[i].empty() )
+        {
+            result[pairs[i].substr( 0, pos )] = ( pos == std::string::npos ? "" : url_decode( pairs[i].substr( pos + 1 ) ) );
+        }
+    }
+
+    return result;
+}
+
+
+std::string ReviewServer::url_decode( const std::string& s )
+{
+    std::string result;
+
+    for ( size_t i = 0; i < s.size(); ++i )
+    {
+        if ( s[i] == '%' && i + 2 < s.size() && std::isxdigit( static_cast<unsigned char>( s[i + 1] ) ) && std::isxdigit( static_cast<unsigned char>( s[i + 2] ) ) )
+        {
+            result += static_cast<char>( std::strtol( s.substr( i + 1, 2 ).c_str(), NULL, 16 ) );
+            i += 2;
+        }
+        else
+        {
+            result += ( s[i] == '+' ? ' ' : s[i] );
+        }
+    }
+
+    return result;
+}
+
+
+std::string ReviewServer::json_string( const std::wstring& ws )
+{
+    std::string s = Utility::to_string( ws, CP_UTF8 );
+    std::string result = "\"";
+
+    for ( size_t i = 0; i < s.size(); ++i )
+    {
+        unsigned char c = static_cast<unsigned char>( s[i] );
+
+        switch ( c )
+        {
+        case '"':  result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if ( c < 0x20 )
+            {
+                const char* hex = "0123456789abcdef";
+                result += "\\u00";
+                result += hex[c >> 4];
+                result += hex[c & 0xF];
+            }
+            else
+            {
+                result += s[i];
+            }
+        }
+    }
+
+    return result + "\"";
+}
+
+
+std::string ReviewServer::json_card( ReviewString& s )
+{
+    if ( s.m_history == NULL )
+    {
+        return "{\"card\":null}";
+    }
+
+    boost::lock_guard<boost::mutex> lock( m_review_manager->m_mutex ); // the review and update threads change the history
+    std::stringstream strm;
+    strm
+        << "{\"card\":{\"hash\":" << s.get_hash()
+        << ",\"round\":" << s.m_history->get_review_round( s.get_hash() )
+        << ",\"text\":" << json_string( s.get_string() ) << "}}";
+    return strm.str();
+}
+
+
+std::string ReviewServer::json_error( const std::string& message )
+{
+    return "{\"error\":" + json_string( std::wstring( message.begin(), message.end() ) ) + "}";
+}
+
+
+std::string ReviewServer::request( unsigned short port, const std::string& target )
+{
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket socket( io_service );
+    socket.connect( boost::asio::ip::tcp::endpoint( boost::asio::ip::address_v4::loopback(), port ) );
+
+    std::string request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    boost::asio::write( socket, boost::asio::buffer( request ) );
+
+    boost::asio::streambuf response;
+    boost::system::error_code error;
+    boost::asio::read( socket, response, boost::asio::transfer_all(), error );
+
+    std::string s( ( std::istreambuf_iterator<char>( &response ) ), std::istreambuf_iterator<char>() );
+    size_t pos = s.find( "\r\n\r\n" );
+    return pos == std::string::npos ? s : s.substr( pos + 4 );
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "ReviewString.h"
+#include "ReviewRing.h"
+class ReviewManager;
+
+
+// a loopback HTTP/1.1 API over the in-memory review queue, answers are JSON in UTF-8:
+//   GET /next?session=s                the next card, the pending card of the session is graded good first
+//                                      (a group card shown again was saved the first time, it is never graded again)
+//   GET /grade?session=s&quality=q     grade the pending card (again|hard|good|easy)
+//   GET /previous?session=s            the card reviewed before, each session goes back on its own until its next /next
+//   GET /delete?session=s              delete the pending card
+//   GET /group?session=s               review the pending card again after minimal-review-distance cards
+//   GET /listen?count=n                the next n due cards and their words to listen
+//   GET /stats                         due cards of every deck, and its forecast by day from today (review.forecast-days)
+//   GET /search?q=text&limit=n         cards by text (see Loader::search), the deck index and hash of each
+//   GET /jump?session=s&deck=d&hash=h  make a found card the pending card of the session, to grade, delete or group it;
+//                                      the card it replaces goes back to the due cards, /next does not grade a jumped card
+// all connections are served by one io_service thread, so the sessions need no lock of their own.
+// a request with more than 8 KB of headers is answered 431.
+class ReviewServer
+{
+public:
+
+    typedef std::map<std::string, std::string> query_type;
+
+    struct PendingCard
+    {
+        PendingCard( const ReviewString& card = ReviewString(), bool again = false, bool jumped = false ) : card( card ), again( again ), jumped( jumped ), time( std::time(0) ) {}
+        ReviewString card;
+        bool again;     // a group card shown again, saved already
+        bool jumped;    // by /jump, not taken from the due cards: graded only by /grade or /group
+        std::time_t time; // shown, a session left for 30 minutes gives its card back to the due cards
+    };
+
+    struct BackCursor
+    {
+        BackCursor() : time( std::time(0) ) {}
+        ReviewRing::Cursor cursor;
+        std::time_t time; // last used, it expires with the session
+    };
+
+public:
+
+    ReviewServer( ReviewManager* review_manager, unsigned short port );
+    ~ReviewServer();
+    std::string handle_request( const std::string& target, int& status );
+    static std::string request( unsigned short port, const std::string& target ); // stub client
+
+public:
+
+    void start_accept();
+    void run();
+    std::string next( const query_type& query );
+    std::string grade( const query_type& query, int& status );
+    std::string previous( const query_type& query );
+    std::string remove( const query_type& query, int& status );
+    std::string group( const query_type& query, int& status );
+    std::string listen( const query_type& query );
+    std::string stats();
+    std::string search( const query_type& query );
+    std::string jump( const query_type& query, int& status );
+    void add_pending( const std::string& session, const PendingCard& card ); // at most 64 sessions, the oldest is abandoned
+    void expire_sessions();
+    void abandon( std::map<std::string, PendingCard>::iterator pending ); // its card goes back to the due cards
+
+public:
+
+    static query_type parse_query( const std::string& query );
+    static std::string url_decode( const std::string& s ); // %XX and +
+    static std::string json_string( const std::wstring& ws );
+    std::string json_card( ReviewString& s ); // under the review manager's lock
+    static std::string json_error( const std::string& message );
+
+public:
+
+    ReviewManager* m_review_manager;
+    boost::asio::io_service m_io_service;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    std::map<std::string, PendingCard> m_pending; // session -> the card shown but not graded yet
+    std::map<std::string, BackCursor> m_back_cursors; // session -> where /previous is in the review ring
+    boost::thread m_thread;
+};
@@ -6,45 +6,31 @@
 #include "Utility.h"
 #include "Log.h"
 #include "ReviewManager.h"
-#include "WriteConsoleHelper.h"
+#include "ConsoleFrame.h"
 
 
-ReviewString::ReviewString( size_t hash, Loader* loader, History* history, Speech* play, const std::wstring& display_format )
+ReviewString::ReviewString( size_t hash, Loader* loader, History* history, Speech* play, const DisplayFormatPtr& display_format )
     : m_hash( hash ),
       m_loader( loader ),
       m_history( history ),
       m_speech( play ),
       m_display_format( display_format )
 {
-    if ( m_hash && m_loader && m_speech )
-    {
-        m_speech_words = Utility::extract_strings_in_braces( m_loader->get_string( m_hash ) );
-    }
-
     if ( m_hash && m_loader )
     {
-        m_wstring = m_loader->get_string( m_hash );
-        m_wstring.erase( std::remove_if( m_wstring.begin(), m_wstring.end(), boost::is_any_of( "{}" ) ), m_wstring.end() );
-
-        static boost::wregex e ( L"(?x) ( \\[ [a-zA-Z] \\] ) (.*?) (?= \\[ [a-zA-Z] \\] | \\z )" );
-        boost::wsregex_iterator it( m_wstring.begin(), m_wstring.end(), e );
-        boost::wsregex_iterator end;
-
-        for ( ; it != end; ++it )
-        {
-            wchar_t ch = it->str(1)[1];
-            std::wstring content = boost::trim_copy( it->str(2) );
-            m_string_map[ch] = content;
-        }
+        m_parsed = m_loader->get_parsed_string( m_hash );
     }
 }
 
 
 std::wstring ReviewString::review()
 {
-    if ( 0 == m_hash )
+    Utility::ConsoleFrame& frame = Utility::console_frame();
+
+    if ( 0 == m_hash || ! m_parsed )
     {
-        stdcout << "empty." << "\n";
+        frame.write( L"empty.\n" );
+        frame.present();
         return L"next";
     }
 
@@ -53,9 +39,11 @@ std::wstring ReviewString::review()
         play_speech();
     }
 
-    if ( m_string_map.empty() || m_display_format.empty() )
+    const std::map<wchar_t, std::wstring>& parts = m_parsed->parts;
+
+    if ( parts.empty() || ! m_display_format || m_display_format->empty() )
     {
-        Utility::write_console_on_center( m_wstring );
+        frame.write_center( m_parsed->text );
     }
     else
     {
@@ -64,12 +52,13 @@ std::wstring ReviewString::review()
         bool is_first_part = true;
         std::wstring first_content;
 
-        for ( size_t i = 0; i < m_display_format.size(); ++i )
+        for ( size_t i = 0; i < m_display_format->size(); ++i )
         {
-            wchar_t ch = m_display_format[i];
+            wchar_t ch = ( *m_display_format )[i];
 
             if ( ( ch == ',' ) && should_wait )
             {
+                frame.present();
                 std::wstring action = ReviewManager::wait_user_interaction();
 
                 if ( action != L"next" )
@@ -78,42 +67,44 @@ std::wstring ReviewString::review()
                     return action;
                 }
 
-                stdcout << L"\n";
+                frame.write( L"\n" );
                 should_wait = false;
                 should_new_line = false;
             }
             else
             {
-                const std::wstring& content = m_string_map[ch];
+                std::map<wchar_t, std::wstring>::const_iterator part = parts.find( ch );
 
-                if ( content.empty() )
+                if ( part == parts.end() || part->second.empty() )
                 {
                     continue;
                 }
 
+                const std::wstring& content = part->second;
+
                 if ( ! first_content.empty() )
                 {
-                    Utility::cls();
-                    stdcout << L"\t" << first_content << "\n";
+                    frame.clear();
+                    frame.write( L"\t" + first_content + L"\n" );
                     first_content.clear();
                 }
 
                 if ( should_new_line )
                 {
-                    stdcout << L"\n";
+                    frame.write( L"\n" );
                 }
 
-                stdcout << L"\t";
+                frame.write( L"\t" );
 
                 if ( is_first_part )
                 {
                     is_first_part = false;
                     first_content = content;
-                    Utility::write_console_on_center( content );
+                    frame.write_center( content );
                 }
                 else
                 {
-                    stdcout << content;
+                    frame.write( content );
                 }
 
                 should_wait = true;
@@ -122,25 +113,27 @@ std::wstring ReviewString::review()
         }
     }
 
-    if ( m_history )
-    {
-        LOG_DEBUG
-            << m_wstring << std::endl << "\t\t"
-            << "[Round: " << m_history->get_review_round( m_hash ) << "] "
-            << Utility::duration_string_from_time_list( m_history->get_times( m_hash ) );
-    }
-
-    return L"next";
+    frame.present();
+    return L"next"; // ReviewManager logs the card, its round is read under the review lock
 }
 
 
 void ReviewString::play_speech()
 {
-    if ( m_speech )
+    if ( m_speech && m_parsed )
     {
-        if ( ! m_speech_words.empty() )
+        std::wstring subtitle_file;
+        size_t start_time = 0;
+        size_t stop_time = 0;
+
+        if ( m_loader && m_loader->get_subtitle_cue( m_hash, subtitle_file, start_time, stop_time ) && m_speech->play_clip( subtitle_file, start_time, stop_time ) )
+        {
+            return;
+        }
+
+        if ( ! m_parsed->speech_words.empty() )
         {
-            m_speech->play( m_speech_words );
+            m_speech->play( m_parsed->speech_words );
         }
     }
 }
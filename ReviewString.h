@@ -1,14 +1,19 @@
 #pragma once
+#include "ParsedString.h"
 class History;
 class Loader;
 class Speech;
 
 
+typedef boost::shared_ptr<const std::wstring> DisplayFormatPtr;
+
+
+// a handle to a card: copying it copies a few pointers, the parsed text is shared and cached by the Loader
 class ReviewString
 {
 public:
 
-    ReviewString( size_t hash = 0, Loader* loader = NULL, History* history = NULL, Speech* play = NULL, const std::wstring& display_format = L"" );
+    ReviewString( size_t hash = 0, Loader* loader = NULL, History* history = NULL, Speech* play = NULL, const DisplayFormatPtr& display_format = DisplayFormatPtr() );
     std::wstring review();
     void play_speech();
     const std::wstring& get_string();
@@ -20,10 +25,8 @@ public:
     Loader* m_loader;
     History* m_history;
     Speech* m_speech;
-    std::wstring m_wstring;
-    std::wstring m_display_format;
-    std::vector<std::wstring> m_speech_words;
-    std::map<wchar_t, std::wstring> m_string_map;
+    ParsedStringPtr m_parsed;
+    DisplayFormatPtr m_display_format;  // shared with the options snapshot
 };
 
 typedef boost::shared_ptr<ReviewString> ReviewStringPtr;
@@ -0,0 +1,176 @@
+#include "stdafx.h"
+#include "Scheduler.h"
+#include "FixedScheduler.h"
+#include "Sm2Scheduler.h"
+#include "Utility.h"
+#include "Log.h"
+
+
+void Scheduler::get_due_bitmap( const ScheduleStates& states, std::time_t current_time, std::time_t once_per_days, due_bitmap& due ) const
+{
+    due.assign( ( states.size() + 31 ) / 32, 0 );
+
+    for ( size_t i = 0; i < states.size(); ++i )
+    {
+        if ( is_expired( states.get( i ), current_time, once_per_days ) )
+        {
+            due[i / 32] |= ( 1u << ( i % 32 ) );
+        }
+    }
+}
+
+
+void Scheduler::get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const
+{
+    due.resize( states.size() );
+
+    for ( size_t i = 0; i < states.size(); ++i )
+    {
+        std::time_t due_time = get_due_time( states.get( i ) );
+        due[i] = ( due_time < 0xFFFFFFFF ? static_cast<boost::uint32_t>( due_time ) : 0xFFFFFFFF );
+    }
+}
+
+
+bool Scheduler::is_expired( const ScheduleState& state, std::time_t current_time, std::time_t once_per_days ) const
+{
+    if ( state.is_new() )
+    {
+        return true;
+    }
+
+    if ( state.is_disabled() || is_finished( state ) )
+    {
+        return false;
+    }
+
+    if ( ! ( get_due_time( state ) < current_time ) )
+    {
+        return false;
+    }
+
+    if ( once_per_days )
+    {
+        if ( current_time - static_cast<std::time_t>( state.last_time ) < once_per_days )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+Scheduler::EReviewResult Scheduler::review( ScheduleState& state, std::time_t review_time, EQuality quality ) const
+{
+    if ( state.is_disabled() )
+    {
+        return Ignored;
+    }
+
+    if ( state.is_new() || get_due_time( state ) < review_time )
+    {
+        on_review( state, review_time, quality );
+        return Accepted;
+    }
+
+    if ( static_cast<std::time_t>( state.last_time ) < review_time ) // schedule changed
+    {
+        state.last_time = static_cast<boost::uint32_t>( review_time );
+        return Rescheduled;
+    }
+
+    return Ignored;
+}
+
+
+ScheduleState Scheduler::replay( const time_list& times ) const
+{
+    ScheduleState state;
+
+    if ( 1 == times.size() && ( ScheduleState::DELETED == times[0] || ScheduleState::FINISHED == times[0] ) )
+    {
+        state.disable( static_cast<boost::uint32_t>( times[0] ) );
+        return state;
+    }
+
+    for ( size_t i = 0; i < times.size(); ++i )
+    {
+        on_review( state, times[i], Good );
+    }
+
+    return state;
+}
+
+
+std::wstring Scheduler::evaluate( const history_type& history ) const
+{
+    size_t cards = 0;
+    size_t reviews = 0;
+    size_t early = 0;
+    size_t late = 0;
+    double total_late = 0;
+    double total_interval = 0;
+
+    for ( history_type::const_iterator it = history.begin(); it != history.end(); ++it )
+    {
+        const time_list& times = it->second;
+
+        if ( times.empty() || ( 1 == times.size() && times[0] <= ScheduleState::FINISHED ) )
+        {
+            continue;
+        }
+
+        ScheduleState state;
+        cards++;
+
+        for ( size_t i = 0; i < times.size() && ! is_finished( state ); ++i )
+        {
+            if ( ! state.is_new() )
+            {
+                std::time_t due_time = get_due_time( state );
+                total_interval += static_cast<double>( due_time - state.last_time );
+                reviews++;
+
+                if ( times[i] < due_time )
+                {
+                    early++;
+                }
+                else
+                {
+                    late++;
+                    total_late += static_cast<double>( times[i] - due_time );
+                }
+            }
+
+            on_review( state, times[i], Good );
+        }
+    }
+
+    std::wstringstream strm;
+    strm
+        << get_name() << L": "
+        << L"cards = " << cards
+        << L", reviews = " << reviews
+        << L", early = " << early
+        << L", late = " << late
+        << L", average-late = " << Utility::duration_string_from_seconds( late ? static_cast<std::time_t>( total_late / late ) : 0 )
+        << L", average-interval = " << Utility::duration_string_from_seconds( reviews ? static_cast<std::time_t>( total_interval / reviews ) : 0 );
+    return strm.str();
+}
+
+
+SchedulerPtr Scheduler::create( const std::wstring& name, const time_list& schedule )
+{
+    if ( name == L"sm2" || name == L"sm-2" )
+    {
+        return SchedulerPtr( new Sm2Scheduler( schedule ) );
+    }
+
+    if ( ! name.empty() && name != L"fixed" )
+    {
+        LOG << "unknown scheduler: " << name << ", use fixed";
+    }
+
+    return SchedulerPtr( new FixedScheduler( schedule ) );
+}
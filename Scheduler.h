@@ -0,0 +1,85 @@
+#pragma once
+typedef std::vector<std::time_t> time_list;
+typedef std::map<size_t, time_list> history_type;
+typedef std::vector<boost::uint32_t> due_bitmap; // bit i % 32 of word i / 32 is set when card i is due
+
+
+struct ScheduleState
+{
+    enum { DELETED, FINISHED };
+
+    ScheduleState() : last_time( 0 ), round( 0 ), ease( 0 ), interval( 0 ) {}
+    bool is_new() const { return 0 == round; }
+    bool is_disabled() const { return 1 == round && ( DELETED == last_time || FINISHED == last_time ); }
+    void disable( boost::uint32_t marker ) { last_time = marker; round = 1; ease = 0; interval = 0; }
+
+    boost::uint32_t last_time;  // last review time, DELETED or FINISHED when disabled
+    boost::uint8_t round;       // accepted reviews
+    boost::uint8_t ease;        // scheduler specific (SM-2: ease factor * 100 - 130)
+    boost::uint16_t interval;   // scheduler specific, in hours
+};
+
+
+// the states of a whole deck as parallel arrays (8 bytes per card), indexed by a dense card index
+struct ScheduleStates
+{
+    size_t size() const { return rounds.size(); }
+    void resize( size_t size ) { last_times.resize( size, 0 ); rounds.resize( size, 0 ); eases.resize( size, 0 ); intervals.resize( size, 0 ); }
+    void clear() { last_times.clear(); rounds.clear(); eases.clear(); intervals.clear(); }
+
+    ScheduleState get( size_t i ) const
+    {
+        ScheduleState state;
+        state.last_time = last_times[i];
+        state.round = rounds[i];
+        state.ease = eases[i];
+        state.interval = intervals[i];
+        return state;
+    }
+
+    void set( size_t i, const ScheduleState& state )
+    {
+        last_times[i] = state.last_time;
+        rounds[i] = state.round;
+        eases[i] = state.ease;
+        intervals[i] = state.interval;
+    }
+
+    std::vector<boost::uint32_t> last_times;
+    std::vector<boost::uint8_t> rounds;
+    std::vector<boost::uint8_t> eases;
+    std::vector<boost::uint16_t> intervals;
+};
+
+
+class Scheduler
+{
+public:
+
+    enum EQuality { Again, Hard, Good, Easy };
+    enum EReviewResult { Accepted, Rescheduled, Ignored };
+
+public:
+
+    virtual ~Scheduler() {}
+    virtual const wchar_t* get_name() const = 0;
+    virtual std::time_t get_due_time( const ScheduleState& state ) const = 0;
+    virtual bool is_finished( const ScheduleState& state ) const = 0;
+    virtual void on_review( ScheduleState& state, std::time_t review_time, EQuality quality ) const = 0;
+    virtual void get_due_bitmap( const ScheduleStates& states, std::time_t current_time, std::time_t once_per_days, due_bitmap& due ) const;
+    virtual void get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const; // by card, 0xFFFFFFFF for never
+    virtual bool adopt( ScheduleState& ) const { return false; } // a state written by another scheduler, true if it changed
+
+public:
+
+    bool is_expired( const ScheduleState& state, std::time_t current_time, std::time_t once_per_days ) const;
+    EReviewResult review( ScheduleState& state, std::time_t review_time, EQuality quality = Good ) const;
+    ScheduleState replay( const time_list& times ) const;
+    std::wstring evaluate( const history_type& history ) const;
+
+public:
+
+    static boost::shared_ptr<const Scheduler> create( const std::wstring& name, const time_list& schedule );
+};
+
+typedef boost::shared_ptr<const Scheduler> SchedulerPtr;
@@ -0,0 +1,386 @@
+#include "stdafx.h"
+#include "SearchIndex.h"
+
+
+void SearchIndex::PostingList::insert( card_id id )
+{
+    if ( count && id <= last ) // interned before its text was added, e.g. a card of the history back in the deck
+    {
+        std::vector<card_id> ids;
+        decode( ids );
+        std::vector<card_id>::iterator it = std::lower_bound( ids.begin(), ids.end(), id );
+
+        if ( it != ids.end() && *it == id )
+        {
+            return;
+        }
+
+        ids.insert( it, id );
+        *this = PostingList();
+
+        for ( size_t i = 0; i < ids.size(); ++i )
+        {
+            insert( ids[i] );
+        }
+
+        return;
+    }
+
+    boost::uint32_t delta = ( count ? id - last : id );
+
+    while ( 0x80 <= delta )
+    {
+        bytes.push_back( static_cast<unsigned char>( delta | 0x80 ) );
+        delta >>= 7;
+    }
+
+    bytes.push_back( static_cast<unsigned char>( delta ) );
+    last = id;
+    ++count;
+}
+
+
+void SearchIndex::PostingList::decode( std::vector<card_id>& ids ) const
+{
+    ids.reserve( ids.size() + count );
+    const unsigned char* p = bytes.empty() ? NULL : &bytes[0];
+    const unsigned char* end = p + bytes.size();
+    card_id id = 0;
+
+    while ( p < end )
+    {
+        boost::uint32_t delta = *p & 0x7F;
+
+        for ( size_t shift = 7; *p++ & 0x80; shift += 7 )
+        {
+            delta |= static_cast<boost::uint32_t>( *p & 0x7F ) << shift;
+        }
+
+        id += delta;
+        ids.push_back( id );
+    }
+}
+
+
+bool SearchIndex::contains( card_id id )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return id < m_indexed.size() && m_indexed[id];
+}
+
+
+void SearchIndex::add( card_id id, const std::wstring& text, const std::wstring& normalized, const std::vector<std::wstring>& words )
+{
+    std::vector<std::wstring> tokens = tokenize( boost::to_lower_copy( text ) );
+
+    for ( size_t i = 0; i < words.size(); ++i )
+    {
+        tokens.push_back( boost::to_lower_copy( words[i] ) );
+    }
+
+    std::sort( tokens.begin(), tokens.end() );
+    tokens.erase( std::unique( tokens.begin(), tokens.end() ), tokens.end() );
+
+    std::vector<boost::uint64_t> trigrams;
+    size_t size = normalized.size();
+
+    for ( size_t i = 0; i < size; ++i )
+    {
+        trigrams.push_back( trigram( normalized[i], ( i + 1 < size ? normalized[i + 1] : 0 ), ( i + 2 < size ? normalized[i + 2] : 0 ) ) );
+    }
+
+    std::sort( trigrams.begin(), trigrams.end() );
+    trigrams.erase( std::unique( trigrams.begin(), trigrams.end() ), trigrams.end() );
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( m_indexed.size() <= id )
+    {
+        m_indexed.resize( id + 1, false );
+        m_live.resize( id + 1, false );
+    }
+
+    m_live[id] = true;
+
+    if ( m_indexed[id] )
+    {
+        return;
+    }
+
+    m_indexed[id] = true;
+
+    for ( size_t i = 0; i < tokens.size(); ++i )
+    {
+        WordMap::iterator it = m_words.find( tokens[i] );
+
+        if ( it == m_words.end() )
+        {
+            it = m_words.insert( std::make_pair( tokens[i], PostingList() ) ).first;
+        }
+
+        it->second.insert( id );
+    }
+
+    for ( size_t i = 0; i < trigrams.size(); ++i )
+    {
+        TrigramMap::iterator it = m_trigrams.find( trigrams[i] );
+
+        if ( it == m_trigrams.end() )
+        {
+            it = m_trigrams.insert( std::make_pair( trigrams[i], PostingList() ) ).first;
+        }
+
+        it->second.insert( id );
+    }
+}
+
+
+void SearchIndex::retain( const std::vector<card_id>& live )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_live.assign( m_indexed.size(), false );
+
+    for ( size_t i = 0; i < live.size(); ++i )
+    {
+        if ( live[i] < m_live.size() )
+        {
+            m_live[live[i]] = true;
+        }
+    }
+}
+
+
+std::vector<SearchIndex::card_id> SearchIndex::find_prefix( const std::wstring& prefix )
+{
+    WordMap::value_type key( boost::to_lower_copy( prefix ), PostingList() );
+    std::vector<const PostingList*> lists;
+
+    if ( key.first.empty() )
+    {
+        return std::vector<card_id>();
+    }
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    sort_keys();
+
+    std::vector<const WordMap::value_type*>::iterator it = std::lower_bound( m_sorted_words.begin(), m_sorted_words.end(), &key, &SearchIndex::less_word );
+
+    for ( ; it != m_sorted_words.end() && 0 == (*it)->first.compare( 0, key.first.size(), key.first ); ++it )
+    {
+        lists.push_back( &(*it)->second );
+    }
+
+    return merge_live( lists );
+}
+
+
+std::vector<SearchIndex::card_id> SearchIndex::find_substring( const std::wstring& normalized )
+{
+    std::vector<const PostingList*> lists;
+    size_t size = normalized.size();
+
+    if ( 0 == size )
+    {
+        return std::vector<card_id>();
+    }
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( size < 3 ) // every trigram that starts with it, the padding covers the end of a text
+    {
+        sort_keys();
+        boost::uint64_t low = trigram( normalized[0], ( 2 == size ? normalized[1] : 0 ), 0 );
+        boost::uint64_t high = trigram( normalized[0], ( 2 == size ? normalized[1] : 0x1FFFFF ), 0x1FFFFF );
+        std::vector< std::pair<boost::uint64_t, const PostingList*> >::iterator it =
+            std::lower_bound( m_sorted_trigrams.begin(), m_sorted_trigrams.end(), std::make_pair( low, static_cast<const PostingList*>( NULL ) ) );
+
+        for ( ; it != m_sorted_trigrams.end() && it->first <= high; ++it )
+        {
+            lists.push_back( it->second );
+        }
+
+        return merge_live( lists );
+    }
+
+    for ( size_t i = 0; i + 3 <= size; ++i )
+    {
+        TrigramMap::const_iterator it = m_trigrams.find( trigram( normalized[i], normalized[i + 1], normalized[i + 2] ) );
+
+        if ( it == m_trigrams.end() )
+        {
+            return std::vector<card_id>();
+        }
+
+        lists.push_back( &it->second );
+    }
+
+    std::sort( lists.begin(), lists.end(), boost::bind( &PostingList::count, _1 ) < boost::bind( &PostingList::count, _2 ) ); // the shortest first, the candidates only shrink
+    lists.erase( std::unique( lists.begin(), lists.end() ), lists.end() );
+    std::vector<card_id> ids;
+    lists.front()->decode( ids );
+
+    for ( size_t i = 1; i < lists.size() && ! ids.empty(); ++i )
+    {
+        std::vector<card_id> next;
+        std::vector<card_id> result;
+        lists[i]->decode( next );
+        std::set_intersection( ids.begin(), ids.end(), next.begin(), next.end(), std::back_inserter( result ) );
+        ids.swap( result );
+    }
+
+    return filter_live( ids );
+}
+
+
+size_t SearchIndex::memory_size()
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    size_t size = 0;
+
+    for ( WordMap::iterator it = m_words.begin(); it != m_words.end(); ++it )
+    {
+        size += it->first.capacity() * sizeof(wchar_t) + sizeof(*it) + it->second.bytes.capacity();
+    }
+
+    for ( TrigramMap::iterator it = m_trigrams.begin(); it != m_trigrams.end(); ++it )
+    {
+        size += sizeof(*it) + it->second.bytes.capacity();
+    }
+
+    return size + m_indexed.size() / 4;
+}
+
+
+void SearchIndex::sort_keys()
+{
+    // keys are never removed, a new one changes the size
+    if ( m_sorted_words.size() != m_words.size() )
+    {
+        m_sorted_words.clear();
+        m_sorted_words.reserve( m_words.size() );
+
+        for ( WordMap::iterator it = m_words.begin(); it != m_words.end(); ++it )
+        {
+            m_sorted_words.push_back( &*it );
+        }
+
+        std::sort( m_sorted_words.begin(), m_sorted_words.end(), &SearchIndex::less_word );
+    }
+
+    if ( m_sorted_trigrams.size() != m_trigrams.size() )
+    {
+        m_sorted_trigrams.clear();
+        m_sorted_trigrams.reserve( m_trigrams.size() );
+
+        for ( TrigramMap::iterator it = m_trigrams.begin(); it != m_trigrams.end(); ++it )
+        {
+            m_sorted_trigrams.push_back( std::make_pair( it->first, &it->second ) );
+        }
+
+        std::sort( m_sorted_trigrams.begin(), m_sorted_trigrams.end() );
+    }
+}
+
+
+std::vector<SearchIndex::card_id> SearchIndex::merge_live( const std::vector<const PostingList*>& lists )
+{
+    std::vector<card_id> ids;
+    size_t count = 0;
+
+    for ( size_t i = 0; i < lists.size(); ++i )
+    {
+        count += lists[i]->count;
+    }
+
+    if ( count < m_indexed.size() / 16 ) // a few ids are sorted
+    {
+        for ( size_t i = 0; i < lists.size(); ++i )
+        {
+            lists[i]->decode( ids );
+        }
+
+        std::sort( ids.begin(), ids.end() );
+        ids.erase( std::unique( ids.begin(), ids.end() ), ids.end() );
+        return filter_live( ids );
+    }
+
+    std::vector<bool> found( m_indexed.size(), false ); // many are marked in a bitmap instead
+    std::vector<card_id> list;
+
+    for ( size_t i = 0; i < lists.size(); ++i )
+    {
+        list.clear();
+        lists[i]->decode( list );
+
+        for ( size_t j = 0; j < list.size(); ++j )
+        {
+            found[list[j]] = true;
+        }
+    }
+
+    for ( size_t i = 0; i < found.size(); ++i )
+    {
+        if ( found[i] && m_live[i] )
+        {
+            ids.push_back( static_cast<card_id>( i ) );
+        }
+    }
+
+    return ids;
+}
+
+
+std::vector<SearchIndex::card_id> SearchIndex::filter_live( const std::vector<card_id>& ids )
+{
+    std::vector<card_id> result;
+    result.reserve( ids.size() );
+
+    for ( size_t i = 0; i < ids.size(); ++i )
+    {
+        if ( ids[i] < m_live.size() && m_live[ids[i]] )
+        {
+            result.push_back( ids[i] );
+        }
+    }
+
+    return result;
+}
+
+
+std::vector<std::wstring> SearchIndex::tokenize( const std::wstring& text )
+{
+    std::vector<std::wstring> tokens;
+    size_t begin = 0;
+
+    for ( size_t i = 0; i <= text.size(); ++i )
+    {
+        if ( i == text.size() || is_separator( text[i] ) )
+        {
+            if ( begin < i )
+            {
+                tokens.push_back( text.substr( begin, i - begin ) );
+            }
+
+            begin = i + 1;
+        }
+    }
+
+    return tokens;
+}
+
+
+bool SearchIndex::is_separator( wchar_t ch )
+{
+    if ( ch < 0x80 )
+    {
+        return ! ( ( L'0' <= ch && ch <= L'9' ) || ( L'a' <= ch && ch <= L'z' ) || ( L'A' <= ch && ch <= L'Z' ) || ch == L'_' );
+    }
+
+    return ( 0x2000 <= ch && ch <= 0x206F ) || ( 0x3000 <= ch && ch <= 0x303F ) || ( 0xFF00 <= ch && ch <= 0xFF0F ) || ( 0xFF1A <= ch && ch <= 0xFF20 ) || ch == 0x00B7;
+}
+
+
+boost::uint64_t SearchIndex::trigram( wchar_t a, wchar_t b, wchar_t c )
+{
+    return ( static_cast<boost::uint64_t>( a & 0x1FFFFF ) << 42 ) | ( static_cast<boost::uint64_t>( b & 0x1FFFFF ) << 21 ) | static_cast<boost::uint64_t>( c & 0x1FFFFF );
+}
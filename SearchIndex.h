@@ -0,0 +1,58 @@
+#pragma once
+#include "CardIdTable.h"
+
+
+// finds the cards of a deck by text, an inverted index built as the deck is loaded and extended as cards are added:
+//   words (tokens of the lower-cased text and the {speech} words) answer prefix queries, sorted on the first query after a change;
+//   trigrams of the normalized text answer substring queries, the text padded at the end so every position starts one.
+// a posting list is the ascending ids of the cards with a key, delta and varint encoded; card ids are append-only,
+// so a new card is appended to its lists. candidates of a substring longer than 3 may have the trigrams apart,
+// the caller checks the text
+class SearchIndex
+{
+public:
+
+    typedef CardIdTable::card_id card_id;
+
+    struct PostingList
+    {
+        PostingList() : last( 0 ), count( 0 ) {}
+        void insert( card_id id );
+        void decode( std::vector<card_id>& ids ) const;
+        std::vector<unsigned char> bytes;   // deltas from the previous id, 7 bits a byte, the high bit for more
+        card_id last;
+        boost::uint32_t count;
+    };
+
+    typedef boost::unordered_map<std::wstring, PostingList> WordMap;
+    typedef boost::unordered_map<boost::uint64_t, PostingList> TrigramMap;
+
+public:
+
+    bool contains( card_id id );
+    void add( card_id id, const std::wstring& text, const std::wstring& normalized, const std::vector<std::wstring>& words );
+    void retain( const std::vector<card_id>& live ); // the cards of the deck now, the others are not found
+    std::vector<card_id> find_prefix( const std::wstring& prefix );
+    std::vector<card_id> find_substring( const std::wstring& normalized );
+    size_t memory_size();
+
+public:
+
+    void sort_keys(); // should lock outside
+    std::vector<card_id> merge_live( const std::vector<const PostingList*>& lists ); // the union, should lock outside
+    std::vector<card_id> filter_live( const std::vector<card_id>& ids ); // should lock outside
+    static bool less_word( const WordMap::value_type* a, const WordMap::value_type* b ) { return a->first < b->first; }
+    static std::vector<std::wstring> tokenize( const std::wstring& text );
+    static bool is_separator( wchar_t ch );
+    static boost::uint64_t trigram( wchar_t a, wchar_t b, wchar_t c );
+
+public:
+
+    boost::mutex m_mutex;
+    WordMap m_words;
+    TrigramMap m_trigrams;
+    std::vector<const WordMap::value_type*> m_sorted_words;                 // sorted when queried, nodes never move
+    std::vector< std::pair<boost::uint64_t, const PostingList*> > m_sorted_trigrams;
+    std::vector<bool> m_indexed;                        // by card id
+    std::vector<bool> m_live;                           // by card id
+};
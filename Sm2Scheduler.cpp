@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "Sm2Scheduler.h"
+
+#ifdef max
+#undef max
+#undef min
+#endif
+
+
+Sm2Scheduler::Sm2Scheduler( const time_list& schedule )
+    : m_schedule( schedule )
+{
+}
+
+
+std::time_t Sm2Scheduler::get_due_time( const ScheduleState& state ) const
+{
+    if ( state.is_new() )
+    {
+        return 0;
+    }
+
+    return state.last_time + static_cast<std::time_t>( state.interval ) * 3600;
+}
+
+
+void Sm2Scheduler::on_review( ScheduleState& state, std::time_t review_time, EQuality quality ) const
+{
+    static const int quality_score[] = { 1, 3, 4, 5 }; // Again, Hard, Good, Easy
+    int q = quality_score[quality];
+    double ease_factor = get_ease_factor( state );
+
+    if ( q < 3 )
+    {
+        state.round = 1;
+        state.interval = 24;
+    }
+    else
+    {
+        if ( state.round < std::numeric_limits<boost::uint8_t>::max() )
+        {
+            state.round++;
+        }
+
+        if ( 1 == state.round )
+        {
+            state.interval = 24;
+        }
+        else if ( 2 == state.round )
+        {
+            state.interval = 6 * 24;
+        }
+        else
+        {
+            // a card reviewed under another scheduler has no interval yet
+            double interval = std::max<double>( state.interval, 6 * 24 ) * ease_factor + 0.5;
+            state.interval = static_cast<boost::uint16_t>( std::min<double>( interval, std::numeric_limits<boost::uint16_t>::max() ) );
+        }
+    }
+
+    ease_factor += 0.1 - ( 5 - q ) * ( 0.08 + ( 5 - q ) * 0.02 );
+    ease_factor = std::max<double>( ease_factor, 1.3 );
+    state.ease = static_cast<boost::uint8_t>( std::min<double>( ( ease_factor - 1.3 ) * 100 + 0.5, 255 ) );
+    state.last_time = static_cast<boost::uint32_t>( review_time );
+}
+
+
+bool Sm2Scheduler::adopt( ScheduleState& state ) const
+{
+    if ( state.is_new() || state.is_disabled() || 0 != state.interval || m_schedule.empty() )
+    {
+        return false;
+    }
+
+    std::time_t span = m_schedule[std::min<size_t>( state.round, m_schedule.size() - 1 )];
+    state.interval = static_cast<boost::uint16_t>( std::min<std::time_t>( std::max<std::time_t>( span / 3600, 1 ), std::numeric_limits<boost::uint16_t>::max() ) );
+    state.ease = 120; // 2.5
+    return true;
+}
+
+
+double Sm2Scheduler::get_ease_factor( const ScheduleState& state )
+{
+    if ( state.is_new() || 0 == state.interval ) // not reviewed under SM-2 yet
+    {
+        return 2.5;
+    }
+
+    return 1.3 + state.ease / 100.0;
+}
+
+
+// last + interval hours; a new card has last 0 and interval 0, so it is due at 0 as get_due_time says
+void Sm2Scheduler::get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const
+{
+    size_t size = states.size();
+    due.resize( size );
+
+    if ( 0 == size )
+    {
+        return;
+    }
+
+    const boost::uint32_t* last_times = &states.last_times[0];
+    const boost::uint16_t* intervals = &states.intervals[0];
+    size_t i = 0;
+
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+    const __m128i hour = _mm_set1_epi16( 3600 );
+    const __m128i bias = _mm_set1_epi32( static_cast<int>( 0x80000000u ) );
+
+    for ( ; i + 8 <= size; i += 8 ) // 16 x 16 bit products put together from their low and high halves, sums saturated as in FixedScheduler
+    {
+        __m128i interval = _mm_loadu_si128( reinterpret_cast<const __m128i*>( intervals + i ) );
+        __m128i low = _mm_mullo_epi16( interval, hour );
+        __m128i high = _mm_mulhi_epu16( interval, hour );
+        __m128i last_a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( last_times + i ) );
+        __m128i last_b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( last_times + i + 4 ) );
+        __m128i a = _mm_add_epi32( last_a, _mm_unpacklo_epi16( low, high ) );
+        __m128i b = _mm_add_epi32( last_b, _mm_unpackhi_epi16( low, high ) );
+        a = _mm_or_si128( a, _mm_cmpgt_epi32( _mm_xor_si128( last_a, bias ), _mm_xor_si128( a, bias ) ) );
+        b = _mm_or_si128( b, _mm_cmpgt_epi32( _mm_xor_si128( last_b, bias ), _mm_xor_si128( b, bias ) ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( &due[i] ), a );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( &due[i + 4] ), b );
+    }
+#endif
+
+    for ( ; i < size; ++i )
+    {
+        boost::uint32_t sum = last_times[i] + intervals[i] * 3600u;
+        due[i] = ( sum < last_times[i] ? 0xFFFFFFFF : sum );
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Scheduler.h"
+
+
+// SuperMemo-2: the interval grows by a per-card ease factor that follows the answer quality
+class Sm2Scheduler : public Scheduler
+{
+public:
+
+    Sm2Scheduler( const time_list& schedule );
+    virtual const wchar_t* get_name() const { return L"sm2"; }
+    virtual std::time_t get_due_time( const ScheduleState& state ) const;
+    virtual bool is_finished( const ScheduleState& ) const { return false; }
+    virtual void on_review( ScheduleState& state, std::time_t review_time, EQuality quality ) const;
+    virtual void get_due_times( const ScheduleStates& states, std::vector<boost::uint32_t>& due ) const;
+    virtual bool adopt( ScheduleState& state ) const; // a reviewed card with no interval: the fixed span of its round, the default ease
+
+public:
+
+    static double get_ease_factor( const ScheduleState& state );
+
+public:
+
+    time_list m_schedule; // review.schedule, only to seed cards reviewed under the fixed scheduler
+};
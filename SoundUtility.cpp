@@ -1,12 +1,19 @@
 #include "stdafx.h"
 #include "SoundUtility.h"
 #include "QueueProcessor.h"
+#include "AudioOutput.h"
 
 
 namespace Utility
 {
 
-    void play_sound( const std::wstring& file  )
+    void play_sound( const std::wstring& file )
+    {
+        get_audio_output()->play( std::vector<std::wstring>( 1, file ) );
+    }
+
+
+    void play_sound_direct_show( const std::wstring& file )
     {
         try
         {
@@ -44,10 +51,7 @@ namespace Utility
 
     void play_sound_list( const std::vector<std::wstring>& files )
     {
-        for ( size_t i = 0; i < files.size(); ++i )
-        {
-            play_sound( files[i] );
-        }
+        get_audio_output()->play( files );
     }
 
 
@@ -68,17 +72,11 @@ namespace Utility
 
     void text_to_speech_list( const std::vector<std::wstring>& words )
     {
-        static ISpVoice* sp_voice = NULL;
-
-        if ( NULL == sp_voice )
-        {
-            ::CoCreateInstance( CLSID_SpVoice, NULL, CLSCTX_ALL, IID_ISpVoice, (void **)&sp_voice );
-        }
+        AudioOutputPtr output = get_audio_output();
 
         for ( size_t i = 0; i < words.size(); ++i )
         {
-            // std::wstring ws = boost::locale::conv::utf_to_utf<wchar_t>( words[i], "" );
-            sp_voice->Speak( words[i].c_str(), 0, NULL );
+            output->speak( words[i] );
             //LOG_TRACE << words[i];
 
             if ( i + 1 < words.size() )
@@ -111,9 +109,29 @@ namespace Utility
 
     void play_or_tts_list( const std::vector< std::pair<std::wstring, std::wstring> >& word_path_list )
     {
+        AudioOutputPtr output = get_audio_output();
+        std::vector<std::wstring> files;
+
         for ( size_t i = 0; i < word_path_list.size(); ++i )
         {
-            play_or_tts( word_path_list[i] );
+            if ( ! word_path_list[i].second.empty() )
+            {
+                files.push_back( word_path_list[i].second ); // recorded words in a row play as one sequence
+                continue;
+            }
+
+            if ( ! files.empty() )
+            {
+                output->play( files );
+                files.clear();
+            }
+
+            output->speak( word_path_list[i].first );
+        }
+
+        if ( ! files.empty() )
+        {
+            output->play( files );
         }
     }
 
@@ -11,6 +11,7 @@ namespace Utility
     };
 
     void play_sound( const std::wstring& file );
+    void play_sound_direct_show( const std::wstring& file );
     void play_sound_list( const std::vector<std::wstring>& files );
     void play_sound_list_thread( const std::vector<std::wstring>& files );
     void text_to_speech( const std::string& word );
@@ -5,18 +5,20 @@
 #include "OptionString.h"
 #include "ProgramOptions.h"
 #include "OptionUpdateHelper.h"
+#include "AudioOutput.h"
 
 
+static const std::time_t recording_miss_seconds = 60; // a recording added meanwhile is found after this
+
 Speech::Speech()
-    : m_no_duplicate( false ),
-      m_no_text_to_speech( false ),
-      m_text_to_speech_repeat( 1 )
+    : m_recordings_version( 0 )
 {
+    m_tts_cache.set_skip( boost::bind( &Speech::has_recording, this, _1 ) );
     ProgramOptions::connect_to_signal( boost::bind( &Speech::update_option, this, _1 ) );
 }
 
 
-void Speech::play( const std::vector<std::wstring>& words )
+void Speech::play( const std::vector<WordTable::word_id>& words )
 {
     std::vector< std::pair<std::wstring, std::wstring> > word_paths = get_word_speech_file_path( words );
 
@@ -27,25 +29,46 @@ void Speech::play( const std::vector<std::wstring>& words )
 }
 
 
-std::vector<std::wstring> Speech::get_files( const std::vector<std::wstring>& words, std::vector<std::wstring>& speak_words )
+bool Speech::play_clip( const std::wstring& subtitle_file, size_t start_time, size_t stop_time )
 {
-    boost::unique_lock<boost::mutex> lock( m_mutex );
+    std::wstring media = boost::filesystem::change_extension( subtitle_file, L".wav" ).wstring();
+
+    if ( ! boost::filesystem::exists( media ) )
+    {
+        return false;
+    }
+
+    std::wstring clip = m_clip_cache.get_clip( media, start_time, stop_time );
 
+    if ( clip.empty() )
+    {
+        return false;
+    }
+
+    Utility::play_or_tts_list_thread( std::vector< std::pair<std::wstring, std::wstring> >( 1, std::make_pair( std::wstring(), clip ) ) );
+    return true;
+}
+
+
+std::vector<std::wstring> Speech::get_files( const std::vector<std::wstring>& words, std::vector<std::wstring>& speak_words )
+{
+    OptionsPtr options = m_options.get();
+    const std::vector< std::pair<boost::filesystem::path, std::wstring> >& speech_paths = options->paths;
     std::vector<std::wstring> files;
     std::vector<bool> word_found( words.size() );
     for ( size_t i = 0; i < word_found.size(); ++i ) { word_found[i] = false; }
 
-    for ( size_t i = 0; i < m_paths.size(); ++i )
+    for ( size_t i = 0; i < speech_paths.size(); ++i )
     {
         for ( size_t j = 0; j < words.size(); ++j )
         {
-            if ( m_no_duplicate && word_found[j] == true )
+            if ( options->no_duplicate && word_found[j] == true )
             {
                 continue;
             }
 
             std::wstring first_char = words[j].substr( 0, 1 );
-            boost::filesystem::path path = m_paths[i].first / first_char / ( words[j] + m_paths[i].second );
+            boost::filesystem::path path = speech_paths[i].first / first_char / ( words[j] + speech_paths[i].second );
 
             if ( boost::filesystem::exists( path ) )
             {
@@ -68,37 +91,26 @@ std::vector<std::wstring> Speech::get_files( const std::vector<std::wstring>& wo
 }
 
 
-std::vector< std::pair<std::wstring, std::wstring> > Speech::get_word_speech_file_path( const std::vector<std::wstring>& words )
+std::vector< std::pair<std::wstring, std::wstring> > Speech::get_word_speech_file_path( const std::vector<WordTable::word_id>& word_ids )
 {
-    boost::unique_lock<boost::mutex> lock( m_mutex );
-
+    std::vector<std::wstring> words = WordTable::instance().get_words( word_ids );
+    OptionsPtr options = m_options.get();
+    const std::vector< std::pair<boost::filesystem::path, std::wstring> >& speech_paths = options->paths;
     std::vector< std::pair<std::wstring, std::wstring> > paths;
 
-    if ( m_no_duplicate )
+    if ( options->no_duplicate )
     {
         for ( size_t i = 0; i < words.size(); ++i )
         {
             const std::wstring& word = words[i];
-            std::wstring word_path;
-            std::wstring first_char = words[i].substr( 0, 1 );
+            std::wstring word_path = find_recording( word_ids[i], word, options );
 
-            for ( size_t j = 0; j < m_paths.size(); ++j )
+            if ( word_path.empty() && ! options->no_text_to_speech )
             {
-                boost::filesystem::path path = m_paths[j].first / first_char / ( word + m_paths[j].second );
-
-                if ( boost::filesystem::exists( path ) )
-                {
-                    word_path = path.wstring();
-                    LOG_TRACE << word_path;
-                    break;
-                }
-                else
-                {
-                    LOG_TRACE << "can not find: " << path.wstring();
-                }
+                word_path = get_synthesized_file( word );
             }
 
-            if ( ! word_path.empty() || ! m_no_text_to_speech )
+            if ( ! word_path.empty() || ! options->no_text_to_speech )
             {
                 paths.push_back( std::make_pair(word, word_path ) );
             }
@@ -106,26 +118,19 @@ std::vector< std::pair<std::wstring, std::wstring> > Speech::get_word_speech_fil
     }
     else
     {
-        for ( size_t i = 0; i < m_paths.size(); ++i )
+        for ( size_t i = 0; i < speech_paths.size(); ++i )
         {
             for ( size_t j = 0; j < words.size(); ++j )
             {
                 const std::wstring& word = words[j];
-                std::wstring first_char = word.substr( 0, 1 );
-                std::wstring word_path;
-                boost::filesystem::path path = m_paths[i].first / first_char / ( word + m_paths[i].second );
+                std::wstring word_path = find_recording( word_ids[j], word, options, i );
 
-                if ( boost::filesystem::exists( path ) )
-                {
-                    word_path = path.wstring();
-                    LOG_TRACE << word_path;
-                }
-                else
+                if ( word_path.empty() && ! options->no_text_to_speech )
                 {
-                    LOG_TRACE << "can not find: " << path.wstring();
+                    word_path = get_synthesized_file( word );
                 }
 
-                if ( ! word_path.empty() || ! m_no_text_to_speech )
+                if ( ! word_path.empty() || ! options->no_text_to_speech )
                 {
                     paths.push_back( std::make_pair(word, word_path ) );
                 }
@@ -137,9 +142,129 @@ std::vector< std::pair<std::wstring, std::wstring> > Speech::get_word_speech_fil
 }
 
 
+std::wstring Speech::find_recording( WordTable::word_id id, const std::wstring& word, OptionsPtr options, size_t path_index )
+{
+    std::time_t now = std::time( NULL );
+    recording_key key( id, path_index );
+
+    {
+        boost::unique_lock<boost::mutex> lock( m_recordings_mutex );
+
+        if ( m_recordings_version == options->version )
+        {
+            boost::unordered_map<recording_key, std::wstring>::iterator it = m_recordings.find( key );
+
+            if ( it != m_recordings.end() )
+            {
+                return it->second;
+            }
+
+            boost::unordered_map<recording_key, std::time_t>::iterator miss = m_misses.find( key );
+
+            if ( miss != m_misses.end() )
+            {
+                if ( now < miss->second + recording_miss_seconds )
+                {
+                    return std::wstring();
+                }
+
+                m_misses.erase( miss );
+            }
+        }
+        else
+        {
+            m_recordings.clear();
+            m_misses.clear();
+            m_recordings_version = options->version;
+        }
+    }
+
+    std::wstring word_path;
+    std::wstring first_char = word.substr( 0, 1 );
+
+    size_t first = ( path_index == any_path ? 0 : path_index );
+    size_t last = ( path_index == any_path ? options->paths.size() : std::min( path_index + 1, options->paths.size() ) );
+
+    for ( size_t j = first; j < last; ++j )
+    {
+        boost::filesystem::path path = options->paths[j].first / first_char / ( word + options->paths[j].second );
+
+        if ( boost::filesystem::exists( path ) )
+        {
+            word_path = path.wstring();
+            LOG_TRACE << word_path;
+            break;
+        }
+        else
+        {
+            LOG_TRACE << "can not find: " << path.wstring();
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock( m_recordings_mutex );
+
+    if ( m_recordings_version == options->version )
+    {
+        if ( word_path.empty() )
+        {
+            m_misses[key] = now;
+        }
+        else
+        {
+            m_recordings[key] = word_path;
+        }
+    }
+
+    return word_path;
+}
+
+
+std::wstring Speech::get_synthesized_file( const std::wstring& word )
+{
+    std::wstring file = m_tts_cache.get_file( word );
+
+    if ( file.empty() && ! m_tts_cache.is_synthesizing( word ) )
+    {
+        m_tts_cache.prefill( std::vector<std::wstring>( 1, word ) ); // spoken live this time, from the cache next time
+    }
+
+    return file;
+}
+
+
+void Speech::prefill( const std::vector<std::wstring>& words )
+{
+    OptionsPtr options = m_options.get();
+
+    if ( ! options->no_text_to_speech )
+    {
+        m_tts_cache.prefill( words );
+    }
+}
+
+
+bool Speech::has_recording( const std::wstring& word )
+{
+    OptionsPtr options = m_options.get();
+    std::wstring first_char = word.substr( 0, 1 );
+
+    for ( size_t i = 0; i < options->paths.size(); ++i )
+    {
+        if ( boost::filesystem::exists( options->paths[i].first / first_char / ( word + options->paths[i].second ) ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 void Speech::update_option( const boost::program_options::variables_map& vm )
 {
     static OptionUpdateHelper option_helper;
+    Options options = m_options.copy();
+    bool changed = false;
 
     if ( option_helper.update_one_option< std::vector<std::wstring> >( speech_path_option, vm ) )
     {
@@ -171,19 +296,77 @@ void Speech::update_option( const boost::program_options::variables_map& vm )
             }
         }
 
-        boost::unique_lock<boost::mutex> lock( m_mutex );
-        m_paths = paths;
+        options.paths = paths;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( speech_no_duplicate, vm, L"false" ) )
     {
-        m_no_duplicate = ( L"true" == option_helper.get_value<std::wstring>( speech_no_duplicate ) );
-        LOG_DEBUG << "speech-no-duplicate: " << m_no_duplicate;
+        options.no_duplicate = ( L"true" == option_helper.get_value<std::wstring>( speech_no_duplicate ) );
+        LOG_DEBUG << "speech-no-duplicate: " << options.no_duplicate;
+        changed = true;
     }
 
     if ( option_helper.update_one_option<std::wstring>( speech_no_text_to_speech, vm, L"false" ) )
     {
-        m_no_text_to_speech = ( L"true" == option_helper.get_value<std::wstring>( speech_no_text_to_speech ) );
-        LOG_DEBUG << "speech-no-text-to-speech: " << m_no_text_to_speech;
+        options.no_text_to_speech = ( L"true" == option_helper.get_value<std::wstring>( speech_no_text_to_speech ) );
+        LOG_DEBUG << "speech-no-text-to-speech: " << options.no_text_to_speech;
+        changed = true;
+    }
+
+    std::wstring default_clip_cache_path = ( boost::filesystem::temp_directory_path() / L"review-clips" ).wstring();
+    bool clip_cache_changed = false;
+
+    if ( option_helper.update_one_option<std::wstring>( speech_clip_cache_path_option, vm, default_clip_cache_path ) )
+    {
+        options.clip_cache_path = option_helper.get_value<std::wstring>( speech_clip_cache_path_option );
+        LOG_DEBUG << "speech-clip-cache-path: " << options.clip_cache_path;
+        clip_cache_changed = changed = true;
+    }
+
+    if ( option_helper.update_one_option<size_t>( speech_clip_cache_size_option, vm, 100 ) )
+    {
+        options.clip_cache_size = option_helper.get_value<size_t>( speech_clip_cache_size_option );
+        LOG_DEBUG << "speech-clip-cache-size: " << options.clip_cache_size;
+        clip_cache_changed = changed = true;
+    }
+
+    if ( clip_cache_changed )
+    {
+        m_clip_cache.configure( options.clip_cache_path, static_cast<boost::uint64_t>( options.clip_cache_size ) * 1024 * 1024 );
+    }
+
+    std::wstring default_tts_cache_path = ( boost::filesystem::temp_directory_path() / L"review-tts" ).wstring();
+    bool tts_cache_changed = false;
+
+    if ( option_helper.update_one_option<std::wstring>( speech_tts_cache_path_option, vm, default_tts_cache_path ) )
+    {
+        options.tts_cache_path = option_helper.get_value<std::wstring>( speech_tts_cache_path_option );
+        LOG_DEBUG << "speech-tts-cache-path: " << options.tts_cache_path;
+        tts_cache_changed = changed = true;
+    }
+
+    if ( option_helper.update_one_option<std::wstring>( speech_tts_voice_option, vm, L"sapi" ) )
+    {
+        options.tts_voice = option_helper.get_value<std::wstring>( speech_tts_voice_option );
+        LOG_DEBUG << "speech-tts-voice: " << options.tts_voice;
+        tts_cache_changed = changed = true;
+    }
+
+    if ( tts_cache_changed )
+    {
+        m_tts_cache.configure( options.tts_cache_path, Synthesizer::create( options.tts_voice ) );
+    }
+
+    if ( option_helper.update_one_option<std::wstring>( speech_output_option, vm, L"windows" ) )
+    {
+        std::wstring output = option_helper.get_value<std::wstring>( speech_output_option );
+        Utility::set_audio_output( Utility::AudioOutput::create( output ) );
+        LOG_DEBUG << "speech-output: " << output;
+    }
+
+    if ( changed )
+    {
+        m_options.publish( options );
     }
 }
@@ -1,21 +1,52 @@
 #pragma once
+#include "OptionSnapshot.h"
+#include "ClipCache.h"
+#include "TtsCache.h"
+#include "WordTable.h"
 
 
 class Speech
 {
+public:
+
+    struct Options
+    {
+        Options() : no_duplicate( false ), no_text_to_speech( false ), text_to_speech_repeat( 1 ), clip_cache_size( 100 ), version( 0 ) {}
+        bool no_duplicate;
+        bool no_text_to_speech;
+        size_t text_to_speech_repeat;
+        std::vector< std::pair<boost::filesystem::path, std::wstring> > paths;
+        std::wstring clip_cache_path;
+        size_t clip_cache_size; // in MB
+        std::wstring tts_cache_path;
+        std::wstring tts_voice;
+        size_t version;
+    };
+
+    typedef OptionSnapshot<Options>::pointer OptionsPtr;
+    typedef std::pair<WordTable::word_id, size_t> recording_key; // the word and the index of its speech path, or any_path
+    static const size_t any_path = static_cast<size_t>( -1 );
+
 public:
 
     Speech();
-    void play( const std::vector<std::wstring>& words );
+    void play( const std::vector<WordTable::word_id>& words );
+    bool play_clip( const std::wstring& subtitle_file, size_t start_time, size_t stop_time ); // from the .wav beside the subtitle
     std::vector<std::wstring> get_files( const std::vector<std::wstring>& words, std::vector<std::wstring>& speak_words );
-    std::vector< std::pair<std::wstring, std::wstring> > get_word_speech_file_path( const std::vector<std::wstring>& words );
+    std::vector< std::pair<std::wstring, std::wstring> > get_word_speech_file_path( const std::vector<WordTable::word_id>& word_ids );
+    void prefill( const std::vector<std::wstring>& words ); // synthesize words without a recording in the background
+    bool has_recording( const std::wstring& word );
+    std::wstring find_recording( WordTable::word_id id, const std::wstring& word, OptionsPtr options, size_t path = any_path ); // in that speech path or the first that has it, empty if none
+    std::wstring get_synthesized_file( const std::wstring& word ); // empty if not synthesized yet
     void update_option( const boost::program_options::variables_map& vm ); // ProgramOptions slot
 
 public:
 
-    boost::mutex m_mutex;
-    volatile bool m_no_duplicate;
-    volatile bool m_no_text_to_speech;
-    volatile size_t m_text_to_speech_repeat;
-    std::vector< std::pair<boost::filesystem::path, std::wstring> > m_paths;
+    OptionSnapshot<Options> m_options;
+    ClipCache m_clip_cache;
+    TtsCache m_tts_cache;
+    boost::mutex m_recordings_mutex;
+    boost::unordered_map<recording_key, std::wstring> m_recordings; // -> find_recording(), for options of m_recordings_version
+    boost::unordered_map<recording_key, std::time_t> m_misses;     // -> when it had no recording, looked up again later
+    size_t m_recordings_version;
 };
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "SrtSubtitleParser.h"
 #include "FileUtility.h"
+#include "UnicodeUtility.h"
 #include "ConsoleUtility.h"
 #include "WriteConsoleHelper.h"
 
@@ -8,6 +9,137 @@
 namespace Utility
 {
 
+    // reads UTF-16 (BOM), UTF-8 (with or without BOM) or ANSI text one line at a time;
+    // the encoding is chosen once for the file, from the BOM or else the first chunk, like wstring_from_file
+    class SubtitleLineReader
+    {
+    public:
+
+        SubtitleLineReader( const std::wstring& file_name )
+            : m_is( file_name.c_str(), std::ios::in | std::ios::binary ),
+              m_utf16( false ),
+              m_code_page( CP_ACP )
+        {
+            unsigned char ch[3] = { 0 };
+            m_is.read( (char*)ch, 3 );
+
+            if ( ch[0] == 0xFF && ch[1] == 0xFE )
+            {
+                m_utf16 = true;
+                m_is.clear();
+                m_is.seekg( 2, std::ios::beg );
+            }
+            else if ( ch[0] == 0xEF && ch[1] == 0xBB && ch[2] == 0xBF )
+            {
+                m_code_page = CP_UTF8;
+            }
+            else
+            {
+                m_is.clear();
+                m_is.seekg( 0, std::ios::beg );
+                m_code_page = ( is_utf8_chunk() ? CP_UTF8 : CP_ACP );
+                m_is.clear();
+                m_is.seekg( 0, std::ios::beg );
+            }
+        }
+
+        bool is_utf8_chunk()
+        {
+            std::vector<char> chunk( 64 * 1024 );
+            m_is.read( &chunk[0], chunk.size() );
+            size_t size = static_cast<size_t>( m_is.gcount() );
+
+            if ( size == chunk.size() ) // a sequence cut at the end of the chunk is not an error
+            {
+                size_t cut = size;
+
+                while ( 0 < cut && size - cut < 3 && 0x80 == ( static_cast<unsigned char>( chunk[cut - 1] ) & 0xC0 ) )
+                {
+                    --cut;
+                }
+
+                if ( 0 < cut && 0xC0 <= static_cast<unsigned char>( chunk[cut - 1] ) )
+                {
+                    --cut;
+                }
+
+                size = cut;
+            }
+
+            return is_utf8( &chunk[0], size );
+        }
+
+        bool is_open() { return m_is.is_open(); }
+
+        bool get_line( std::wstring& line )
+        {
+            line.clear();
+
+            if ( m_utf16 )
+            {
+                std::streambuf* buf = m_is.rdbuf();
+                int lo = buf->sbumpc();
+
+                if ( lo == EOF )
+                {
+                    return false;
+                }
+
+                for ( ; lo != EOF; lo = buf->sbumpc() )
+                {
+                    int hi = buf->sbumpc();
+                    wchar_t ch = static_cast<wchar_t>( ( ( hi == EOF ? 0 : hi ) << 8 ) | lo );
+
+                    if ( ch == L'\n' )
+                    {
+                        break;
+                    }
+
+                    line += ch;
+                }
+            }
+            else
+            {
+                if ( ! std::getline( m_is, m_bytes ) )
+                {
+                    return false;
+                }
+
+                if ( ! m_bytes.empty() )
+                {
+                    int size = MultiByteToWideChar( m_code_page, 0, m_bytes.c_str(), m_bytes.size(), 0, 0 );
+
+                    if ( 0 < size )
+                    {
+                        line.resize( size );
+                        MultiByteToWideChar( m_code_page, 0, m_bytes.c_str(), m_bytes.size(), &line[0], size );
+                    }
+                }
+            }
+
+            if ( ! line.empty() && line[line.size() - 1] == L'\r' )
+            {
+                line.erase( line.size() - 1 );
+            }
+
+            return true;
+        }
+
+    public:
+
+        std::ifstream m_is;
+        bool m_utf16;
+        int m_code_page;        // of the lines that are not UTF-16
+        std::string m_bytes;
+    };
+
+
+    static void append_subtitle( SrtSubtitleList* subtitles, const SrtSubtitle& sub )
+    {
+        subtitles->push_back( sub );
+    }
+
+
     SrtSubtitleParser::SrtSubtitleParser( const std::wstring& file_name )
         : m_file_name( file_name )
     {
@@ -17,57 +149,208 @@ namespace Utility
 
     void SrtSubtitleParser::parse()
     {
-        m_subtitles.reserve( 5000 );
-        std::wstring s = Utility::wstring_from_file( m_file_name.c_str() );
-        boost::wsmatch m;
-        boost::wregex e
-        (
-            L"(?x)"
-            L"^ ([0-9]+) [\\r\\n]+"         // $1: number
-            L"^ ([^\\r\\n]+) [\\r\\n]+"     // $2 start-stop time
-            L"^ ([^\\r\\n]+) [\\r\\n]+"     // $3 text
-            L"^ ([^\\r\\n]+)?"              // $4 ?text2
-        );
-
-        boost::wregex time_e
-        (
-            L"([0-9]+):([0-9]+):([0-9]+),([0-9]+) --> ([0-9]+):([0-9]+):([0-9]+),([0-9]+)"
-        );
-
-        boost::wsregex_iterator it( s.begin(), s.end(), e );
-        boost::wsregex_iterator end;
-
-        for ( ; it != end; ++it )
+        m_subtitles.clear();
+        parse_file( m_file_name, boost::bind( &append_subtitle, &m_subtitles, _1 ) );
+    }
+
+
+    bool SrtSubtitleParser::parse_file( const std::wstring& file_name, const cue_handler& handler )
+    {
+        enum { Cue, Identifier, Text, Skip } state = Cue;
+        SubtitleLineReader reader( file_name );
+
+        if ( ! reader.is_open() )
+        {
+            return false;
+        }
+
+        SrtSubtitle sub;
+        size_t index = 0;
+        std::wstring line;
+
+        while ( reader.get_line( line ) )
+        {
+            boost::trim_right( line );
+
+            if ( line.empty() )
+            {
+                if ( state == Text && ! sub.text.empty() )
+                {
+                    handler( sub );
+                }
+
+                sub = SrtSubtitle();
+                state = Cue;
+                continue;
+            }
+
+            switch ( state )
+            {
+            case Cue:
+            case Identifier:
+                if ( parse_timing( line, sub.start_time, sub.stop_time ) )
+                {
+                    sub.number = ( sub.number ? sub.number : index + 1 );
+                    index = sub.number;
+                    state = Text;
+                }
+                else if ( state == Cue && line.find_first_not_of( L"0123456789" ) == std::wstring::npos )
+                {
+                    sub.number = std::wcstoul( line.c_str(), NULL, 10 );
+                    state = Identifier;
+                }
+                else
+                {
+                    state = ( state == Cue ? Identifier : Skip ); // a WebVTT cue id, or WEBVTT, NOTE, STYLE, REGION blocks
+                }
+                break;
+
+            case Text:
+                line = strip_tags( line );
+
+                if ( sub.text.empty() )
+                {
+                    sub.text = line;
+                }
+                else if ( sub.text2.empty() )
+                {
+                    sub.text2 = line;
+                }
+                else
+                {
+                    sub.text2 += L" " + line;
+                }
+                break;
+
+            case Skip:
+                break;
+            }
+        }
+
+        if ( state == Text && ! sub.text.empty() )
+        {
+            handler( sub );
+        }
+
+        return true;
+    }
+
+
+    bool SrtSubtitleParser::parse_timing( const std::wstring& line, size_t& start_time, size_t& stop_time )
+    {
+        const wchar_t* p = line.c_str();
+        const wchar_t* end = p + line.size();
+
+        if ( ! parse_timestamp( p, end, start_time ) )
+        {
+            return false;
+        }
+
+        while ( p != end && *p == L' ' ) { ++p; }
+
+        if ( end - p < 3 || p[0] != L'-' || p[1] != L'-' || p[2] != L'>' )
+        {
+            return false;
+        }
+
+        p += 3;
+        return parse_timestamp( p, end, stop_time ); // WebVTT cue settings may follow
+    }
+
+
+    bool SrtSubtitleParser::parse_timestamp( const wchar_t*& p, const wchar_t* end, size_t& milliseconds )
+    {
+        size_t fields[3] = { 0 };
+        size_t count = 0;
+
+        while ( p != end && *p == L' ' ) { ++p; }
+
+        while ( true ) // hh:mm:ss or mm:ss
         {
-            SrtSubtitle sub;
-            sub.number = boost::lexical_cast<size_t>( it->str(1) );
+            if ( p == end || *p < L'0' || L'9' < *p || count == 3 )
+            {
+                return false;
+            }
 
-            std::wstring time_string = it->str(2);
-            boost::wsmatch m;
-            if ( boost::regex_search( time_string, m, time_e ) )
+            for ( ; p != end && L'0' <= *p && *p <= L'9'; ++p )
             {
-                size_t start_hour           = boost::lexical_cast<size_t>( m.str(1) );
-                size_t start_minute         = boost::lexical_cast<size_t>( m.str(2) );
-                size_t start_second         = boost::lexical_cast<size_t>( m.str(3) );
-                size_t start_millisecond    = boost::lexical_cast<size_t>( m.str(4) );
-                sub.start_time = ( start_hour*3600 + start_minute*60 + start_second ) * 1000 + start_millisecond;
+                fields[count] = fields[count] * 10 + ( *p - L'0' );
+            }
 
-                size_t stop_hour            = boost::lexical_cast<size_t>( m.str(5) );
-                size_t stop_minute          = boost::lexical_cast<size_t>( m.str(6) );
-                size_t stop_second          = boost::lexical_cast<size_t>( m.str(7) );
-                size_t stop_millisecond     = boost::lexical_cast<size_t>( m.str(8) );
-                sub.stop_time = ( stop_hour*3600 + stop_minute*60 + stop_second ) * 1000 + stop_millisecond;
+            count++;
+
+            if ( p == end || *p != L':' )
+            {
+                break;
             }
 
-            sub.text = it->str(3);
-            
-            if ( (*it)[4].matched )
+            ++p;
+        }
+
+        if ( count < 2 || p == end || ( *p != L',' && *p != L'.' ) ) // SRT uses ',', WebVTT '.'
+        {
+            return false;
+        }
+
+        size_t fraction = 0;
+        size_t digits = 0;
+
+        for ( ++p; p != end && L'0' <= *p && *p <= L'9'; ++p )
+        {
+            if ( digits < 3 )
             {
-                sub.text2 = it->str(4);
+                fraction = fraction * 10 + ( *p - L'0' );
+                digits++;
             }
+        }
+
+        for ( ; digits < 3; ++digits )
+        {
+            fraction *= 10;
+        }
+
+        size_t seconds = ( count == 3 ? fields[0] * 3600 + fields[1] * 60 + fields[2] : fields[0] * 60 + fields[1] );
+        milliseconds = seconds * 1000 + fraction;
+        return true;
+    }
+
+
+    std::wstring SrtSubtitleParser::strip_tags( const std::wstring& text )
+    {
+        if ( text.find_first_of( L"<{" ) == std::wstring::npos )
+        {
+            return text;
+        }
+
+        std::wstring result;
+        wchar_t closing = 0;
+
+        for ( size_t i = 0; i < text.size(); ++i )
+        {
+            wchar_t ch = text[i];
 
-            m_subtitles.push_back( sub );
+            if ( closing )
+            {
+                closing = ( ch == closing ? 0 : closing );
+            }
+            else if ( ch == L'<' || ch == L'{' ) // <i>, <c.yellow>, <00:01.000>, {\an8}
+            {
+                closing = ( ch == L'<' ? L'>' : L'}' );
+            }
+            else
+            {
+                result += ch;
+            }
         }
+
+        return result;
+    }
+
+
+    bool SrtSubtitleParser::is_subtitle_file( const std::wstring& file_name )
+    {
+        std::wstring extension = boost::to_lower_copy( boost::filesystem::path( file_name ).extension().wstring() );
+        return extension == L".srt" || extension == L".vtt";
     }
 
 }
@@ -6,8 +6,9 @@ namespace Utility
 
     struct SrtSubtitle
     {
+        SrtSubtitle() : number( 0 ), start_time( 0 ), stop_time( 0 ) {}
         size_t number;
-        size_t start_time;
+        size_t start_time;  // in milliseconds
         size_t stop_time;
         std::wstring text;
         std::wstring text2;
@@ -16,13 +17,26 @@ namespace Utility
     typedef std::vector<SrtSubtitle> SrtSubtitleList;
 
 
+    // SRT and WebVTT, read line by line with a small state machine: only one cue is kept in memory
     class SrtSubtitleParser
     {
     public:
-        
+
+        typedef boost::function<void (const SrtSubtitle&)> cue_handler;
+
+    public:
+
         SrtSubtitleParser( const std::wstring& file_name );
         void parse();
 
+    public:
+
+        static bool parse_file( const std::wstring& file_name, const cue_handler& handler );
+        static bool parse_timing( const std::wstring& line, size_t& start_time, size_t& stop_time );
+        static bool parse_timestamp( const wchar_t*& p, const wchar_t* end, size_t& milliseconds );
+        static std::wstring strip_tags( const std::wstring& text );
+        static bool is_subtitle_file( const std::wstring& file_name );
+
     public:
 
         std::wstring m_file_name;
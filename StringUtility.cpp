@@ -43,25 +43,27 @@ namespace Utility
     std::vector<std::wstring> extract_strings_in_braces( const std::wstring& s, const wchar_t lc, const wchar_t rc )
     {
         std::vector<std::wstring> words;
-        static boost::wregex e;
+        size_t open = std::wstring::npos; // the innermost unclosed lc
 
-        if ( e.empty() )
+        for ( size_t i = 0; i < s.size(); ++i )
         {
-            std::wstringstream strm;
-            strm << L"\\" << lc << L"([^" << lc << rc << L"]+)\\" << rc;
-            e.assign( strm.str() );
-        }
-
-        boost::wsregex_iterator it( s.begin(), s.end(), e );
-        boost::wsregex_iterator end;
+            if ( s[i] == lc )
+            {
+                open = i;
+            }
+            else if ( s[i] == rc )
+            {
+                if ( open != std::wstring::npos )
+                {
+                    std::wstring w = boost::trim_copy( s.substr( open + 1, i - open - 1 ) );
 
-        for ( ; it != end; ++it )
-        {
-            std::wstring w = boost::trim_copy( it->str(1) );
+                    if ( ! w.empty() )
+                    {
+                        words.push_back( w );
+                    }
+                }
 
-            if ( ! w.empty() )
-            {
-                words.push_back( w );
+                open = std::wstring::npos;
             }
         }
 
@@ -0,0 +1,294 @@
+#include "stdafx.h"
+#include "TtsCache.h"
+#include "UnicodeUtility.h"
+#include "HashUtility.h"
+#include "Log.h"
+
+
+SynthesizerPtr Synthesizer::create( const std::wstring& name )
+{
+#ifdef _WIN32
+    if ( name == L"tone" )
+    {
+        return SynthesizerPtr( new ToneSynthesizer );
+    }
+
+    if ( ! name.empty() && name != L"sapi" )
+    {
+        LOG << "unknown synthesizer: " << name << ", use sapi";
+    }
+
+    return SynthesizerPtr( new SapiSynthesizer );
+#else
+    if ( ! name.empty() && name != L"tone" )
+    {
+        LOG << "no synthesizer " << name << " here, use tone";
+    }
+
+    return SynthesizerPtr( new ToneSynthesizer );
+#endif
+}
+
+
+#ifdef _WIN32
+
+
+SapiSynthesizer::SapiSynthesizer()
+    : m_voice( NULL )
+{
+    ::CoCreateInstance( CLSID_SpVoice, NULL, CLSCTX_ALL, IID_ISpVoice, (void **)&m_voice );
+}
+
+
+SapiSynthesizer::~SapiSynthesizer()
+{
+    if ( m_voice )
+    {
+        m_voice->Release();
+    }
+}
+
+
+std::wstring SapiSynthesizer::voice()
+{
+    std::wstring id = L"sapi";
+    ISpObjectToken* token = NULL;
+
+    if ( m_voice && SUCCEEDED( m_voice->GetVoice( &token ) ) )
+    {
+        wchar_t* token_id = NULL;
+
+        if ( SUCCEEDED( token->GetId( &token_id ) ) )
+        {
+            id = token_id;
+            ::CoTaskMemFree( token_id );
+        }
+
+        token->Release();
+    }
+
+    return id;
+}
+
+
+bool SapiSynthesizer::synthesize( const std::wstring& text, const std::wstring& file )
+{
+    if ( NULL == m_voice )
+    {
+        return false;
+    }
+
+    WAVEFORMATEX format = { WAVE_FORMAT_PCM, 1, 22050, 44100, 2, 16, 0 };
+    ISpStream* stream = NULL;
+    HRESULT hr = ::CoCreateInstance( CLSID_SpStream, NULL, CLSCTX_ALL, IID_ISpStream, (void **)&stream );
+
+    if ( FAILED( hr ) )
+    {
+        return false;
+    }
+
+    hr = stream->BindToFile( file.c_str(), SPFM_CREATE_ALWAYS, &SPDFID_WaveFormatEx, &format, SPFEI_ALL_EVENTS );
+
+    if ( SUCCEEDED( hr ) )
+    {
+        hr = m_voice->SetOutput( stream, TRUE );
+
+        if ( SUCCEEDED( hr ) )
+        {
+            hr = m_voice->Speak( text.c_str(), SPF_DEFAULT, NULL );
+            m_voice->SetOutput( NULL, TRUE );
+        }
+
+        stream->Close();
+    }
+
+    stream->Release();
+    return SUCCEEDED( hr );
+}
+#endif
+
+
+bool ToneSynthesizer::synthesize( const std::wstring& text, const std::wstring& file )
+{
+    const boost::uint32_t sample_rate = 16000;
+    const double pi = 3.14159265358979323846;
+    std::string utf8 = Utility::to_string( text, CP_UTF8 );
+    double frequency = 300 + static_cast<double>( Utility::xxhash64( utf8.c_str(), utf8.size() ) % 500 );
+    size_t length = std::min<size_t>( 120 + 60 * text.size(), 2000 ); // in milliseconds
+    std::vector<boost::int16_t> samples( sample_rate * length / 1000 );
+
+    for ( size_t i = 0; i < samples.size(); ++i )
+    {
+        samples[i] = static_cast<boost::int16_t>( 8000 * std::sin( 2 * pi * frequency * i / sample_rate ) );
+    }
+
+    boost::uint16_t fmt[8] = { 1, 1, 0, 0, 0, 0, 2, 16 }; // PCM, mono, rate, byte rate, 2 bytes a sample
+    boost::uint32_t byte_rate = sample_rate * 2;
+    memcpy( &fmt[2], &sample_rate, 4 );
+    memcpy( &fmt[4], &byte_rate, 4 );
+    boost::uint32_t fmt_size = sizeof(fmt);
+    boost::uint32_t data_size = static_cast<boost::uint32_t>( samples.size() * 2 );
+    boost::uint32_t riff_size = 4 + 8 + fmt_size + 8 + data_size;
+
+    boost::filesystem::ofstream os( file, std::ios::out | std::ios::binary | std::ios::trunc );
+    os.write( "RIFF", 4 );
+    os.write( reinterpret_cast<const char*>( &riff_size ), 4 );
+    os.write( "WAVEfmt ", 8 );
+    os.write( reinterpret_cast<const char*>( &fmt_size ), 4 );
+    os.write( reinterpret_cast<const char*>( fmt ), fmt_size );
+    os.write( "data", 4 );
+    os.write( reinterpret_cast<const char*>( &data_size ), 4 );
+    if ( ! samples.empty() ) { os.write( reinterpret_cast<const char*>( &samples[0] ), data_size ); }
+    return !! os;
+}
+
+
+TtsCache::TtsCache()
+    : m_prefill( boost::function<void (const std::vector<std::wstring>&)>( boost::bind( &TtsCache::synthesize_list, this, _1 ) ) )
+{
+}
+
+
+void TtsCache::configure( const std::wstring& directory, SynthesizerPtr synthesizer )
+{
+    boost::unique_lock<boost::mutex> synthesize_lock( m_synthesize_mutex ); // not while the prefill thread uses the old one
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_directory = directory;
+    m_synthesizer = synthesizer;
+    m_voice = ( synthesizer ? synthesizer->voice() : L"" );
+
+    if ( ! m_directory.empty() )
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories( m_directory, ec );
+    }
+
+    LOG_DEBUG << "tts cache: " << m_directory << ", voice " << m_voice;
+}
+
+
+std::wstring TtsCache::get_file_name( const std::wstring& word )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    if ( m_directory.empty() || ! m_synthesizer )
+    {
+        return L"";
+    }
+
+    std::string utf8 = Utility::to_string( m_voice + L"|" + word, CP_UTF8 );
+    std::wstringstream name;
+    name << std::hex << std::setw( 16 ) << std::setfill( L'0' ) << Utility::xxhash64( utf8.c_str(), utf8.size() ) << L".wav";
+    return ( boost::filesystem::path( m_directory ) / name.str() ).wstring();
+}
+
+
+std::wstring TtsCache::get_file( const std::wstring& word )
+{
+    std::wstring file = get_file_name( word );
+
+    if ( file.empty() || ! boost::filesystem::exists( file ) )
+    {
+        return L"";
+    }
+
+    return file;
+}
+
+
+std::wstring TtsCache::synthesize( const std::wstring& word )
+{
+    std::wstring file = get_file_name( word );
+
+    if ( file.empty() || boost::filesystem::exists( file ) )
+    {
+        return file;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock( m_mutex );
+
+        while ( m_synthesizing.find( word ) != m_synthesizing.end() )
+        {
+            m_synthesized.wait( lock );
+        }
+
+        if ( boost::filesystem::exists( file ) )
+        {
+            return file;
+        }
+
+        m_synthesizing.insert( word );
+    }
+
+    std::wstring temp = file + L".tmp";
+    boost::system::error_code ec;
+    bool synthesized = false;
+
+    {
+        boost::unique_lock<boost::mutex> synthesize_lock( m_synthesize_mutex ); // a voice speaks one text at a time
+        synthesized = m_synthesizer->synthesize( word, temp );
+    }
+
+    if ( synthesized )
+    {
+        boost::filesystem::rename( temp, file, ec ); // never a half written file under the final name
+    }
+    else
+    {
+        LOG << "cannot synthesize: " << word;
+    }
+
+    if ( ! synthesized || ec )
+    {
+        boost::filesystem::remove( temp, ec );
+        file.clear();
+    }
+    else
+    {
+        LOG_TRACE << "synthesized " << word << ": " << file;
+    }
+
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    m_synthesizing.erase( word );
+    m_synthesized.notify_all();
+    return file;
+}
+
+
+bool TtsCache::is_synthesizing( const std::wstring& word )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_synthesizing.find( word ) != m_synthesizing.end();
+}
+
+
+void TtsCache::prefill( const std::vector<std::wstring>& words )
+{
+    if ( ! get_file_name( L"" ).empty() )
+    {
+        m_prefill.queue_items( words );
+    }
+}
+
+
+void TtsCache::synthesize_list( const std::vector<std::wstring>& words )
+{
+    std::set<std::wstring> done;
+    size_t count = 0;
+
+    for ( size_t i = 0; i < words.size(); ++i )
+    {
+        if ( ! done.insert( words[i] ).second || ( m_skip && m_skip( words[i] ) ) || ! get_file( words[i] ).empty() )
+        {
+            continue;
+        }
+
+        if ( ! synthesize( words[i] ).empty() )
+        {
+            count++;
+        }
+    }
+
+    LOG_DEBUG << "tts prefill: " << count << " of " << done.size() << " words synthesized";
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "QueueProcessor.h"
+
+
+// turns text into a .wav file; the voice names what it sounds like, so a cache keeps voices apart
+class Synthesizer
+{
+public:
+
+    virtual ~Synthesizer() {}
+    virtual std::wstring voice() = 0;
+    virtual bool synthesize( const std::wstring& text, const std::wstring& file ) = 0;
+
+public:
+
+    static boost::shared_ptr<Synthesizer> create( const std::wstring& name ); // sapi, tone (always tone off Windows)
+};
+
+typedef boost::shared_ptr<Synthesizer> SynthesizerPtr;
+
+
+#ifdef _WIN32
+// the default SAPI voice, spoken into a file instead of the speakers
+class SapiSynthesizer : public Synthesizer
+{
+public:
+
+    SapiSynthesizer();
+    ~SapiSynthesizer();
+    virtual std::wstring voice();
+    virtual bool synthesize( const std::wstring& text, const std::wstring& file );
+
+public:
+
+    ISpVoice* m_voice;
+};
+#endif
+
+
+// no speech engine: a short tone whose pitch and length follow the text, for machines without SAPI and for tests;
+// the only synthesizer where there is no SAPI
+class ToneSynthesizer : public Synthesizer
+{
+public:
+
+    virtual std::wstring voice() { return L"tone"; }
+    virtual bool synthesize( const std::wstring& text, const std::wstring& file );
+};
+
+
+// synthesized words kept as <directory>/<hash of voice and word>.wav, so a word is synthesized once
+// and later plays as a file. prefill() synthesizes a batch of words in the background.
+// callers synthesize different words at once, but the voice speaks one of them at a time
+class TtsCache
+{
+public:
+
+    TtsCache();
+    void configure( const std::wstring& directory, SynthesizerPtr synthesizer );
+    void set_skip( boost::function<bool (const std::wstring&)> skip ) { m_skip = skip; } // words not worth synthesizing, e.g. recorded ones
+    std::wstring get_file( const std::wstring& word );      // empty if not synthesized yet
+    std::wstring synthesize( const std::wstring& word );    // empty on failure, waits for a caller synthesizing the same word
+    bool is_synthesizing( const std::wstring& word );
+    void prefill( const std::vector<std::wstring>& words );
+
+public:
+
+    std::wstring get_file_name( const std::wstring& word );
+    void synthesize_list( const std::vector<std::wstring>& words ); // prefill thread
+
+public:
+
+    boost::mutex m_mutex;
+    std::wstring m_directory;       // empty: disabled
+    SynthesizerPtr m_synthesizer;
+    std::wstring m_voice;
+    std::set<std::wstring> m_synthesizing;  // words in flight
+    boost::condition_variable m_synthesized;
+    boost::mutex m_synthesize_mutex;        // the voice
+    boost::function<bool (const std::wstring&)> m_skip;
+    QueueProcessor<> m_prefill;
+};
@@ -1,33 +1,372 @@
 #include "stdafx.h"
 #include "UnicodeUtility.h"
 
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+#define UNICODE_UTILITY_SSE2
+#endif
+
 
 namespace Utility
 {
 
     std::wstring to_wstring( const std::string& s, int code_page )
     {
-        static wchar_t buffer[ 1024 * 1024];
-        MultiByteToWideChar( code_page, 0, s.c_str(), - 1, buffer, 1024 * 1024 );
-        return std::wstring( buffer );
+        std::wstring ws( s.size(), 0 ); // never more characters than bytes
+
+        if ( s.empty() )
+        {
+            return ws;
+        }
+
+        if ( CP_UTF8 == code_page )
+        {
+            ws.resize( utf8_to_wide( s.data(), s.size(), &ws[0] ) );
+            return ws;
+        }
+
+        size_t ascii = widen_ascii( s.data(), s.size(), &ws[0] ); // ANSI code pages keep ASCII as it is
+
+        if ( ascii == s.size() )
+        {
+            return ws;
+        }
+
+        // only the rest is converted, after the widened prefix; no lead byte of a DBCS code page is below 0x80
+#ifdef _WIN32
+        int rest = MultiByteToWideChar( code_page, 0, s.data() + ascii, static_cast<int>( s.size() - ascii ), &ws[ascii], static_cast<int>( ws.size() - ascii ) );
+        ws.resize( ascii + std::max( rest, 0 ) );
+#else
+        ws.resize( ascii + utf8_to_wide( s.data() + ascii, s.size() - ascii, &ws[ascii] ) ); // no code pages here, the narrow encoding is UTF-8
+#endif
+        return ws;
     }
 
 
     std::string to_string( const std::wstring& ws, int code_page )
     {
-        static char buffer[ 1024 * 1024];
-        WideCharToMultiByte( code_page, 0, ws.c_str(), -1, buffer, 1024 * 1024, 0, 0 );
-        return std::string( buffer );
+        std::string s;
+
+        if ( ws.empty() )
+        {
+            return s;
+        }
+
+        if ( CP_UTF8 == code_page )
+        {
+            s.resize( max_utf8_size( ws.size() ) );
+            s.resize( wide_to_utf8( ws.data(), ws.size(), &s[0] ) );
+            return s;
+        }
+
+        s.resize( ws.size() );
+        size_t ascii = narrow_ascii( ws.data(), ws.size(), &s[0] );
+
+        if ( ascii == ws.size() )
+        {
+            return s;
+        }
+
+#ifdef _WIN32
+        const wchar_t* rest = ws.data() + ascii;
+        int rest_size = static_cast<int>( ws.size() - ascii );
+        int size = WideCharToMultiByte( code_page, 0, rest, rest_size, 0, 0, 0, 0 );
+        s.resize( ascii + std::max( size, 0 ) );
+
+        if ( 0 < size )
+        {
+            WideCharToMultiByte( code_page, 0, rest, rest_size, &s[ascii], size, 0, 0 );
+        }
+#else
+        s.resize( ascii + max_utf8_size( ws.size() - ascii ) );
+        s.resize( ascii + wide_to_utf8( ws.data() + ascii, ws.size() - ascii, &s[ascii] ) ); // no code pages here, the narrow encoding is UTF-8
+#endif
+        return s;
     }
 
 
     std::string to_string( const std::string& s, int code_page_from, int code_page_to )
     {
-        static char buffer[ 1024 * 1024];
-        static wchar_t wbuffer[ 1024 * 1024];
-        int wsize = MultiByteToWideChar( code_page_from, 0, s.c_str(), -1, wbuffer, 1024 * 1024 );
-        WideCharToMultiByte( code_page_to, 0, wbuffer, wsize, buffer, 1024 * 1024, 0, 0 );
-        return std::string( buffer );
+        return to_string( to_wstring( s, code_page_from ), code_page_to );
+    }
+
+
+    size_t widen_ascii( const char* s, size_t size, wchar_t* out )
+    {
+        size_t i = 0;
+
+#if defined(UNICODE_UTILITY_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+
+        for ( ; i + 16 <= size; i += 16 )
+        {
+            __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i ) );
+
+            if ( _mm_movemask_epi8( bytes ) ) // a byte with the high bit
+            {
+                break;
+            }
+
+            __m128i low = _mm_unpacklo_epi8( bytes, zero );
+            __m128i high = _mm_unpackhi_epi8( bytes, zero );
+
+            if ( sizeof(wchar_t) == 2 )
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), low );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i + 8 ), high );
+            }
+            else
+            {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), _mm_unpacklo_epi16( low, zero ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i + 4 ), _mm_unpackhi_epi16( low, zero ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i + 8 ), _mm_unpacklo_epi16( high, zero ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i + 12 ), _mm_unpackhi_epi16( high, zero ) );
+            }
+        }
+#endif
+
+        for ( ; i < size && static_cast<unsigned char>( s[i] ) < 0x80; ++i )
+        {
+            out[i] = s[i];
+        }
+
+        return i;
+    }
+
+
+    size_t narrow_ascii( const wchar_t* s, size_t size, char* out )
+    {
+        size_t i = 0;
+
+#if defined(UNICODE_UTILITY_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+
+        if ( sizeof(wchar_t) == 2 )
+        {
+            const __m128i mask = _mm_set1_epi16( static_cast<short>( 0xFF80 ) );
+
+            for ( ; i + 8 <= size; i += 8 )
+            {
+                __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i ) );
+
+                if ( 0xFFFF != _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_and_si128( v, mask ), zero ) ) )
+                {
+                    break;
+                }
+
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( out + i ), _mm_packus_epi16( v, v ) );
+            }
+        }
+        else
+        {
+            const __m128i mask = _mm_set1_epi32( static_cast<int>( 0xFFFFFF80 ) );
+
+            for ( ; i + 8 <= size; i += 8 )
+            {
+                __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i ) );
+                __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i + 4 ) );
+
+                if ( 0xFFFF != _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( _mm_or_si128( a, b ), mask ), zero ) ) )
+                {
+                    break;
+                }
+
+                __m128i words = _mm_packs_epi32( a, b );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( out + i ), _mm_packus_epi16( words, words ) );
+            }
+        }
+#endif
+
+        for ( ; i < size && 0 == ( static_cast<boost::uint32_t>( s[i] ) & 0xFFFFFF80 ); ++i )
+        {
+            out[i] = static_cast<char>( s[i] );
+        }
+
+        return i;
+    }
+
+
+    // one UTF-8 sequence at s[0]; false and the length of its valid prefix (one U+FFFD) if it is ill-formed
+    static bool decode_utf8( const unsigned char* u, size_t size, boost::uint32_t& code, size_t& length )
+    {
+        unsigned char c = u[0];
+        code = 0xFFFD;
+        length = 1;
+
+        if ( 0xC2 <= c && c <= 0xDF )
+        {
+            length = 2;
+        }
+        else if ( 0xE0 <= c && c <= 0xEF )
+        {
+            length = 3;
+        }
+        else if ( 0xF0 <= c && c <= 0xF4 )
+        {
+            length = 4;
+        }
+        else
+        {
+            return false;
+        }
+
+        // the second byte range rules out overlongs, surrogates and code points above 0x10FFFF
+        unsigned char low = ( 0xE0 == c ? 0xA0 : 0xF0 == c ? 0x90 : 0x80 );
+        unsigned char high = ( 0xED == c ? 0x9F : 0xF4 == c ? 0x8F : 0xBF );
+        boost::uint32_t value = c & ( 0x7F >> length );
+        size_t k = 1;
+
+        for ( ; k < length && k < size && ( 1 == k ? low : 0x80 ) <= u[k] && u[k] <= ( 1 == k ? high : 0xBF ); ++k )
+        {
+            value = ( value << 6 ) | ( u[k] & 0x3F );
+        }
+
+        if ( k < length )
+        {
+            length = k;
+            return false;
+        }
+
+        code = value;
+        return true;
+    }
+
+
+    size_t utf8_to_wide( const char* s, size_t size, wchar_t* out )
+    {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>( s );
+        size_t i = 0;
+        size_t n = 0;
+
+        while ( i < size )
+        {
+            size_t run = widen_ascii( s + i, size - i, out + n );
+            i += run;
+            n += run;
+
+            if ( size <= i )
+            {
+                break;
+            }
+
+            boost::uint32_t code = 0;
+            size_t length = 0;
+            decode_utf8( u + i, size - i, code, length );
+
+            if ( sizeof(wchar_t) == 2 && 0x10000 <= code )
+            {
+                code -= 0x10000;
+                out[n++] = static_cast<wchar_t>( 0xD800 + ( code >> 10 ) );
+                out[n++] = static_cast<wchar_t>( 0xDC00 + ( code & 0x3FF ) );
+            }
+            else
+            {
+                out[n++] = static_cast<wchar_t>( code );
+            }
+
+            i += length;
+        }
+
+        return n;
+    }
+
+
+    size_t ascii_length( const char* s, size_t size )
+    {
+        size_t i = 0;
+
+#if defined(UNICODE_UTILITY_SSE2)
+        for ( ; i + 16 <= size; i += 16 )
+        {
+            if ( _mm_movemask_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i ) ) ) )
+            {
+                break;
+            }
+        }
+#endif
+
+        while ( i < size && static_cast<unsigned char>( s[i] ) < 0x80 )
+        {
+            ++i;
+        }
+
+        return i;
+    }
+
+
+    bool is_utf8( const char* s, size_t size )
+    {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>( s );
+        size_t i = 0;
+
+        while ( ( i += ascii_length( s + i, size - i ) ) < size )
+        {
+            boost::uint32_t code = 0;
+            size_t length = 0;
+
+            if ( ! decode_utf8( u + i, size - i, code, length ) )
+            {
+                return false;
+            }
+
+            i += length;
+        }
+
+        return true;
+    }
+
+
+    size_t wide_to_utf8( const wchar_t* s, size_t size, char* out )
+    {
+        size_t i = 0;
+        size_t n = 0;
+
+        while ( i < size )
+        {
+            size_t run = narrow_ascii( s + i, size - i, out + n );
+            i += run;
+            n += run;
+
+            if ( size <= i )
+            {
+                break;
+            }
+
+            boost::uint32_t code = static_cast<boost::uint32_t>( s[i++] );
+
+            if ( sizeof(wchar_t) == 2 )
+            {
+                code &= 0xFFFF;
+            }
+
+            if ( 0xD800 <= code && code <= 0xDBFF && i < size && 0xDC00 <= ( s[i] & 0xFFFF ) && ( s[i] & 0xFFFF ) <= 0xDFFF )
+            {
+                code = 0x10000 + ( ( code - 0xD800 ) << 10 ) + ( ( s[i++] & 0xFFFF ) - 0xDC00 );
+            }
+            else if ( ( 0xD800 <= code && code <= 0xDFFF ) || 0x10FFFF < code ) // a lone surrogate
+            {
+                code = 0xFFFD;
+            }
+
+            if ( code < 0x800 )
+            {
+                out[n++] = static_cast<char>( 0xC0 | ( code >> 6 ) );
+            }
+            else if ( code < 0x10000 )
+            {
+                out[n++] = static_cast<char>( 0xE0 | ( code >> 12 ) );
+                out[n++] = static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+            }
+            else
+            {
+                out[n++] = static_cast<char>( 0xF0 | ( code >> 18 ) );
+                out[n++] = static_cast<char>( 0x80 | ( ( code >> 12 ) & 0x3F ) );
+                out[n++] = static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+            }
+
+            out[n++] = static_cast<char>( 0x80 | ( code & 0x3F ) );
+        }
+
+        return n;
     }
 
 }
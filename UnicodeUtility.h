@@ -6,4 +6,15 @@ namespace Utility
     std::wstring to_wstring( const std::string& s, int code_page );
     std::string to_string( const std::wstring& ws, int code_page );
     std::string to_string( const std::string& s, int code_page_from, int code_page_to );
+
+    // UTF-8 <-> wchar_t (UTF-16 on Windows, UTF-32 elsewhere) without the Windows API, on explicit lengths
+    // into the caller's buffer; invalid input becomes U+FFFD. out needs room for size wchar_t (utf8_to_wide)
+    // or max_utf8_size( size ) chars (wide_to_utf8). both return the number of units written
+    size_t utf8_to_wide( const char* s, size_t size, wchar_t* out );
+    size_t wide_to_utf8( const wchar_t* s, size_t size, char* out );
+    inline size_t max_utf8_size( size_t wide_size ) { return wide_size * ( sizeof(wchar_t) == 2 ? 3 : 4 ); }
+    size_t widen_ascii( const char* s, size_t size, wchar_t* out );     // copies the leading bytes below 0x80, returns how many
+    size_t narrow_ascii( const wchar_t* s, size_t size, char* out );    // copies the leading characters below 0x80, returns how many
+    size_t ascii_length( const char* s, size_t size );                  // the number of leading bytes below 0x80
+    bool is_utf8( const char* s, size_t size );                         // well-formed UTF-8 (pure ASCII is)
 }
@@ -5,6 +5,7 @@
 #include "SoundUtility.h"
 #include "ConsoleUtility.h"
 #include "FileUtility.h"
+#include "HashUtility.h"
 #include "WriteConsoleHelper.h"
 
 #ifdef max
@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "WordTable.h"
+
+static WordTable word_table; // constructed before main, so no race on first use
+
+
+WordTable& WordTable::instance()
+{
+    return word_table;
+}
+
+
+WordTable::word_id WordTable::intern( const std::wstring& word )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+
+    boost::unordered_map<std::wstring, word_id>::iterator it = m_ids.find( word );
+
+    if ( it != m_ids.end() )
+    {
+        return it->second;
+    }
+
+    word_id id = static_cast<word_id>( m_words.size() );
+    m_words.push_back( word );
+    m_ids[word] = id;
+    return id;
+}
+
+
+std::vector<WordTable::word_id> WordTable::intern_words( const std::vector<std::wstring>& words )
+{
+    std::vector<word_id> ids;
+    ids.reserve( words.size() );
+
+    for ( size_t i = 0; i < words.size(); ++i )
+    {
+        ids.push_back( intern( words[i] ) );
+    }
+
+    return ids;
+}
+
+
+std::wstring WordTable::get_word( word_id id )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_words[id];
+}
+
+
+std::vector<std::wstring> WordTable::get_words( const std::vector<word_id>& ids )
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    std::vector<std::wstring> words;
+    words.reserve( ids.size() );
+
+    for ( size_t i = 0; i < ids.size(); ++i )
+    {
+        words.push_back( m_words[ids[i]] );
+    }
+
+    return words;
+}
+
+
+size_t WordTable::size()
+{
+    boost::unique_lock<boost::mutex> lock( m_mutex );
+    return m_words.size();
+}
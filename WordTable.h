@@ -0,0 +1,30 @@
+#pragma once
+
+
+// interns the {braced} speech words of all decks into dense 32 bit ids when the decks are loaded,
+// so a card keeps a short list of ids and per-word data lives in tables indexed by id.
+// one table for the process: the same word in two decks has one id
+class WordTable
+{
+public:
+
+    typedef boost::uint32_t word_id;
+
+public:
+
+    word_id intern( const std::wstring& word );
+    std::vector<word_id> intern_words( const std::vector<std::wstring>& words );
+    std::wstring get_word( word_id id );
+    std::vector<std::wstring> get_words( const std::vector<word_id>& ids );
+    size_t size();
+
+public:
+
+    static WordTable& instance();
+
+public:
+
+    boost::mutex m_mutex;
+    std::vector<std::wstring> m_words;                      // id -> word
+    boost::unordered_map<std::wstring, word_id> m_ids;      // word -> id
+};
@@ -2,6 +2,7 @@
 #include "Log.h"
 #include "OptionString.h"
 #include "ReviewManager.h"
+#include "ReviewServer.h"
 #include "OptionString.h"
 #include "ProgramOptions.h"
 #include "ConsoleCommand.h"
@@ -14,9 +15,12 @@ int _tmain(int argc, _TCHAR* argv[])
     op::options_description desc( "Options", 100 );
     desc.add_options()
         ( "help,?", "produce help message" )
-        ( file_name_option, op::wvalue<std::wstring>(),  "the file to be reviewed" )
+        ( file_name_option, op::wvalue<std::wstring>(),  "the file to be reviewed (lines, .srt/.vtt subtitles or a directory of them)" )
         ( file_history_option, op::wvalue<std::wstring>(),  ".history" )
         ( file_review_option, op::wvalue<std::wstring>(),  ".review, history cache" )
+        ( file_times_option, op::wvalue<std::wstring>(),  ".times, every review time (cold)" )
+        ( file_decks_option, op::wvalue<std::wstring>(),  "more files reviewed together with file.name, separated by |" )
+        ( file_back_option, op::wvalue<std::wstring>(),  ".back, the last reviewed cards (empty: not saved)" )
         ( config_option, op::wvalue<std::wstring>(),  "config file" )
         ( review_schedule, op::wvalue<std::wstring>(), "review schedule (time span list)" )
         ( review_minimal_time_option, op::value<boost::timer::nanosecond_type>()->default_value( 500 ),  "in miniseconds" )
@@ -26,20 +30,37 @@ int _tmain(int argc, _TCHAR* argv[])
         ( review_display_format_option, op::wvalue<std::wstring>(),  "display format" )
         ( review_once_per_days_option, op::value<size_t>()->default_value( 0 ),  "only review once in [n] days" )
         ( review_minimal_review_distance_option, op::value<size_t>()->default_value( 10 ),  "minimal review distance" )
+        ( review_scheduler_option, op::wvalue<std::wstring>(), "scheduler (fixed|sm2)" )
+        ( review_evaluate_scheduler_option, op::wvalue<std::wstring>(), "replay the history with every scheduler and exit (true|false)" )
+        ( review_session_size_option, op::value<size_t>()->default_value( 0 ), "order [n] due cards ahead, 0 picks one card at a time" )
+        ( review_back_size_option, op::value<size_t>()->default_value( 1000 ), "remember the last [n] reviewed cards to go back" )
+        ( review_forecast_days_option, op::value<size_t>()->default_value( 14 ), "days of due forecast and reviews in the stats" )
+        ( review_dump_stats_option, op::wvalue<std::wstring>(), "print the stats of every deck and exit (true|false)" )
         ( speech_play_back, op::value<size_t>()->default_value( 0 ),  "listen back [n]" )
         ( speech_disabled_option, op::wvalue<std::wstring>(), "true|false" )
         ( speech_path_option, op::wvalue< std::vector<std::wstring> >()->multitoken(), "speech path" )
         ( speech_no_duplicate, op::wvalue<std::wstring>(), "no duplicate (true|false)" )
         ( speech_no_text_to_speech, op::wvalue<std::wstring>(), "no TTS(text-to-speech) (true|false)" )
+        ( speech_clip_cache_path_option, op::wvalue<std::wstring>(), "where clips cut from the .wav beside a subtitle deck are kept" )
+        ( speech_clip_cache_size_option, op::value<size_t>()->default_value( 100 ), "clip cache size in MB" )
+        ( speech_output_option, op::wvalue<std::wstring>(), "where sound goes: windows, null, wav:<file>" )
+        ( speech_tts_cache_path_option, op::wvalue<std::wstring>(), "where synthesized words are kept, empty to speak them live every time" )
+        ( speech_tts_voice_option, op::wvalue<std::wstring>(), "synthesizer of the tts cache: sapi, tone" )
         ( listen_no_string_option, op::wvalue<std::wstring>(), "no original string (true|false)" )
         ( listen_all_option, op::wvalue<std::wstring>(), "listen all? (true|false)" )
+        ( listen_prefetch_option, op::value<size_t>()->default_value( 4 ), "cards resolved ahead of the one playing" )
+        ( listen_pause_option, op::value<size_t>()->default_value( 0 ), "pause between cards in milliseconds" )
+        ( listen_export_option, op::wvalue<std::wstring>(), "render listen mode into this .wav (with a .chapters index) and exit" )
         ( upgrade_hash_algorithm_option, op::wvalue<std::wstring>(), "upgrade hash algorithm (true|false)" )
         ( system_font_face_name, op::wvalue<std::wstring>(), "console font name" )
         ( system_font_size, op::value<SHORT>()->default_value( 18 ), "console font size" )
         ( system_console_width, op::value<SHORT>()->default_value( 60 ), "console width" )
         ( system_console_height, op::value<SHORT>()->default_value( 5 ), "console height" )
         ( system_console_color, op::wvalue<std::wstring>(), "console color" )
+        ( system_console_renderer, op::wvalue<std::wstring>(), "how frames reach the screen: windows, ansi (VT escape sequences)" )
         ( system_picture_path, op::wvalue<std::wstring>(), "desktop wallpaper path" )
+        ( server_port_option, op::value<unsigned short>()->default_value( 0 ), "serve the review API on 127.0.0.1:[port], 0 is off" )
+        ( server_request_option, op::value<std::string>(), "send one request (e.g. /next?session=1) to the running server, print the answer and exit" )
         ;
 
     desc.add( Log::get_description() );
@@ -54,6 +75,27 @@ int _tmain(int argc, _TCHAR* argv[])
 
     Log::initialize( vm );
 
+    if ( vm.count( server_request_option ) )
+    {
+        if ( 0 == vm[server_port_option].as<unsigned short>() ) // 0 is the server off, there is nothing to ask
+        {
+            std::cout << "must set " << server_port_option << " to the port of the running server for " << server_request_option << std::endl;
+            return 1;
+        }
+
+        try
+        {
+            std::cout << ReviewServer::request( vm[server_port_option].as<unsigned short>(), vm[server_request_option].as<std::string>() ) << std::endl;
+        }
+        catch ( std::exception& e )
+        {
+            std::cout << e.what() << std::endl;
+            return 1; // e.g. no server on the port
+        }
+
+        return 0;
+    }
+
     if ( ! vm.count( file_name_option ) )
     {
         std::cout << "must set " << file_name_option << std::endl;
@@ -61,14 +103,25 @@ int _tmain(int argc, _TCHAR* argv[])
         return 0;
     }
 
-    std::wstring file_name = vm[file_name_option].as<std::wstring>();
-    Utility::remove_if_isany_of( file_name, ".\\|/:<>?*\"" );
+    std::vector<std::wstring> file_names( 1, vm[file_name_option].as<std::wstring>() );
 
-    if ( ::CreateMutex( NULL, FALSE, file_name.c_str() ) == NULL || GetLastError() == ERROR_ALREADY_EXISTS )
+    if ( vm.count( file_decks_option ) )
     {
-        std::cout << "error: another instance is running." << std::endl;
-        system( "pause" );
-        return 0;
+        std::vector<std::wstring> decks = Utility::split_string( vm[file_decks_option].as<std::wstring>(), L"|" );
+        file_names.insert( file_names.end(), decks.begin(), decks.end() );
+    }
+
+    for ( size_t i = 0; i < file_names.size(); ++i )
+    {
+        std::wstring file_name = boost::trim_copy( file_names[i] );
+        Utility::remove_if_isany_of( file_name, ".\\|/:<>?*\"" );
+
+        if ( ::CreateMutex( NULL, FALSE, file_name.c_str() ) == NULL || GetLastError() == ERROR_ALREADY_EXISTS )
+        {
+            std::cout << "error: another instance is running." << std::endl;
+            system( "pause" );
+            return 0;
+        }
     }
 
     ConsoleCommand console_command;
@@ -78,11 +131,37 @@ int _tmain(int argc, _TCHAR* argv[])
         ::CoInitializeEx( NULL, COINIT_MULTITHREADED );
         ReviewManager rm;
 
-        //if ( vm[upgrade_hash_algorithm_option].as<std::wstring>() == L"true" )
-        //{
-        //    rm.upgrade_hash_algorithm();
-        //    return 0;
-        //}
+        if ( vm.count( upgrade_hash_algorithm_option ) && vm[upgrade_hash_algorithm_option].as<std::wstring>() == L"true" )
+        {
+            rm.upgrade_hash_algorithm();
+            return 0;
+        }
+
+        if ( vm.count( review_evaluate_scheduler_option ) && vm[review_evaluate_scheduler_option].as<std::wstring>() == L"true" )
+        {
+            rm.evaluate_schedulers();
+            return 0;
+        }
+
+        rm.initialize();
+
+        if ( vm.count( review_dump_stats_option ) && vm[review_dump_stats_option].as<std::wstring>() == L"true" )
+        {
+            rm.dump_stats();
+            return 0;
+        }
+
+        if ( vm.count( listen_export_option ) )
+        {
+            return rm.export_listen( vm[listen_export_option].as<std::wstring>() ) ? 0 : 1;
+        }
+
+        boost::scoped_ptr<ReviewServer> server;
+
+        if ( vm[server_port_option].as<unsigned short>() )
+        {
+            server.reset( new ReviewServer( &rm, vm[server_port_option].as<unsigned short>() ) );
+        }
 
         rm.review();
     }
@@ -8,11 +8,13 @@
 #include "targetver.h"
 
 #include <stdio.h>
-#include <tchar.h>
+#include <boost/asio.hpp> // before windows.h, it needs winsock2.h
 
 
 
 // TODO: reference additional headers your program requires here
+#ifdef _WIN32
+#include <tchar.h>
 #include <windows.h>
 #include <MMSystem.h>
 #pragma  comment( lib, "winmm.lib" )
@@ -22,8 +24,18 @@
 #include <atlbase.h>
 #include <atlcom.h>
 #include <sapi.h>
-#include <stdlib.h>
+#pragma comment( lib, "sapi.lib" )
 #include <conio.h>
+#else // only the portable parts (Unicode and file utilities, the tone synthesizer, the ANSI console, the wav sink) build here
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define CP_ACP  0       // the code page numbers Utility::to_wstring and to_string take
+#define CP_UTF8 65001
+#endif
+#include <stdlib.h>
 #include <limits>
 #include <iostream>
 #include <string>
@@ -33,10 +45,18 @@
 #include <map>
 #include <set>
 #include <list>
+#include <deque>
 #include <fstream>
 #include <sstream>
+#if defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
@@ -49,8 +69,10 @@
 #include <boost/log/utility/setup.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/random_generator.hpp>
+#include <boost/bind.hpp> // _1 and friends, newer boost no longer brings them in through thread
 #include <boost/functional.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/local_function.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>